@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+
+/**
+ * @brief	Reads a monotonic clock
+ *
+ * @param	none
+ *
+ * @retval	The time in nanoseconds
+ */
+static uint64_t Nanoseconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief	Opens a counter of the instructions this process runs in user mode
+ *
+ * @param	none
+ *
+ * @retval	The counter's file descriptor, or -1 if there's none
+ */
+static int OpenInstructionCounter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief	Prints the header line of the CSV
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void BenchHeader(void)
+{
+	printf("benchmark,iterations,ns_per_op,instructions_per_op\n");
+}
+
+/**
+ * @brief	Prints a benchmark's line of the CSV
+ *
+ * @param	name The name of the benchmark
+ * @param	iterations How many times the code ran
+ * @param	elapsed How long that took, in nanoseconds
+ * @param	counter The instruction counter, or -1 if there's none
+ * @param	instructions How many instructions that took
+ *
+ * @retval	none
+ */
+static void PrintResult(const char *name, uint64_t iterations, uint64_t elapsed, int counter, uint64_t instructions)
+{
+	printf("%s,%llu,%.1f,", name, (unsigned long long)iterations, (double)elapsed / iterations);
+
+	if(counter >= 0)
+	{
+		printf("%.1f", (double)instructions / iterations);
+		close(counter);
+	}
+
+	printf("\n");
+}
+
+/**
+ * @brief	Runs a benchmark for at least BENCH_MIN_NS, doubling the
+ * 			iterations of every round, and prints its line of the CSV
+ * 			from the last round
+ *
+ * @param	name The name of the benchmark
+ * @param	func The code to time
+ *
+ * @retval	none
+ */
+void Bench(const char *name, BenchFunc func)
+{
+	int counter = OpenInstructionCounter();
+	uint64_t iterations, i, start, elapsed, instructions = 0;
+
+	// Warm up the caches and branch predictors
+	func();
+
+	for(iterations = 1; ; iterations *= 2)
+	{
+		if(counter >= 0)
+		{
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+		}
+
+		start = Nanoseconds();
+
+		for(i = 0; i < iterations; ++i)
+			func();
+
+		elapsed = Nanoseconds() - start;
+
+		if(counter >= 0)
+		{
+			ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+
+			if(read(counter, &instructions, sizeof(instructions)) != sizeof(instructions))
+				instructions = 0;
+		}
+
+		if(elapsed >= BENCH_MIN_NS / 4 && iterations >= 4)
+			break;
+	}
+
+	PrintResult(name, iterations, elapsed, counter, instructions);
+}
+
+/**
+ * @brief	Like Bench(), for code that needs something done before
+ * 			every run that shouldn't be timed. Every run is timed (and
+ * 			its instructions counted) on its own, so the clock and the
+ * 			counter add a little to every run.
+ *
+ * @param	name The name of the benchmark
+ * @param	setup The code to run before every run, untimed
+ * @param	func The code to time
+ *
+ * @retval	none
+ */
+void BenchSetup(const char *name, BenchFunc setup, BenchFunc func)
+{
+	int counter = OpenInstructionCounter();
+	uint64_t iterations, i, start, elapsed, instructions, count;
+
+	// Warm up the caches and branch predictors
+	setup();
+	func();
+
+	for(iterations = 1; ; iterations *= 2)
+	{
+		elapsed = 0;
+		instructions = 0;
+
+		if(counter >= 0)
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+
+		for(i = 0; i < iterations; ++i)
+		{
+			setup();
+
+			if(counter >= 0)
+				ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+
+			start = Nanoseconds();
+			func();
+			elapsed += Nanoseconds() - start;
+
+			if(counter >= 0)
+				ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		}
+
+		if(counter >= 0 && read(counter, &count, sizeof(count)) == sizeof(count))
+			instructions = count;
+
+		if(elapsed >= BENCH_MIN_NS / 4 && iterations >= 4)
+			break;
+	}
+
+	PrintResult(name, iterations, elapsed, counter, instructions);
+}
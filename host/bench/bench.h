@@ -0,0 +1,32 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+/**
+ * Shared by the host benchmarks (see host/Makefile). Every benchmark line
+ * is CSV:
+ *
+ * 		benchmark,iterations,ns_per_op,instructions_per_op
+ *
+ * instructions_per_op comes from the CPU's instruction counter (perf
+ * events), and is empty where that isn't available. It's the number to
+ * compare across machines and runs, ns_per_op depends on the machine.
+ */
+
+// Nanoseconds every benchmark runs for, at least
+#define BENCH_MIN_NS 200000000ULL
+
+// The code a benchmark times
+typedef void (*BenchFunc)(void);
+
+// Prints the header line of the CSV
+void BenchHeader(void);
+
+// Runs a benchmark over and over and prints its line of the CSV
+void Bench(const char *name, BenchFunc func);
+
+// Like Bench(), running setup untimed before every run of func
+void BenchSetup(const char *name, BenchFunc setup, BenchFunc func);
+
+#endif /* BENCH_H_ */
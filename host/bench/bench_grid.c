@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "LedMatrix.h"
+#include "pacman.h"
+#include "bench.h"
+
+/**
+ * Compares DrawGridArray() and DrawRowLine(), which fill in whole runs of
+ * pixels, against drawing the same pixels one by one with DrawPixel() (the
+ * way DrawGridArray() used to), on grids with long and short runs.
+ */
+
+// The grid being drawn
+static GridArray grid;
+
+/**
+ * @brief	Draws the set bits of the grid pixel by pixel, the way
+ * 			DrawGridArray() used to
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void PixelGrid(void)
+{
+	uint8_t row, col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		for(col = 0; col < MAX_COLS; ++col)
+			if(GET_GRIDARRAY_BIT(grid, row, col))
+				DrawPixel(row, col);
+}
+
+/**
+ * @brief	Draws the grid with DrawGridArray()
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void RunGrid(void)
+{
+	DrawGridArray(grid);
+}
+
+/**
+ * @brief	Draws every row of the display pixel by pixel
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void PixelRows(void)
+{
+	uint8_t row, col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		for(col = 0; col < MAX_COLS; ++col)
+			DrawPixel(row, col);
+}
+
+/**
+ * @brief	Draws every row of the display with DrawRowLine()
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void LineRows(void)
+{
+	uint8_t row;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		DrawRowLine(row, 0, MAX_COLS);
+}
+
+/**
+ * @brief	Times both ways of drawing a grid
+ *
+ * @param	name What's in the grid
+ *
+ * @retval	none
+ */
+static void BenchGrid(const char *name)
+{
+	char label[64];
+
+	snprintf(label, sizeof(label), "grid_%s_per_pixel", name);
+	Bench(label, PixelGrid);
+
+	snprintf(label, sizeof(label), "grid_%s_runs", name);
+	Bench(label, RunGrid);
+}
+
+int main(void)
+{
+	uint8_t row, col;
+
+	SetColor(COLOR_MAX, COLOR_MAX / 2, 0);
+	BenchHeader();
+
+	// The built-in level: long walls and a few gaps
+	memcpy(grid, level, sizeof(grid));
+	BenchGrid("level");
+
+	// Every other pixel, the worst case for runs
+	for(row = 0; row < MAX_ROWS; ++row)
+		for(col = 0; col < MAX_COLS; ++col)
+			if((row + col) % 2)
+				SET_GRIDARRAY_BIT(grid, row, col);
+			else
+				CLEAR_GRIDARRAY_BIT(grid, row, col);
+
+	BenchGrid("checkerboard");
+
+	memset(grid, 0, sizeof(grid));
+	BenchGrid("empty");
+
+	memset(grid, 0xFF, sizeof(grid));
+	BenchGrid("full");
+
+	Bench("rows_per_pixel", PixelRows);
+	Bench("rows_lines", LineRows);
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "pacman.h"
+#include "scheduler.h"
+#include "utility.h"
+#include "bench.h"
+
+/**
+ * The hot paths the device's 'b' command times (see benchmark.h), on the
+ * booted firmware: the drawing functions, a whole game tick, and the
+ * refresh interrupt through a whole frame. Like on the device, everything
+ * runs with interrupts masked. The mock charges every register access, so
+ * the refresh numbers include simulating the GPIO writes (and the waits for
+ * polled cycles spin on the simulated clock).
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// The game's and the refresh's timer interrupts, called directly
+extern void Timer1Int(void);
+extern void Timer0AInt(void);
+
+// The code each benchmark times
+static void BenchClearMatrix(void)
+{
+	ClearMatrix();
+}
+
+static void BenchDrawSolidColor(void)
+{
+	SetColor(COLOR_MAX, 0, COLOR_MAX);
+	DrawSolidColor();
+}
+
+static void BenchDrawRowLine(void)
+{
+	SetColor(COLOR_MAX, COLOR_MAX, 0);
+	DrawRowLine(MAX_ROWS / 2, 0, MAX_COLS);
+}
+
+static void BenchDrawColumnLine(void)
+{
+	SetColor(0, COLOR_MAX, COLOR_MAX);
+	DrawColumnLine(MAX_COLS / 2, 0, MAX_ROWS);
+}
+
+static void BenchDrawGridArray(void)
+{
+	SetColor(0, COLOR_MAX, COLOR_MAX);
+	DrawGridArray(level);
+}
+
+// The interrupt, then the tick it starts
+static void BenchGameTick(void)
+{
+	Timer1Int();
+	RunTask(EVENT_TICK);
+}
+
+// Lets the last frame get displayed, so the next tick doesn't skip composing one
+static void ShowPendingFrame(void)
+{
+	while(FramePending())
+		Timer0AInt();
+}
+
+int main(void)
+{
+	BootFirmware(SECOND / 10);
+	SAVE_AND_DISABLE_INTERRUPTS();
+
+	BenchHeader();
+	Bench("ClearMatrix", BenchClearMatrix);
+	Bench("DrawSolidColor", BenchDrawSolidColor);
+	Bench("DrawRowLine", BenchDrawRowLine);
+	Bench("DrawColumnLine", BenchDrawColumnLine);
+	Bench("DrawGridArray", BenchDrawGridArray);
+
+	// The benchmarks drew all over the back buffer
+	InvalidateLayers();
+	BenchSetup("GameTick", ShowPendingFrame, BenchGameTick);
+	Bench("ScanoutFrame", ScanoutFrame);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+#include "LedMatrix.h"
+#include "pathfind.h"
+#include "pacman.h"
+#include "bench.h"
+
+/**
+ * Compares ComputeDistanceField(), which expands a whole row of the BFS
+ * frontier at once, against a queue based search that expands one cell at
+ * a time, on the built-in level and on a level with a maze of corridors.
+ */
+
+static GridArray walls;
+static DistanceField field;
+
+/**
+ * @brief	Fills in a distance field to the middle of the level one cell
+ * 			at a time, with a queue
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void QueueBfs(void)
+{
+	static uint16_t queue[MAX_ROWS * MAX_COLS];
+	static const int8_t moves[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+	uint16_t head = 0, tail = 0, dist;
+	uint8_t r, c, next_r, next_c, i;
+
+	memset(field, PATH_UNREACHABLE, sizeof(field));
+	field[MAX_ROWS / 2 - 3][MAX_COLS / 2] = 0;
+	queue[tail++] = (MAX_ROWS / 2 - 3) * MAX_COLS + MAX_COLS / 2;
+
+	while(head != tail)
+	{
+		r = queue[head] / MAX_COLS;
+		c = queue[head] % MAX_COLS;
+		head++;
+		dist = field[r][c] + 1;
+
+		for(i = 0; i < 4; ++i)
+		{
+			next_r = (r + MAX_ROWS + moves[i][0]) % MAX_ROWS;
+			next_c = (c + MAX_COLS + moves[i][1]) % MAX_COLS;
+
+			if(GET_GRIDARRAY_BIT(walls, next_r, next_c) || field[next_r][next_c] != PATH_UNREACHABLE)
+				continue;
+
+			field[next_r][next_c] = (dist < PATH_UNREACHABLE - 1) ? dist : PATH_UNREACHABLE - 1;
+			queue[tail++] = next_r * MAX_COLS + next_c;
+		}
+	}
+}
+
+/**
+ * @brief	Fills in the same distance field with ComputeDistanceField()
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void BitBfs(void)
+{
+	ComputeDistanceField(walls, MAX_ROWS / 2 - 3, MAX_COLS / 2, field);
+}
+
+/**
+ * @brief	Gets the distance field from the cache, after the first time
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void CachedBfs(void)
+{
+	GetDistanceField(MAX_ROWS / 2 - 3, MAX_COLS / 2);
+}
+
+int main(void)
+{
+	uint8_t row;
+
+	BenchHeader();
+
+	memcpy(walls, level, sizeof(walls));
+	Bench("bfs_level_queue", QueueBfs);
+	Bench("bfs_level_bitboard", BitBfs);
+
+	SetPathLevel(walls);
+	Bench("bfs_level_cached", CachedBfs);
+
+	// Long winding corridors: every other row is a wall with a gap at alternating ends
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		if(row % 2 == 0)
+			walls[row] = 0;
+		else if(row % 4 == 1)
+			walls[row] = GRIDROW_ALL & ~(GridRow)1;
+		else
+			walls[row] = GRIDROW_ALL >> 1;
+	}
+
+	Bench("bfs_corridors_queue", QueueBfs);
+	Bench("bfs_corridors_bitboard", BitBfs);
+
+	return 0;
+}
@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "protocol.h"
+#include "stream.h"
+#include "UART.h"
+#include "streamenc.h"
+#include "bench.h"
+
+/**
+ * Times the streaming encoder (host/streamenc.c), then measures how many
+ * frames per second streaming mode sustains at a few baud rates, for a
+ * few kinds of animation. After the usual CSV (see bench.h), a second
+ * table follows, with its own header:
+ *
+ * 		scene,baud,bytes_per_frame,link_fps,decoded_fps,rx_overflows
+ *
+ * link_fps is what the link could carry (8N1, framing included), and
+ * decoded_fps is what the firmware on the mock actually displayed while
+ * the frames were sent back to back.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many frames of every scene are streamed
+#define FRAMES 8
+
+static const uint8_t palette[STREAM_PALETTE_SIZE][3] =
+{
+	{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 255, 0},
+	{0, 0, 255}, {255, 255, 0}, {0, 255, 255}, {255, 0, 255},
+	{128, 0, 0}, {0, 128, 0}, {0, 0, 128}, {128, 128, 0},
+	{0, 128, 128}, {128, 0, 128}, {64, 64, 64}, {192, 192, 192},
+};
+
+static StreamImage frames[FRAMES + 1];
+static StreamImage inverse;	// Differs from the first frame in every pixel
+static uint8_t tokens[STREAM_MAX_TOKENS];
+
+// A way to animate the display
+typedef void (*SceneFunc)(uint16_t frame, StreamImage image);
+
+/**
+ * @brief	A few sprites moving over a still background, like the game
+ *
+ * @param	frame Which frame of the animation
+ * @param	image Where to draw it
+ *
+ * @retval	none
+ */
+static void Sprites(uint16_t frame, StreamImage image)
+{
+	uint8_t row, col, sprite;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+			memcpy(image[row][col], palette[(row % 4 == 0 || col % 4 == 0) ? 4 : 0], 3);
+	}
+
+	for(sprite = 0; sprite < 5; ++sprite)
+		memcpy(image[(2 + 6 * sprite) % MAX_ROWS][(frame + 7 * sprite) % MAX_COLS], palette[2 + sprite], 3);
+}
+
+/**
+ * @brief	Vertical stripes of palette colors scrolling sideways
+ *
+ * @param	frame Which frame of the animation
+ * @param	image Where to draw it
+ *
+ * @retval	none
+ */
+static void Stripes(uint16_t frame, StreamImage image)
+{
+	uint8_t row, col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+			memcpy(image[row][col], palette[((col + frame) / 8) % STREAM_PALETTE_SIZE], 3);
+	}
+}
+
+/**
+ * @brief	Every pixel a random palette color, every frame
+ *
+ * @param	frame Unused
+ * @param	image Where to draw it
+ *
+ * @retval	none
+ */
+static void PaletteNoise(uint16_t frame, StreamImage image)
+{
+	uint8_t row, col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+			memcpy(image[row][col], palette[rand() % STREAM_PALETTE_SIZE], 3);
+	}
+}
+
+/**
+ * @brief	Every pixel a random color, every frame
+ *
+ * @param	frame Unused
+ * @param	image Where to draw it
+ *
+ * @retval	none
+ */
+static void RgbNoise(uint16_t frame, StreamImage image)
+{
+	uint8_t *pixels = &image[0][0][0];
+	uint16_t i;
+
+	for(i = 0; i < MAX_ROWS * MAX_COLS * 3; ++i)
+		pixels[i] = rand();
+}
+
+/**
+ * @brief	Encodes the second frame of the sprites against the first
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void EncodeSprites(void)
+{
+	StreamEncode(frames[0], frames[1], palette, STREAM_PALETTE_SIZE, tokens);
+}
+
+/**
+ * @brief	Encodes a frame of random colors against the one before it
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void EncodeNoise(void)
+{
+	StreamEncode(frames[2], frames[3], palette, STREAM_PALETTE_SIZE, tokens);
+}
+
+/**
+ * @brief	Runs the firmware until everything sent was received and displayed
+ *
+ * @param	baud The baud rate
+ *
+ * @retval	none
+ */
+static void Drain(uint32_t baud)
+{
+	while(MockUARTPending() != 0)
+		RunFirmware(SECOND / 1000);
+
+	// The last bytes wait for the receive timeout (32 bit times)
+	RunFirmware(SECOND * 40 / baud);
+
+	while(FramePending())
+		RunFirmware(SECOND / 10000);
+}
+
+/**
+ * @brief	Streams a scene at a baud rate and prints its line of the throughput table
+ *
+ * @param	name The name of the scene
+ * @param	scene Draws the frames
+ * @param	baud The baud rate
+ *
+ * @retval	none
+ */
+static void Stream(const char *name, SceneFunc scene, uint32_t baud)
+{
+	uint8_t payload[4] = {baud, baud >> 8, baud >> 16, baud >> 24}, on = 1;
+	uint64_t start, link_bytes = 0;
+	uint32_t overflows;
+	uint16_t frame, i;
+	size_t length;
+
+	BootFirmware(SECOND / 10);
+	SendFrame(OP_SET_BAUD, payload, sizeof(payload));
+	RunFirmware(SECOND / 10);
+
+	SendFrame(OP_STREAM_MODE, &on, 1);
+	StreamSendPalette(palette, STREAM_PALETTE_SIZE, SendFrame);
+
+	for(frame = 0; frame <= FRAMES; ++frame)
+		scene(frame, frames[frame]);
+
+	// The first frame sets every pixel, and isn't timed
+	for(i = 0; i < MAX_ROWS * MAX_COLS * 3; ++i)
+		(&inverse[0][0][0])[i] = ~(&frames[0][0][0][0])[i];
+
+	length = StreamEncode(inverse, frames[0], palette, STREAM_PALETTE_SIZE, tokens);
+	StreamSend(tokens, length, SendFrame);
+	Drain(baud);
+
+	overflows = UARTRxOverflows();
+	start = MockNow();
+
+	for(frame = 1; frame <= FRAMES; ++frame)
+	{
+		length = StreamEncode(frames[frame - 1], frames[frame], palette, STREAM_PALETTE_SIZE, tokens);
+		StreamSend(tokens, length, SendFrame);
+		link_bytes += StreamLinkBytes(length);
+	}
+
+	Drain(baud);
+
+	printf("%s,%u,%u,%.1f,%.1f,%u\n", name, baud, (unsigned)(link_bytes / FRAMES),
+		(double)baud / 10 / ((double)link_bytes / FRAMES),
+		FRAMES / ((double)(MockNow() - start) / SECOND),
+		UARTRxOverflows() - overflows);
+}
+
+int main(void)
+{
+	static const uint32_t bauds[] = {9600, 115200, 921600};
+	uint8_t i;
+
+	BenchHeader();
+
+	Sprites(0, frames[0]);
+	Sprites(1, frames[1]);
+	RgbNoise(0, frames[2]);
+	RgbNoise(1, frames[3]);
+	Bench("stream_encode_sprites", EncodeSprites);
+	Bench("stream_encode_rgb_noise", EncodeNoise);
+
+	printf("\nscene,baud,bytes_per_frame,link_fps,decoded_fps,rx_overflows\n");
+	srand(1);
+
+	for(i = 0; i < sizeof(bauds) / sizeof(bauds[0]); ++i)
+	{
+		Stream("sprites", Sprites, bauds[i]);
+		Stream("stripes", Stripes, bauds[i]);
+		Stream("palette_noise", PaletteNoise, bauds[i]);
+		Stream("rgb_noise", RgbNoise, bauds[i]);
+	}
+
+	return 0;
+}
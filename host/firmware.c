@@ -0,0 +1,9 @@
+// Builds src/main.c with its main() renamed to FirmwareMain(), see firmware.h
+#include "firmware.h"
+
+// main() can end without a return statement, which FirmwareMain() can't
+#pragma GCC diagnostic ignored "-Wreturn-type"
+
+#define main FirmwareMain
+#include "../src/main.c"
+#undef main
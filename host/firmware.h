@@ -0,0 +1,7 @@
+#ifndef FIRMWARE_H_
+#define FIRMWARE_H_
+
+// The firmware's main() (src/main.c), renamed so the host programs can have their own
+int FirmwareMain(void);
+
+#endif /* FIRMWARE_H_ */
@@ -0,0 +1,7 @@
+#ifndef HW_GPIO_H_
+#define HW_GPIO_H_
+
+// Stands in for TivaWare's hw_gpio.h in the host build, the firmware only uses the registers in tm4c123gh6pm.h
+#include "inc/tm4c123gh6pm.h"
+
+#endif /* HW_GPIO_H_ */
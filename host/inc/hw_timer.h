@@ -0,0 +1,7 @@
+#ifndef HW_TIMER_H_
+#define HW_TIMER_H_
+
+// Stands in for TivaWare's hw_timer.h in the host build, the timer bits the firmware uses are in tm4c123gh6pm.h
+#include "inc/tm4c123gh6pm.h"
+
+#endif /* HW_TIMER_H_ */
@@ -0,0 +1,88 @@
+#ifndef TM4C123GH6PM_H_
+#define TM4C123GH6PM_H_
+
+#include "mock.h"
+
+/**
+ * Stands in for TivaWare's tm4c123gh6pm.h in the host build (see host/Makefile).
+ * Only the registers and bits the firmware uses are here, and every register
+ * goes through the peripheral mock (see mock.h).
+ */
+
+// System control
+#define SYSCTL_RIS_R (*MockRegister(MOCK_SYSCTL_RIS))
+#define SYSCTL_RCC_R (*MockRegister(MOCK_SYSCTL_RCC))
+#define SYSCTL_RCC2_R (*MockRegister(MOCK_SYSCTL_RCC2))
+#define SYSCTL_RCGCTIMER_R (*MockRegister(MOCK_SYSCTL_RCGCTIMER))
+#define SYSCTL_RCGCGPIO_R (*MockRegister(MOCK_SYSCTL_RCGCGPIO))
+#define SYSCTL_RCGCUART_R (*MockRegister(MOCK_SYSCTL_RCGCUART))
+
+// GPIO ports A, B, and C
+#define GPIO_PORTA_DATA_R (*MockRegister(MOCK_GPIO_PORTA_DATA))
+#define GPIO_PORTA_DIR_R (*MockRegister(MOCK_GPIO_PORTA_DIR))
+#define GPIO_PORTA_DEN_R (*MockRegister(MOCK_GPIO_PORTA_DEN))
+#define GPIO_PORTA_DR8R_R (*MockRegister(MOCK_GPIO_PORTA_DR8R))
+#define GPIO_PORTB_DATA_R (*MockRegister(MOCK_GPIO_PORTB_DATA))
+#define GPIO_PORTB_DIR_R (*MockRegister(MOCK_GPIO_PORTB_DIR))
+#define GPIO_PORTB_DEN_R (*MockRegister(MOCK_GPIO_PORTB_DEN))
+#define GPIO_PORTB_DR4R_R (*MockRegister(MOCK_GPIO_PORTB_DR4R))
+#define GPIO_PORTC_AFSEL_R (*MockRegister(MOCK_GPIO_PORTC_AFSEL))
+#define GPIO_PORTC_DEN_R (*MockRegister(MOCK_GPIO_PORTC_DEN))
+#define GPIO_PORTC_PCTL_R (*MockRegister(MOCK_GPIO_PORTC_PCTL))
+
+// Timers 0, 1, and 2
+#define TIMER0_CFG_R (*MockRegister(MOCK_TIMER0_CFG))
+#define TIMER0_TAMR_R (*MockRegister(MOCK_TIMER0_TAMR))
+#define TIMER0_CTL_R (*MockRegister(MOCK_TIMER0_CTL))
+#define TIMER0_IMR_R (*MockRegister(MOCK_TIMER0_IMR))
+#define TIMER0_ICR_R (*MockRegister(MOCK_TIMER0_ICR))
+#define TIMER0_TAILR_R (*MockRegister(MOCK_TIMER0_TAILR))
+#define TIMER0_TAMATCHR_R (*MockRegister(MOCK_TIMER0_TAMATCHR))
+#define TIMER0_TAV_R (*MockRegister(MOCK_TIMER0_TAV))
+#define TIMER1_CFG_R (*MockRegister(MOCK_TIMER1_CFG))
+#define TIMER1_TAMR_R (*MockRegister(MOCK_TIMER1_TAMR))
+#define TIMER1_CTL_R (*MockRegister(MOCK_TIMER1_CTL))
+#define TIMER1_IMR_R (*MockRegister(MOCK_TIMER1_IMR))
+#define TIMER1_ICR_R (*MockRegister(MOCK_TIMER1_ICR))
+#define TIMER1_TAILR_R (*MockRegister(MOCK_TIMER1_TAILR))
+#define TIMER1_TAMATCHR_R (*MockRegister(MOCK_TIMER1_TAMATCHR))
+#define TIMER1_TAV_R (*MockRegister(MOCK_TIMER1_TAV))
+#define TIMER2_CFG_R (*MockRegister(MOCK_TIMER2_CFG))
+#define TIMER2_TAMR_R (*MockRegister(MOCK_TIMER2_TAMR))
+#define TIMER2_CTL_R (*MockRegister(MOCK_TIMER2_CTL))
+#define TIMER2_IMR_R (*MockRegister(MOCK_TIMER2_IMR))
+#define TIMER2_ICR_R (*MockRegister(MOCK_TIMER2_ICR))
+#define TIMER2_TAILR_R (*MockRegister(MOCK_TIMER2_TAILR))
+#define TIMER2_TAMATCHR_R (*MockRegister(MOCK_TIMER2_TAMATCHR))
+#define TIMER2_TAV_R (*MockRegister(MOCK_TIMER2_TAV))
+
+// UART4
+#define UART4_DR_R (*MockRegister(MOCK_UART4_DR))
+#define UART4_FR_R (*MockRegister(MOCK_UART4_FR))
+#define UART4_IBRD_R (*MockRegister(MOCK_UART4_IBRD))
+#define UART4_FBRD_R (*MockRegister(MOCK_UART4_FBRD))
+#define UART4_LCRH_R (*MockRegister(MOCK_UART4_LCRH))
+#define UART4_CTL_R (*MockRegister(MOCK_UART4_CTL))
+#define UART4_IFLS_R (*MockRegister(MOCK_UART4_IFLS))
+#define UART4_IM_R (*MockRegister(MOCK_UART4_IM))
+#define UART4_ICR_R (*MockRegister(MOCK_UART4_ICR))
+
+// NVIC and SysTick
+#define NVIC_EN0_R (*MockRegister(MOCK_NVIC_EN0))
+#define NVIC_EN1_R (*MockRegister(MOCK_NVIC_EN1))
+#define NVIC_PEND0_R (*MockRegister(MOCK_NVIC_PEND0))
+#define NVIC_PEND1_R (*MockRegister(MOCK_NVIC_PEND1))
+#define NVIC_UNPEND0_R (*MockRegister(MOCK_NVIC_UNPEND0))
+#define NVIC_UNPEND1_R (*MockRegister(MOCK_NVIC_UNPEND1))
+#define NVIC_PRI4_R (*MockRegister(MOCK_NVIC_PRI4))
+#define NVIC_PRI5_R (*MockRegister(MOCK_NVIC_PRI5))
+#define NVIC_PRI15_R (*MockRegister(MOCK_NVIC_PRI15))
+#define NVIC_ST_CTRL_R (*MockRegister(MOCK_NVIC_ST_CTRL))
+#define NVIC_ST_RELOAD_R (*MockRegister(MOCK_NVIC_ST_RELOAD))
+#define NVIC_ST_CURRENT_R (*MockRegister(MOCK_NVIC_ST_CURRENT))
+
+// Register bits
+#define SYSCTL_RCGCUART_R4 0x00000010	// UART Module 4 Run Mode Clock Gating Control
+#define TIMER_ICR_TAMCINT 0x00000010	// GPTM Timer A Match Interrupt Clear
+
+#endif /* TM4C123GH6PM_H_ */
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "LedMatrix.h"
+#include "mazegraph.h"
+#include "pacman.h"
+
+/**
+ * Compiles the maze graph of the built-in level (level in src/pacman.c)
+ * and writes it out as C, so the target keeps the graph in flash instead
+ * of building it in RAM every time the level gets loaded:
+ *
+ * 		mazegen > ../src/mazelevel.c
+ *
+ * (which is what "make mazelevel" does). A level with more than
+ * MAZE_MAX_NODES junctions, like an open room, gets no graph. host/test/
+ * test_mazegraph.c checks that the file is up to date.
+ */
+
+int main(void)
+{
+	static MazeNode nodes[MAZE_MAX_NODES];
+	static uint8_t distance[MAZE_MAX_NODES * MAZE_MAX_NODES];
+	MazeGraph graph;
+	uint16_t i, j;
+
+	if(MAX_ROWS != 32 || MAX_COLS != 32)
+	{
+		fprintf(stderr, "mazegen: build it for a 32x32 display, the built-in level's size\n");
+		return 1;
+	}
+
+	printf("#include <stdint.h>\n");
+	printf("#include \"mazegraph.h\"\n\n");
+	printf("// Generated by host/mazegen.c from the built-in level in pacman.c, don't edit\n\n");
+
+	// An open room has a junction at nearly every cell, far too many for a table in flash
+	if(!BuildMazeGraph(level, nodes, distance, &graph))
+	{
+		fprintf(stderr, "mazegen: the built-in level has more than %u junctions, so it gets no graph\n", MAZE_MAX_NODES);
+		printf("// The level has more than MAZE_MAX_NODES junctions, so the ghosts search it cell by cell\n");
+		printf("const MazeGraph *const builtin_maze_graph = 0;\n");
+		return 0;
+	}
+
+	printf("#if MAX_ROWS == 32 && MAX_COLS == 32\n\n");
+
+	printf("// The junctions and dead ends of the level: row, column, the node at the end of each corridor, and its length\n");
+	printf("static const MazeNode builtin_nodes[%u] =\n{\n", graph.num_nodes);
+
+	for(i = 0; i < graph.num_nodes; ++i)
+	{
+		printf("\t{%u, %u, {%u, %u, %u, %u}, {%u, %u, %u, %u} },\n", nodes[i].row, nodes[i].col,
+			nodes[i].neighbor[0], nodes[i].neighbor[1], nodes[i].neighbor[2], nodes[i].neighbor[3],
+			nodes[i].length[0], nodes[i].length[1], nodes[i].length[2], nodes[i].length[3]);
+	}
+
+	printf("};\n\n");
+	printf("// Shortest path lengths between every pair of nodes\n");
+	printf("static const uint8_t builtin_distance[%u * %u] =\n{\n", graph.num_nodes, graph.num_nodes);
+
+	for(i = 0; i < graph.num_nodes; ++i)
+	{
+		printf("\t");
+
+		for(j = 0; j < graph.num_nodes; ++j)
+			printf("%u,%s", distance[i * graph.num_nodes + j], (j + 1 < graph.num_nodes) ? " " : "\n");
+	}
+
+	printf("};\n\n");
+	printf("static const MazeGraph builtin_graph = {%u, builtin_nodes, builtin_distance};\n\n", graph.num_nodes);
+	printf("const MazeGraph *const builtin_maze_graph = &builtin_graph;\n\n");
+	printf("#else\n\n");
+	printf("// The level is in the top left of bigger displays, where its corridors wrap around differently\n");
+	printf("const MazeGraph *const builtin_maze_graph = 0;\n\n");
+	printf("#endif\n");
+
+	return 0;
+}
@@ -0,0 +1,962 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include "mock.h"
+#include "LedMatrix.h"
+
+// UART flag register bits
+#define UART_FR_BUSY 0x08
+#define UART_FR_RXFE 0x10
+#define UART_FR_TXFF 0x20
+#define UART_FR_RXFF 0x40
+#define UART_FR_TXFE 0x80
+
+// UART interrupt bits
+#define UART_INT_RX 0x10
+#define UART_INT_TX 0x20
+#define UART_INT_RT 0x40
+
+#define UART_FIFO_SIZE 16
+#define UART_RX_TRIGGER 8	// Receive interrupt at half full (IFLS set by InitUART())
+#define UART_TX_TRIGGER 2	// Transmit interrupt at 1/8 full
+
+// Marks a UART4_DR_R value handed out for a read, and whether it held a received byte
+#define DR_READ_MARK 0x80000000
+#define DR_READ_DATA 0x40000000
+
+// Lowest priority, what thread mode runs at
+#define THREAD_PRIORITY 0x100
+
+// A busy wait that runs this long past the deadline is taken to be stuck
+#define HANG_CYCLES (10ULL * SYSCLK)
+
+#define NEVER UINT64_MAX
+
+// Registers of one timer, in the order of MockRegisterId
+typedef enum {TIMER_CFG, TIMER_TAMR, TIMER_CTL, TIMER_IMR, TIMER_ICR, TIMER_TAILR, TIMER_TAMATCHR, TIMER_TAV, TIMER_REGISTERS} TimerRegister;
+
+static const MockRegisterId timer_base[3] = { MOCK_TIMER0_CFG, MOCK_TIMER1_CFG, MOCK_TIMER2_CFG };
+static const uint8_t timer_irq[3] = { MOCK_IRQ_TIMER0A, MOCK_IRQ_TIMER1A, MOCK_IRQ_TIMER2A };
+
+static volatile uint32_t regs[MOCK_REGISTER_COUNT];
+static uint32_t shadow[MOCK_REGISTER_COUNT];	// What every register held when it was last handed out
+static MockRegisterId last_id = MOCK_REGISTER_COUNT;	// The register handed out last
+
+static uint64_t now;			// SYSCLK cycles since the start
+static uint64_t access_time;	// When the register handed out last got accessed
+static uint64_t deadline = NEVER;
+static jmp_buf stop;
+static uint8_t running;
+
+// Interrupts
+static uint32_t host_rate;		// SYSCLK cycles per microsecond of host CPU time, 0 if it isn't counted
+static uint64_t host_since;		// Host CPU time (ns) not counted yet
+
+static uint32_t primask;
+static uint16_t active_priority = THREAD_PRIORITY;
+static uint8_t pending[MOCK_IRQ_COUNT];
+static uint32_t interrupt_count[MOCK_IRQ_COUNT];
+static uint8_t in_sync;
+
+static uint32_t timer_ris[3];
+
+// UART4
+static uint8_t *rx_queue;		// Bytes still to be received
+static size_t rx_queue_length, rx_queue_pos, rx_queue_capacity;
+static uint64_t rx_done = NEVER;	// When the byte coming in now is received
+static uint64_t rx_last;		// When the last byte was received
+static uint8_t rx_fifo[UART_FIFO_SIZE];
+static uint8_t rx_fifo_count;
+static uint8_t tx_fifo[UART_FIFO_SIZE];
+static uint8_t tx_fifo_count;
+static uint64_t tx_done = NEVER;	// When the byte going out now is sent
+static uint32_t uart_ris;
+static uint8_t *tx_log;			// Sent bytes, until MockUARTTake()
+static size_t tx_log_length, tx_log_capacity;
+static FILE *tx_echo;
+
+// Panels
+static uint32_t porta, portb;	// Port values the panels see
+static uint8_t shift[CHAIN_COLS];	// The last CHAIN_COLS values clocked in, as a ring
+static uint16_t shift_pos;		// Where the next one goes, and the oldest one is
+static uint8_t latched[CHAIN_COLS];
+static uint64_t lit_since;		// Start of the time not added to lit yet
+static uint64_t lit[MAX_ROWS][MAX_COLS][3];
+static uint64_t lit_end[MAX_ROWS][MAX_COLS][3];	// When every LED last went dark (0 if it hasn't been lit)
+static uint64_t longest_dark[MAX_ROWS][MAX_COLS][3];
+static uint64_t gpio_writes[2];
+static FILE *gpio_trace;
+
+/**
+ * @brief	Appends bytes to a growing buffer
+ *
+ * @param	buf The buffer
+ * @param	length The bytes in it
+ * @param	capacity Its size
+ * @param	data The bytes to add
+ * @param	count How many
+ *
+ * @retval	none
+ */
+static void Append(uint8_t **buf, size_t *length, size_t *capacity, const uint8_t *data, size_t count)
+{
+	if(*length + count > *capacity)
+	{
+		*capacity = (*length + count) * 2;
+		*buf = realloc(*buf, *capacity);
+
+		if(*buf == NULL)
+		{
+			perror("mock");
+			exit(1);
+		}
+	}
+
+	memcpy(*buf + *length, data, count);
+	*length += count;
+}
+
+/**
+ * @brief	Finds the priority of an interrupt in the NVIC_PRI registers
+ *
+ * @param	irq The interrupt
+ *
+ * @retval	The priority (0 is the highest)
+ */
+static uint16_t Priority(uint8_t irq)
+{
+	uint32_t value;
+
+	switch(irq / 4)
+	{
+		case 4: value = regs[MOCK_NVIC_PRI4]; break;
+		case 5: value = regs[MOCK_NVIC_PRI5]; break;
+		case 15: value = regs[MOCK_NVIC_PRI15]; break;
+		default: value = 0; break;
+	}
+
+	return (value >> (8 * (irq % 4) + 5)) & 0x7;
+}
+
+/**
+ * @brief	Checks whether an interrupt is enabled in the NVIC
+ *
+ * @param	irq The interrupt
+ *
+ * @retval	1 if it's enabled
+ */
+static uint8_t Enabled(uint8_t irq)
+{
+	return ((irq < 32 ? regs[MOCK_NVIC_EN0] : regs[MOCK_NVIC_EN1]) >> (irq % 32)) & 1;
+}
+
+/**
+ * @brief	Finds the cycles it takes to send or receive a byte (8N1)
+ *
+ * @param	none
+ *
+ * @retval	The cycles, 16 * (IBRD + FBRD / 64) per bit
+ */
+static uint64_t ByteCycles(void)
+{
+	uint64_t divisor = ((uint64_t)regs[MOCK_UART4_IBRD] << 6) + (regs[MOCK_UART4_FBRD] & 0x3F);
+
+	return (divisor != 0) ? divisor * 10 / 4 : 1;
+}
+
+/**
+ * @brief	Adds a stretch of lit time to an LED, keeping track of the
+ * 			longest time it went dark in between
+ *
+ * @param	row The LED's pixel row
+ * @param	col The LED's pixel column
+ * @param	channel 0 for red, 1 for green, 2 for blue
+ * @param	start When the stretch started
+ * @param	end When it ended
+ *
+ * @retval	none
+ */
+static void LightLed(uint8_t row, uint8_t col, uint8_t channel, uint64_t start, uint64_t end)
+{
+	if(lit_end[row][col][channel] != 0 && start - lit_end[row][col][channel] > longest_dark[row][col][channel])
+		longest_dark[row][col][channel] = start - lit_end[row][col][channel];
+
+	lit[row][col][channel] += end - start;
+	lit_end[row][col][channel] = end;
+}
+
+/**
+ * @brief	Adds the time the latched row pair has been lit since
+ * 			lit_since to every LED it lights, up to now
+ *
+ * @param	when The time to add up to
+ *
+ * @retval	none
+ */
+static void FlushLit(uint64_t when)
+{
+	uint64_t span = (when > lit_since) ? when - lit_since : 0;
+	uint8_t address, scan_row, panel, col, half, row;
+	uint16_t k;
+
+	if(when > lit_since)
+		lit_since = when;
+
+	// OE is active low
+	if(span == 0 || (portb & OE))
+		return;
+
+	// The board crosses DEMUX B and C, demux_vals in LedMatrix.c makes up for it
+	address = portb & 0xF;
+	scan_row = (address & 0x9) | ((address & 0x2) << 1) | ((address & 0x4) >> 1);
+
+	// The first value clocked in ends up in the last panel (see ChainColumn())
+	for(k = 0; k < CHAIN_COLS; ++k)
+	{
+		uint8_t value = latched[k];
+
+		panel = CHAIN_PANELS - 1 - k / PANEL_COLS;
+		col = (panel % PANELS_X) * PANEL_COLS + k % PANEL_COLS;
+
+		for(half = 0; half < 2; ++half, value >>= 3)
+		{
+			row = (panel / PANELS_X) * PANEL_ROWS + half * SCAN_ROWS + scan_row;
+
+			if(value & R0)
+				LightLed(row, col, 0, when - span, when);
+			if(value & G0)
+				LightLed(row, col, 1, when - span, when);
+			if(value & B0)
+				LightLed(row, col, 2, when - span, when);
+		}
+	}
+}
+
+/**
+ * @brief	Shows the panels a new value of port A or B
+ *
+ * @param	id MOCK_GPIO_PORTA_DATA or MOCK_GPIO_PORTB_DATA
+ * @param	value The new value
+ *
+ * @retval	none
+ */
+static void WriteGpio(MockRegisterId id, uint32_t value)
+{
+	uint32_t rising;
+
+	if(gpio_trace != NULL)
+		fprintf(gpio_trace, "%llu %c %02X\n", (unsigned long long)access_time, (id == MOCK_GPIO_PORTA_DATA) ? 'A' : 'B', value & 0xFF);
+
+	if(id == MOCK_GPIO_PORTA_DATA)
+	{
+		gpio_writes[0]++;
+		porta = value;
+		return;
+	}
+
+	gpio_writes[1]++;
+	rising = value & ~portb;
+
+	// Anything that changes which LEDs are lit ends the current stretch of lit time
+	if(((value ^ portb) & (OE | 0xF)) || (rising & LATCH))
+		FlushLit(access_time);
+
+	if(rising & SCLK)
+	{
+		shift[shift_pos] = porta & ALL_DATAPORT_PINS;
+		shift_pos = (shift_pos + 1) % CHAIN_COLS;
+	}
+
+	// latched[k] is the k-th of the last CHAIN_COLS values clocked in
+	if(rising & LATCH)
+	{
+		uint16_t k;
+
+		for(k = 0; k < CHAIN_COLS; ++k)
+			latched[k] = shift[(shift_pos + k) % CHAIN_COLS];
+	}
+
+	portb = value;
+}
+
+/**
+ * @brief	Starts sending the next byte of the transmit FIFO, if the
+ * 			UART is idle
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void StartTransmit(void)
+{
+	if(tx_done == NEVER && tx_fifo_count != 0 && (regs[MOCK_UART4_CTL] & 1))
+		tx_done = access_time + ByteCycles();
+}
+
+/**
+ * @brief	Starts receiving the next queued byte, if nothing is coming in
+ *
+ * @param	when When the byte starts coming in
+ *
+ * @retval	none
+ */
+static void StartReceive(uint64_t when)
+{
+	if(rx_done == NEVER && rx_queue_pos < rx_queue_length && (regs[MOCK_UART4_CTL] & 1))
+		rx_done = when + ByteCycles();
+}
+
+/**
+ * @brief	Makes a write to the register handed out last take effect
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ApplyAccess(void)
+{
+	MockRegisterId id = last_id;
+	uint32_t value = regs[id];
+	uint8_t timer, irq;
+
+	if(id == MOCK_REGISTER_COUNT)
+		return;
+
+	switch(id)
+	{
+		case MOCK_GPIO_PORTA_DATA:
+		case MOCK_GPIO_PORTB_DATA:
+			if(value != shadow[id])
+				WriteGpio(id, value);
+			break;
+
+		case MOCK_TIMER0_ICR:
+		case MOCK_TIMER1_ICR:
+		case MOCK_TIMER2_ICR:
+			timer = (id - MOCK_TIMER0_CFG) / TIMER_REGISTERS;
+			timer_ris[timer] &= ~value;
+			regs[id] = 0;
+			break;
+
+		case MOCK_UART4_DR:
+			if(value == shadow[id])
+			{
+				// Read, which takes the byte out of the receive FIFO
+				if(value & DR_READ_DATA)
+				{
+					memmove(&rx_fifo[0], &rx_fifo[1], rx_fifo_count - 1);
+					rx_fifo_count--;
+				}
+			}
+			else if(tx_fifo_count < UART_FIFO_SIZE)
+			{
+				tx_fifo[tx_fifo_count++] = value & 0xFF;
+				StartTransmit();
+			}
+			break;
+
+		case MOCK_UART4_ICR:
+			uart_ris &= ~value;
+			regs[id] = 0;
+			break;
+
+		case MOCK_UART4_CTL:
+			StartTransmit();
+			StartReceive(access_time);
+			break;
+
+		case MOCK_NVIC_PEND0:
+		case MOCK_NVIC_PEND1:
+		case MOCK_NVIC_UNPEND0:
+		case MOCK_NVIC_UNPEND1:
+			for(irq = 0; irq < 32; ++irq)
+			{
+				if(value & (1UL << irq))
+					pending[irq + ((id == MOCK_NVIC_PEND1 || id == MOCK_NVIC_UNPEND1) ? 32 : 0)] = (id == MOCK_NVIC_PEND0 || id == MOCK_NVIC_PEND1);
+			}
+			regs[id] = 0;
+			break;
+
+		default:
+			break;
+	}
+
+	last_id = MOCK_REGISTER_COUNT;
+}
+
+/**
+ * @brief	Finds when the next thing that can raise an interrupt happens
+ *
+ * @param	none
+ *
+ * @retval	The time, or NEVER
+ */
+static uint64_t NextEvent(void)
+{
+	uint64_t next = NEVER, when;
+	volatile uint32_t *timer_regs;
+	uint8_t timer;
+
+	for(timer = 0; timer < 3; ++timer)
+	{
+		timer_regs = &regs[timer_base[timer]];
+
+		if(!(timer_regs[TIMER_CTL] & 1) || !(timer_regs[TIMER_IMR] & 0x10) || (timer_ris[timer] & 0x10))
+			continue;
+
+		if(timer_regs[TIMER_TAV] < timer_regs[TIMER_TAMATCHR])
+			when = now + timer_regs[TIMER_TAMATCHR] - timer_regs[TIMER_TAV];
+		else
+			when = now + (timer_regs[TIMER_TAILR] - timer_regs[TIMER_TAV]) + timer_regs[TIMER_TAMATCHR] + 1;
+
+		if(when < next)
+			next = when;
+	}
+
+	if(rx_done < next)
+		next = rx_done;
+	if(tx_done < next)
+		next = tx_done;
+
+	// The receive timeout, 32 bits after the last byte came in
+	if(rx_fifo_count != 0 && !(uart_ris & UART_INT_RT))
+	{
+		when = rx_last + ByteCycles() * 32 / 10;
+
+		if(when < next)
+			next = (when > now) ? when : now;
+	}
+
+	return next;
+}
+
+/**
+ * @brief	Runs the timers and the UART up to a later time
+ *
+ * @param	until The time
+ *
+ * @retval	none
+ */
+static void Advance(uint64_t until)
+{
+	volatile uint32_t *timer_regs;
+	uint64_t value, elapsed = until - now;
+	uint8_t timer;
+
+	for(timer = 0; timer < 3 && elapsed != 0; ++timer)
+	{
+		timer_regs = &regs[timer_base[timer]];
+
+		if(!(timer_regs[TIMER_CTL] & 1))
+			continue;
+
+		// Counting up from TAV, matching at TAMATCHR and starting over (or stopping) after TAILR
+		value = (uint64_t)timer_regs[TIMER_TAV] + elapsed;
+
+		if(timer_regs[TIMER_TAV] < timer_regs[TIMER_TAMATCHR] && value >= timer_regs[TIMER_TAMATCHR])
+			timer_ris[timer] |= 0x10;
+
+		if(value > timer_regs[TIMER_TAILR])
+		{
+			if((timer_regs[TIMER_TAMR] & 0x3) == 0x1)
+			{
+				timer_regs[TIMER_CTL] &= ~1;
+				value = timer_regs[TIMER_TAILR];
+			}
+			else
+			{
+				value = (value - timer_regs[TIMER_TAILR] - 1) % ((uint64_t)timer_regs[TIMER_TAILR] + 1);
+
+				if(value >= timer_regs[TIMER_TAMATCHR])
+					timer_ris[timer] |= 0x10;
+			}
+		}
+
+		timer_regs[TIMER_TAV] = (uint32_t)value;
+	}
+
+	now = until;
+
+	while(rx_done <= now)
+	{
+		if(rx_fifo_count < UART_FIFO_SIZE)
+			rx_fifo[rx_fifo_count++] = rx_queue[rx_queue_pos];
+
+		rx_queue_pos++;
+		rx_last = rx_done;
+		rx_done = NEVER;
+		uart_ris &= ~UART_INT_RT;
+
+		if(rx_fifo_count >= UART_RX_TRIGGER)
+			uart_ris |= UART_INT_RX;
+
+		StartReceive(rx_last);
+	}
+
+	while(tx_done <= now)
+	{
+		if(tx_echo != NULL)
+			fputc(tx_fifo[0], tx_echo);
+
+		Append(&tx_log, &tx_log_length, &tx_log_capacity, tx_fifo, 1);
+		memmove(&tx_fifo[0], &tx_fifo[1], tx_fifo_count - 1);
+		tx_fifo_count--;
+
+		if(tx_fifo_count == UART_TX_TRIGGER)
+			uart_ris |= UART_INT_TX;
+
+		value = tx_done;
+		tx_done = NEVER;
+
+		if(tx_fifo_count != 0)
+			tx_done = value + ByteCycles();
+	}
+
+	if(rx_fifo_count != 0 && now >= rx_last + ByteCycles() * 32 / 10)
+		uart_ris |= UART_INT_RT;
+}
+
+/**
+ * @brief	Takes the highest priority interrupt that can preempt the
+ * 			code running now, if there is one
+ *
+ * @param	ignore_primask 1 to look for interrupts that wake up WFI
+ *
+ * @retval	The interrupt, or MOCK_IRQ_COUNT for none
+ */
+static uint8_t NextInterrupt(uint8_t ignore_primask)
+{
+	uint8_t irq, best = MOCK_IRQ_COUNT;
+	uint8_t timer;
+
+	// The peripherals' interrupt lines are level triggered
+	for(timer = 0; timer < 3; ++timer)
+	{
+		if(timer_ris[timer] & regs[timer_base[timer] + TIMER_IMR])
+			pending[timer_irq[timer]] = 1;
+	}
+
+	if(uart_ris & regs[MOCK_UART4_IM])
+		pending[MOCK_IRQ_UART4] = 1;
+
+	if(primask && !ignore_primask)
+		return MOCK_IRQ_COUNT;
+
+	for(irq = 0; irq < MOCK_IRQ_COUNT; ++irq)
+	{
+		if(pending[irq] && Enabled(irq) && Priority(irq) < active_priority && (best == MOCK_IRQ_COUNT || Priority(irq) < Priority(best)))
+			best = irq;
+	}
+
+	return best;
+}
+
+/**
+ * @brief	Runs an interrupt's handler
+ *
+ * @param	irq The interrupt
+ *
+ * @retval	none
+ */
+static void TakeInterrupt(uint8_t irq)
+{
+	const MockVector *vector;
+	uint16_t preempted = active_priority;
+
+	pending[irq] = 0;
+	interrupt_count[irq]++;
+	Advance(now + MOCK_IRQ_ENTRY_CYCLES);
+
+	for(vector = mock_vectors; vector->handler != NULL; ++vector)
+	{
+		if(vector->irq == irq)
+			break;
+	}
+
+	if(vector->handler == NULL)
+	{
+		fprintf(stderr, "mock: interrupt %u has no handler\n", irq);
+		exit(1);
+	}
+
+	active_priority = Priority(irq);
+	vector->handler();
+	active_priority = preempted;
+}
+
+/**
+ * @brief	Reads the CPU time of the host thread running the simulation
+ *
+ * @param	none
+ *
+ * @retval	The time in nanoseconds
+ */
+static uint64_t HostCpuTime(void)
+{
+	struct timespec cpu;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+
+	return (uint64_t)cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+}
+
+/**
+ * @brief	Makes the last register write take effect, lets time pass,
+ * 			and takes the interrupts that became pending
+ *
+ * @param	cycles How much time passes
+ *
+ * @retval	none
+ */
+static void Sync(uint64_t cycles)
+{
+	uint8_t irq;
+
+	// An interrupt handler can only start its own accesses once the interrupted one is done
+	if(in_sync)
+		return;
+
+	in_sync = 1;
+	ApplyAccess();
+
+	// The code that ran since the last access
+	if(host_rate != 0)
+	{
+		uint64_t cpu = HostCpuTime();
+
+		cycles += (cpu - host_since) * host_rate / 1000;
+		host_since = cpu;
+	}
+
+	Advance(now + cycles);
+
+	if(deadline != NEVER && now > deadline + HANG_CYCLES)
+	{
+		fprintf(stderr, "mock: stuck for %llu cycles past the deadline\n", (unsigned long long)(now - deadline));
+		exit(1);
+	}
+
+	while((irq = NextInterrupt(0)) != MOCK_IRQ_COUNT)
+	{
+		in_sync = 0;
+		TakeInterrupt(irq);
+		in_sync = 1;
+		ApplyAccess();
+	}
+
+	in_sync = 0;
+}
+
+/**
+ * @brief	Runs the clock up to an access of a register. The access
+ * 			itself happens after this returns, and takes effect at the
+ * 			next call.
+ *
+ * @param	id The register
+ *
+ * @retval	The register
+ */
+volatile uint32_t *MockRegister(MockRegisterId id)
+{
+	Sync((id >= MOCK_NVIC_EN0) ? MOCK_PPB_CYCLES : MOCK_APB_CYCLES);
+
+	switch(id)
+	{
+		case MOCK_SYSCTL_RIS:
+			regs[id] |= 0x40;	// The PLL is always locked
+			break;
+
+		case MOCK_UART4_DR:
+			regs[id] = DR_READ_MARK | ((rx_fifo_count != 0) ? DR_READ_DATA | rx_fifo[0] : 0);
+			break;
+
+		case MOCK_UART4_FR:
+			regs[id] = ((rx_fifo_count == 0) ? UART_FR_RXFE : 0) | ((rx_fifo_count == UART_FIFO_SIZE) ? UART_FR_RXFF : 0) |
+				((tx_fifo_count == UART_FIFO_SIZE) ? UART_FR_TXFF : 0) | ((tx_fifo_count == 0) ? UART_FR_TXFE : 0) |
+				((tx_done != NEVER) ? UART_FR_BUSY : 0);
+			break;
+
+		case MOCK_NVIC_ST_CTRL:
+			// Only used by SysTickDelay(), so jump to the end of the period
+			if(regs[id] & 1)
+			{
+				Advance(now + (regs[MOCK_NVIC_ST_RELOAD] & 0xFFFFFF) + 1);
+				regs[id] |= 0x10000;
+			}
+			break;
+
+		case MOCK_DWT_CYCCNT:
+			regs[id] = (uint32_t)now;
+			break;
+
+		default:
+			break;
+	}
+
+	last_id = id;
+	access_time = now;
+	shadow[id] = regs[id];
+
+	return &regs[id];
+}
+
+/**
+ * @brief	Sets PRIMASK. Unmasking takes any pending interrupt right away.
+ *
+ * @param	masked 1 to mask every interrupt, 0 to unmask them
+ *
+ * @retval	What PRIMASK was before
+ */
+uint32_t MockSetPrimask(uint32_t masked)
+{
+	uint32_t before = primask;
+
+	Sync(0);
+	primask = masked;
+	Sync(1);
+
+	return before;
+}
+
+/**
+ * @brief	Sleeps until an interrupt that could preempt the running code
+ * 			is pending (even if PRIMASK masks it). Once MockRun()'s time
+ * 			is up, or if nothing is left to wake the core, MockRun() returns.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void MockWaitForInterrupt(void)
+{
+	uint64_t next;
+
+	Sync(1);
+
+	while(NextInterrupt(1) == MOCK_IRQ_COUNT)
+	{
+		next = NextEvent();
+
+		if(running && (next == NEVER || next > deadline))
+		{
+			if(next != NEVER)
+				Advance(deadline > now ? deadline : now);
+
+			longjmp(stop, (next == NEVER) ? MOCK_IDLE : MOCK_DEADLINE);
+		}
+
+		if(next == NEVER)
+		{
+			fprintf(stderr, "mock: WFI with nothing left to wake the core\n");
+			exit(1);
+		}
+
+		Advance(next);
+	}
+
+	Sync(0);
+}
+
+/**
+ * @brief	Runs code in thread mode until it returns, or until it sleeps
+ * 			(WAIT_FOR_INTERRUPT()) when there's less time left than it
+ * 			would sleep for. Code stopped that way (like RunScheduler())
+ * 			can be run again to go on.
+ *
+ * @param	entry The code to run
+ * @param	cycles How many SYSCLK cycles it gets
+ *
+ * @retval	Why it stopped
+ */
+MockResult MockRun(void (*entry)(void), uint64_t cycles)
+{
+	volatile MockResult result;
+
+	deadline = now + cycles;
+	running = 1;
+
+	result = (MockResult)setjmp(stop);
+
+	if(result == MOCK_RETURNED)
+		entry();
+
+	// Only thread mode sleeps, but a sleep between masking and unmasking interrupts leaves them masked
+	running = 0;
+	primask = 0;
+	in_sync = 0;
+	deadline = NEVER;
+
+	return result;
+}
+
+/**
+ * @brief	Makes the host's CPU time count as time passing, so code
+ * 			that runs without touching registers takes time too
+ *
+ * @param	cycles_per_us How many SYSCLK cycles a microsecond of the host's
+ * 						  CPU time counts as, 0 to only count register accesses
+ *
+ * @retval	none
+ */
+void MockChargeHostTime(uint32_t cycles_per_us)
+{
+	host_rate = cycles_per_us;
+	host_since = HostCpuTime();
+}
+
+/**
+ * @brief	Returns the SYSCLK cycles since the simulation started
+ *
+ * @param	none
+ *
+ * @retval	The time
+ */
+uint64_t MockNow(void)
+{
+	return now;
+}
+
+/**
+ * @brief	Returns how many times an interrupt was taken
+ *
+ * @param	irq The interrupt
+ *
+ * @retval	The count
+ */
+uint32_t MockInterruptCount(uint8_t irq)
+{
+	return (irq < MOCK_IRQ_COUNT) ? interrupt_count[irq] : 0;
+}
+
+/**
+ * @brief	Queues bytes to be received by UART4. They come in back to
+ * 			back at the baud rate, after every byte queued before them.
+ *
+ * @param	data The bytes
+ * @param	length How many
+ *
+ * @retval	none
+ */
+void MockUARTReceive(const uint8_t *data, size_t length)
+{
+	Append(&rx_queue, &rx_queue_length, &rx_queue_capacity, data, length);
+	StartReceive(now);
+}
+
+/**
+ * @brief	Returns how many queued bytes haven't been received yet
+ *
+ * @param	none
+ *
+ * @retval	The count
+ */
+size_t MockUARTPending(void)
+{
+	return rx_queue_length - rx_queue_pos;
+}
+
+/**
+ * @brief	Takes bytes sent by UART4
+ *
+ * @param	buf Where to store them
+ * @param	max The most bytes to take
+ *
+ * @retval	How many were stored
+ */
+size_t MockUARTTake(uint8_t *buf, size_t max)
+{
+	size_t count = (tx_log_length < max) ? tx_log_length : max;
+
+	memcpy(buf, tx_log, count);
+	memmove(tx_log, tx_log + count, tx_log_length - count);
+	tx_log_length -= count;
+
+	return count;
+}
+
+/**
+ * @brief	Also writes every byte sent by UART4 to a file
+ *
+ * @param	out The file, or NULL to stop
+ *
+ * @retval	none
+ */
+void MockUARTEcho(FILE *out)
+{
+	tx_echo = out;
+}
+
+/**
+ * @brief	Returns how long an LED of a pixel was lit for
+ *
+ * @param	row The pixel's row
+ * @param	col The pixel's column
+ * @param	channel 0 for red, 1 for green, 2 for blue
+ *
+ * @retval	The SYSCLK cycles it was lit for since the start or MockClearLit()
+ */
+uint64_t MockLitCycles(uint8_t row, uint8_t col, uint8_t channel)
+{
+	FlushLit(now);
+
+	return lit[row][col][channel];
+}
+
+/**
+ * @brief	Returns the longest time an LED of a pixel went dark between
+ * 			two stretches of being lit
+ *
+ * @param	row The pixel's row
+ * @param	col The pixel's column
+ * @param	channel 0 for red, 1 for green, 2 for blue
+ *
+ * @retval	The SYSCLK cycles, since the start or MockClearLit()
+ */
+uint64_t MockLongestDark(uint8_t row, uint8_t col, uint8_t channel)
+{
+	FlushLit(now);
+
+	return longest_dark[row][col][channel];
+}
+
+/**
+ * @brief	Starts adding up the lit times (and dark times) from zero again
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void MockClearLit(void)
+{
+	lit_since = now;
+	memset(lit, 0, sizeof(lit));
+	memset(lit_end, 0, sizeof(lit_end));
+	memset(longest_dark, 0, sizeof(longest_dark));
+}
+
+/**
+ * @brief	Writes every GPIO write to a file
+ *
+ * @param	out The file, or NULL to stop
+ *
+ * @retval	none
+ */
+void MockTraceGpio(FILE *out)
+{
+	gpio_trace = out;
+}
+
+/**
+ * @brief	Returns the number of writes to a GPIO port's data register
+ *
+ * @param	port 'A' or 'B'
+ *
+ * @retval	The count
+ */
+uint64_t MockGpioWrites(char port)
+{
+	return gpio_writes[port == 'B'];
+}
@@ -0,0 +1,150 @@
+#ifndef MOCK_H_
+#define MOCK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Register level mock of the TM4C123 peripherals the firmware uses, for
+ * building and running it on a PC (see host/Makefile). Every register in
+ * host/inc/tm4c123gh6pm.h goes through MockRegister(), which is where the
+ * simulated clock runs:
+ *
+ * 		- Every register access takes MOCK_APB_CYCLES (peripherals) or
+ * 		  MOCK_PPB_CYCLES (NVIC, SysTick, DWT) SYSCLK cycles, the code in
+ * 		  between takes no time at all. DWT_CYCCNT_R reads the clock.
+ * 		- Timers 0 to 2 count up in periodic or one-shot mode and raise
+ * 		  their match interrupt at TAMATCHR.
+ * 		- UART4 sends and receives at the baud rate set by IBRD/FBRD, with
+ * 		  16 byte FIFOs, the receive (half full), receive timeout, and
+ * 		  transmit (1/8 full) interrupts. Bytes to receive are queued with
+ * 		  MockUARTReceive(), sent bytes are collected for MockUARTTake().
+ * 		- The NVIC dispatches Timer0AInt, Timer1Int, Timer2AInt, and UART4Int
+ * 		  (see host/vectors.c) by priority, with preemption, whenever
+ * 		  PRIMASK is clear. Interrupts are level triggered, like the
+ * 		  peripherals' interrupt lines.
+ * 		- GPIO ports A and B drive a model of the chained panels: SCLK shifts
+ * 		  port A in, LATCH latches it, and while OE is low the addressed row
+ * 		  pair lights up. How long every LED was lit is added up for
+ * 		  MockLitCycles(), the longest it went dark in between is kept
+ * 		  for MockLongestDark(), and every GPIO write can be traced to a
+ * 		  file.
+ *
+ * Writes take effect at the next register access (which is always before
+ * anything could notice). To time code that hardly touches any registers,
+ * MockChargeHostTime() makes the time the host's CPU spent running it count
+ * too, scaled to SYSCLK cycles. WAIT_FOR_INTERRUPT() skips ahead to the next
+ * interrupt, so code that waits for an interrupt has to sleep in a loop
+ * instead of spinning on a variable, or it never gets one.
+ */
+
+// SYSCLK cycles of a register access
+#define MOCK_APB_CYCLES 3	// Peripheral registers
+#define MOCK_PPB_CYCLES 1	// Core registers (NVIC, SysTick, DWT)
+
+// SYSCLK cycles to enter an interrupt
+#define MOCK_IRQ_ENTRY_CYCLES 12
+
+// Interrupt numbers of the interrupts the firmware uses
+#define MOCK_IRQ_TIMER0A 19
+#define MOCK_IRQ_TIMER1A 21
+#define MOCK_IRQ_TIMER2A 23
+#define MOCK_IRQ_UART4 60
+#define MOCK_IRQ_COUNT 64
+
+// Every mocked register
+typedef enum
+{
+	MOCK_SYSCTL_RIS, MOCK_SYSCTL_RCC, MOCK_SYSCTL_RCC2,
+	MOCK_SYSCTL_RCGCTIMER, MOCK_SYSCTL_RCGCGPIO, MOCK_SYSCTL_RCGCUART,
+
+	MOCK_GPIO_PORTA_DATA, MOCK_GPIO_PORTA_DIR, MOCK_GPIO_PORTA_DEN, MOCK_GPIO_PORTA_DR8R,
+	MOCK_GPIO_PORTB_DATA, MOCK_GPIO_PORTB_DIR, MOCK_GPIO_PORTB_DEN, MOCK_GPIO_PORTB_DR4R,
+	MOCK_GPIO_PORTC_AFSEL, MOCK_GPIO_PORTC_DEN, MOCK_GPIO_PORTC_PCTL,
+
+	MOCK_TIMER0_CFG, MOCK_TIMER0_TAMR, MOCK_TIMER0_CTL, MOCK_TIMER0_IMR, MOCK_TIMER0_ICR,
+	MOCK_TIMER0_TAILR, MOCK_TIMER0_TAMATCHR, MOCK_TIMER0_TAV,
+	MOCK_TIMER1_CFG, MOCK_TIMER1_TAMR, MOCK_TIMER1_CTL, MOCK_TIMER1_IMR, MOCK_TIMER1_ICR,
+	MOCK_TIMER1_TAILR, MOCK_TIMER1_TAMATCHR, MOCK_TIMER1_TAV,
+	MOCK_TIMER2_CFG, MOCK_TIMER2_TAMR, MOCK_TIMER2_CTL, MOCK_TIMER2_IMR, MOCK_TIMER2_ICR,
+	MOCK_TIMER2_TAILR, MOCK_TIMER2_TAMATCHR, MOCK_TIMER2_TAV,
+
+	MOCK_UART4_DR, MOCK_UART4_FR, MOCK_UART4_IBRD, MOCK_UART4_FBRD, MOCK_UART4_LCRH,
+	MOCK_UART4_CTL, MOCK_UART4_IFLS, MOCK_UART4_IM, MOCK_UART4_ICR,
+
+	MOCK_NVIC_EN0, MOCK_NVIC_EN1, MOCK_NVIC_PEND0, MOCK_NVIC_PEND1, MOCK_NVIC_UNPEND0, MOCK_NVIC_UNPEND1,
+	MOCK_NVIC_PRI4, MOCK_NVIC_PRI5, MOCK_NVIC_PRI15,
+	MOCK_NVIC_ST_CTRL, MOCK_NVIC_ST_RELOAD, MOCK_NVIC_ST_CURRENT,
+
+	MOCK_DEMCR, MOCK_DWT_CTRL, MOCK_DWT_CYCCNT,
+
+	MOCK_REGISTER_COUNT
+} MockRegisterId;
+
+// Why MockRun() returned
+typedef enum
+{
+	MOCK_RETURNED,	// The code returned
+	MOCK_DEADLINE,	// The time ran out while the core was asleep
+	MOCK_IDLE		// The core went to sleep with nothing left to wake it up
+} MockResult;
+
+// An interrupt handler of the firmware (see host/vectors.c)
+typedef struct MockVector_t
+{
+	uint8_t irq;
+	void (*handler)(void);
+} MockVector;
+
+// The firmware's interrupt handlers, ended by an entry without a handler
+extern const MockVector mock_vectors[];
+
+// Runs the clock up to an access of a register, and returns the register
+volatile uint32_t *MockRegister(MockRegisterId id);
+
+// Sets PRIMASK (1 masks every interrupt), returns what it was
+uint32_t MockSetPrimask(uint32_t masked);
+
+// Skips ahead to the next interrupt (WFI)
+void MockWaitForInterrupt(void);
+
+// Runs code until it returns, or until it sleeps once the time (in SYSCLK cycles from now) is up
+MockResult MockRun(void (*entry)(void), uint64_t cycles);
+
+// Counts every microsecond of the host's CPU time as a number of SYSCLK cycles, from the next register access on (0 stops)
+void MockChargeHostTime(uint32_t cycles_per_us);
+
+// Returns the SYSCLK cycles since the simulation started
+uint64_t MockNow(void);
+
+// Returns how many times an interrupt was taken
+uint32_t MockInterruptCount(uint8_t irq);
+
+// Queues bytes to be received by UART4, back to back after everything queued before
+void MockUARTReceive(const uint8_t *data, size_t length);
+
+// Returns how many queued bytes haven't been received yet
+size_t MockUARTPending(void);
+
+// Takes up to max bytes sent by UART4, returns how many there were
+size_t MockUARTTake(uint8_t *buf, size_t max);
+
+// Also writes every byte sent by UART4 to a file as it's sent (NULL to stop)
+void MockUARTEcho(FILE *out);
+
+// Returns how many SYSCLK cycles an LED of a pixel was lit for (channel 0 is red, 1 green, 2 blue)
+uint64_t MockLitCycles(uint8_t row, uint8_t col, uint8_t channel);
+
+// Returns the longest time an LED of a pixel went dark between two stretches of being lit
+uint64_t MockLongestDark(uint8_t row, uint8_t col, uint8_t channel);
+
+// Starts adding up the lit times (and dark times) from zero again
+void MockClearLit(void);
+
+// Writes every GPIO write to a file, as "<cycle> <port> <value>" lines (NULL to stop)
+void MockTraceGpio(FILE *out);
+
+// Returns the number of writes to a GPIO port's data register ('A' or 'B')
+uint64_t MockGpioWrites(char port);
+
+#endif /* MOCK_H_ */
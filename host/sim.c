@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mock.h"
+#include "firmware.h"
+#include "LedMatrix.h"
+
+/**
+ * Runs the firmware headless on the peripheral mock (see mock.h), for as
+ * long as it would run on the board in the given time:
+ *
+ * 		sim [-t seconds] [-i input] [-o output] [-g trace]
+ *
+ * 		-t	Simulated seconds to run for (default 10)
+ * 		-i	File (or - for stdin) with the bytes to send to the UART, sent
+ * 			back to back at the baud rate right after reset
+ * 		-o	File for everything the firmware sends over the UART (default stdout)
+ * 		-g	File to trace every GPIO write to (see MockTraceGpio())
+ *
+ * At the end, a summary of the simulation is written to stderr.
+ */
+
+/**
+ * @brief	Reads a whole file
+ *
+ * @param	path The file, or - for stdin
+ * @param	length Where to store its length
+ *
+ * @retval	The contents (malloc'd)
+ */
+static uint8_t *ReadFile(const char *path, size_t *length)
+{
+	FILE *in = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+	uint8_t *data = NULL;
+	size_t capacity = 0, count;
+
+	if(in == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+
+	*length = 0;
+
+	do
+	{
+		if(*length == capacity)
+		{
+			capacity = capacity * 2 + 4096;
+			data = realloc(data, capacity);
+		}
+
+		count = fread(data + *length, 1, capacity - *length, in);
+		*length += count;
+	} while(count != 0);
+
+	if(in != stdin)
+		fclose(in);
+
+	return data;
+}
+
+/**
+ * @brief	Runs the firmware from reset
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Boot(void)
+{
+	FirmwareMain();
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 10;
+	FILE *output = stdout, *trace = NULL;
+	uint8_t *input;
+	size_t length;
+	MockResult result;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t:i:o:g:")) != -1)
+	{
+		switch(opt)
+		{
+			case 't':
+				seconds = atof(optarg);
+				break;
+			case 'i':
+				input = ReadFile(optarg, &length);
+				MockUARTReceive(input, length);
+				free(input);
+				break;
+			case 'o':
+				output = fopen(optarg, "wb");
+				break;
+			case 'g':
+				trace = fopen(optarg, "w");
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-t seconds] [-i input] [-o output] [-g trace]\n", argv[0]);
+				return 2;
+		}
+
+		if(output == NULL || (opt == 'g' && trace == NULL))
+		{
+			perror(optarg);
+			return 1;
+		}
+	}
+
+	MockUARTEcho(output);
+	MockTraceGpio(trace);
+
+	result = MockRun(Boot, (uint64_t)(seconds * SYSCLK));
+
+	fflush(output);
+
+	if(trace != NULL)
+		fclose(trace);
+
+	fprintf(stderr, "sim: %.3f s simulated, %s\n", (double)MockNow() / SYSCLK,
+		(result == MOCK_DEADLINE) ? "time up" : (result == MOCK_IDLE) ? "nothing left to do" : "main() returned");
+	fprintf(stderr, "sim: interrupts Timer0A=%u Timer1A=%u Timer2A=%u UART4=%u\n",
+		MockInterruptCount(MOCK_IRQ_TIMER0A), MockInterruptCount(MOCK_IRQ_TIMER1A),
+		MockInterruptCount(MOCK_IRQ_TIMER2A), MockInterruptCount(MOCK_IRQ_UART4));
+	fprintf(stderr, "sim: GPIO writes A=%llu B=%llu, %zu bytes not received yet\n",
+		(unsigned long long)MockGpioWrites('A'), (unsigned long long)MockGpioWrites('B'), MockUARTPending());
+
+	return 0;
+}
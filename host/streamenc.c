@@ -0,0 +1,151 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "streamenc.h"
+#include "protocol.h"
+
+// Longest run a skip and a color token can cover
+#define MAX_SKIP 0x80
+#define MAX_RUN 0x40
+
+/**
+ * @brief	Finds a color in the palette
+ *
+ * @param	palette The palette
+ * @param	palette_size The number of colors in it
+ * @param	color The color
+ *
+ * @retval	Its index, or palette_size if it isn't there
+ */
+static uint8_t FindPaletteColor(const uint8_t palette[][3], uint8_t palette_size, const uint8_t *color)
+{
+	uint8_t i;
+
+	for(i = 0; i < palette_size; ++i)
+	{
+		if(memcmp(palette[i], color, 3) == 0)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * @brief	Encodes a frame as changes against the previous one (see
+ * 			stream.h). Unchanged pixels become skip tokens, everything
+ * 			else becomes runs of one color, which may cover unchanged
+ * 			pixels of the same color too.
+ *
+ * @param	prev The frame on the display
+ * @param	next The frame to display
+ * @param	palette The colors that can be sent by index
+ * @param	palette_size The number of colors in the palette (up to STREAM_PALETTE_SIZE)
+ * @param	tokens Where to store the token stream (STREAM_MAX_TOKENS bytes)
+ *
+ * @retval	The length of the token stream
+ */
+size_t StreamEncode(const StreamImage prev, const StreamImage next, const uint8_t palette[][3], uint8_t palette_size, uint8_t *tokens)
+{
+	const uint8_t *prev_pixels = &prev[0][0][0], *next_pixels = &next[0][0][0];
+	size_t length = 0;
+	uint16_t pixel = 0, run;
+	uint8_t index;
+
+	while(pixel < MAX_ROWS * MAX_COLS)
+	{
+		run = 1;
+
+		if(memcmp(&prev_pixels[3 * pixel], &next_pixels[3 * pixel], 3) == 0)
+		{
+			while(pixel + run < MAX_ROWS * MAX_COLS && run < MAX_SKIP &&
+				memcmp(&prev_pixels[3 * (pixel + run)], &next_pixels[3 * (pixel + run)], 3) == 0)
+				run++;
+
+			// Unchanged pixels at the end of the frame don't need a token
+			if(pixel + run < MAX_ROWS * MAX_COLS)
+				tokens[length++] = run - 1;
+		}
+		else
+		{
+			while(pixel + run < MAX_ROWS * MAX_COLS && run < MAX_RUN &&
+				memcmp(&next_pixels[3 * pixel], &next_pixels[3 * (pixel + run)], 3) == 0)
+				run++;
+
+			index = FindPaletteColor(palette, palette_size, &next_pixels[3 * pixel]);
+
+			if(index < palette_size)
+			{
+				tokens[length++] = 0xC0 | (run - 1);
+				tokens[length++] = index;
+			}
+			else
+			{
+				tokens[length++] = 0x80 | (run - 1);
+				memcpy(&tokens[length], &next_pixels[3 * pixel], 3);
+				length += 3;
+			}
+		}
+
+		pixel += run;
+	}
+
+	return length;
+}
+
+/**
+ * @brief	Sends a token stream as a streamed frame, split into as few
+ * 			OP_STREAM_DATA frames as fit
+ *
+ * @param	tokens The token stream (from StreamEncode())
+ * @param	length The length of the token stream
+ * @param	send Sends a protocol frame
+ *
+ * @retval	none
+ */
+void StreamSend(const uint8_t *tokens, size_t length, StreamSendFunc send)
+{
+	size_t part;
+
+	send(OP_STREAM_BEGIN, 0, 0);
+
+	for(; length != 0; tokens += part, length -= part)
+	{
+		part = (length < PROTOCOL_MAX_PAYLOAD) ? length : PROTOCOL_MAX_PAYLOAD;
+		send(OP_STREAM_DATA, tokens, part);
+	}
+
+	send(OP_STREAM_END, 0, 0);
+}
+
+/**
+ * @brief	Sends the palette, starting at index 0
+ *
+ * @param	palette The colors
+ * @param	palette_size The number of colors (up to STREAM_PALETTE_SIZE)
+ * @param	send Sends a protocol frame
+ *
+ * @retval	none
+ */
+void StreamSendPalette(const uint8_t palette[][3], uint8_t palette_size, StreamSendFunc send)
+{
+	uint8_t payload[1 + 3 * STREAM_PALETTE_SIZE] = {0};
+
+	memcpy(&payload[1], palette, 3 * palette_size);
+	send(OP_STREAM_PALETTE, payload, 1 + 3 * palette_size);
+}
+
+/**
+ * @brief	Counts the bytes StreamSend() puts on the wire: the token
+ * 			stream, and 4 bytes of framing (SYNC, opcode, length, CRC)
+ * 			for every frame it's sent in
+ *
+ * @param	length The length of the token stream
+ *
+ * @retval	The number of bytes
+ */
+size_t StreamLinkBytes(size_t length)
+{
+	size_t frames = 2 + (length + PROTOCOL_MAX_PAYLOAD - 1) / PROTOCOL_MAX_PAYLOAD;
+
+	return length + 4 * frames;
+}
@@ -0,0 +1,37 @@
+#ifndef STREAMENC_H_
+#define STREAMENC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LedMatrix.h"
+#include "stream.h"
+
+/**
+ * Encoder for the firmware's streaming mode (see stream.h), used by the
+ * host tests and benchmarks. A frame is encoded against the frame before
+ * it: pixels that didn't change are skipped, and the changed ones are
+ * sent as runs of one color, by palette index when the palette has it.
+ */
+
+// An 8 bit per component frame of the whole display
+typedef uint8_t StreamImage[MAX_ROWS][MAX_COLS][3];
+
+// Largest token stream of a frame (every pixel an RGB token)
+#define STREAM_MAX_TOKENS (MAX_ROWS * MAX_COLS * 4)
+
+// Sends a protocol frame (like SendFrame() in host/test/harness.h)
+typedef void (*StreamSendFunc)(uint8_t opcode, const uint8_t *payload, uint8_t length);
+
+// Encodes a frame as changes against the previous one, returns the length of the token stream
+size_t StreamEncode(const StreamImage prev, const StreamImage next, const uint8_t palette[][3], uint8_t palette_size, uint8_t *tokens);
+
+// Sends a token stream as OP_STREAM_BEGIN, OP_STREAM_DATA frames, and OP_STREAM_END
+void StreamSend(const uint8_t *tokens, size_t length, StreamSendFunc send);
+
+// Sends the palette as OP_STREAM_PALETTE
+void StreamSendPalette(const uint8_t palette[][3], uint8_t palette_size, StreamSendFunc send);
+
+// Returns how many bytes StreamSend() puts on the wire for a token stream
+size_t StreamLinkBytes(size_t length);
+
+#endif /* STREAMENC_H_ */
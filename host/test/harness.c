@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "protocol.h"
+#include "scheduler.h"
+
+static int checks, failures;
+
+// Bytes sent by the firmware that weren't taken as a frame yet
+static uint8_t sent[4096];
+static size_t sent_length;
+
+// The firmware's main(), defined by host/firmware.c
+extern int FirmwareMain(void);
+
+/**
+ * @brief	Counts a check, and prints it if it failed
+ *
+ * @param	passed Whether it passed
+ * @param	text The condition
+ * @param	file Where the check is
+ * @param	line Where the check is
+ *
+ * @retval	passed
+ */
+int CheckResult(int passed, const char *text, const char *file, int line)
+{
+	checks++;
+
+	if(!passed)
+	{
+		failures++;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+	}
+
+	return passed;
+}
+
+/**
+ * @brief	Prints how many checks passed
+ *
+ * @param	none
+ *
+ * @retval	The exit code of the test, 0 if every check passed
+ */
+int TestResult(void)
+{
+	printf("%d of %d checks passed\n", checks - failures, checks);
+
+	return failures != 0;
+}
+
+/**
+ * @brief	Runs the firmware from reset
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Boot(void)
+{
+	FirmwareMain();
+}
+
+/**
+ * @brief	Resets the firmware and runs it
+ *
+ * @param	cycles How many SYSCLK cycles to run it for
+ *
+ * @retval	none
+ */
+void BootFirmware(uint64_t cycles)
+{
+	MockRun(Boot, cycles);
+}
+
+/**
+ * @brief	Runs the firmware's scheduler, after BootFirmware()
+ *
+ * @param	cycles How many SYSCLK cycles to run it for
+ *
+ * @retval	none
+ */
+void RunFirmware(uint64_t cycles)
+{
+	MockRun(RunScheduler, cycles);
+}
+
+/**
+ * @brief	Adds a byte to a CRC8 (polynomial 0x07), like protocol.c
+ *
+ * @param	crc The CRC so far
+ * @param	data The byte to add
+ *
+ * @retval	The new CRC
+ */
+static uint8_t Crc8(uint8_t crc, uint8_t data)
+{
+	uint8_t bit;
+
+	crc ^= data;
+
+	for(bit = 0; bit < 8; ++bit)
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+
+	return crc;
+}
+
+/**
+ * @brief	Queues a protocol frame to be received by the firmware
+ *
+ * @param	opcode The opcode
+ * @param	payload The payload
+ * @param	length The length of payload
+ *
+ * @retval	none
+ */
+void SendFrame(uint8_t opcode, const uint8_t *payload, uint8_t length)
+{
+	uint8_t frame[PROTOCOL_MAX_PAYLOAD + 4];
+	uint8_t crc, i;
+
+	frame[0] = PROTOCOL_SYNC;
+	frame[1] = opcode;
+	frame[2] = length;
+	crc = Crc8(Crc8(0, opcode), length);
+
+	for(i = 0; i < length; ++i)
+	{
+		frame[3 + i] = payload[i];
+		crc = Crc8(crc, payload[i]);
+	}
+
+	frame[3 + length] = crc;
+	MockUARTReceive(frame, length + 4);
+}
+
+/**
+ * @brief	Takes the next good frame the firmware sent, dropping any
+ * 			bytes before it
+ *
+ * @param	opcode Where to store its opcode
+ * @param	payload Where to store its payload (PROTOCOL_MAX_PAYLOAD bytes)
+ * @param	length Where to store the length of its payload
+ *
+ * @retval	1 if there was a frame
+ */
+int ReceiveFrame(uint8_t *opcode, uint8_t *payload, uint8_t *length)
+{
+	size_t start, i;
+	uint8_t crc;
+
+	sent_length += MockUARTTake(sent + sent_length, sizeof(sent) - sent_length);
+
+	for(start = 0; start + 4 <= sent_length; ++start)
+	{
+		if(sent[start] != PROTOCOL_SYNC || start + 4 + sent[start + 2] > sent_length)
+			continue;
+
+		for(crc = 0, i = start + 1; i < start + 3 + sent[start + 2]; ++i)
+			crc = Crc8(crc, sent[i]);
+
+		if(crc != sent[start + 3 + sent[start + 2]])
+			continue;
+
+		*opcode = sent[start + 1];
+		*length = sent[start + 2];
+		memcpy(payload, &sent[start + 3], *length);
+
+		start += 4 + *length;
+		memmove(sent, sent + start, sent_length - start);
+		sent_length -= start;
+
+		return 1;
+	}
+
+	return 0;
+}
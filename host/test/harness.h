@@ -0,0 +1,37 @@
+#ifndef HARNESS_H_
+#define HARNESS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Shared by the host tests (see host/Makefile). A test is a program that
+ * runs its CHECK()s and returns TestResult() from main(), so it exits
+ * with 0 only if every check passed.
+ */
+
+// Checks a condition, printing it and where it is if it doesn't hold
+#define CHECK(cond) CheckResult((cond) != 0, #cond, __FILE__, __LINE__)
+
+// Like CHECK(), with a printf style message explaining the failure
+#define CHECK_MSG(cond, ...) do { if(!CheckResult((cond) != 0, #cond, __FILE__, __LINE__)) fprintf(stderr, "\t" __VA_ARGS__), fputc('\n', stderr); } while(0)
+
+// Counts a check, returns whether it passed
+int CheckResult(int passed, const char *text, const char *file, int line);
+
+// Prints how many checks passed, returns the exit code of the test
+int TestResult(void);
+
+// Resets the firmware and runs it for a number of SYSCLK cycles (needs host/firmware.c)
+void BootFirmware(uint64_t cycles);
+
+// Runs the firmware's scheduler for a number of SYSCLK cycles, after BootFirmware()
+void RunFirmware(uint64_t cycles);
+
+// Queues a protocol frame (see protocol.h) to be received by the firmware
+void SendFrame(uint8_t opcode, const uint8_t *payload, uint8_t length);
+
+// Takes the next frame the firmware sent, skipping anything else, returns 0 if there's none
+int ReceiveFrame(uint8_t *opcode, uint8_t *payload, uint8_t *length);
+
+#endif /* HARNESS_H_ */
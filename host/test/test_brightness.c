@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+
+/**
+ * Models the brightness control (SetBrightness()) on the mock's panels:
+ * lights one pixel per BCM cycle (pixel (0, bcm) has only that bit set),
+ * calibrates, and adds up the light of every plane over whole frames at full
+ * brightness and at a few lower levels. Prints every plane's lit time as
+ * CSV, next to level / BRIGHTNESS_MAX of its lit time at full brightness,
+ * and checks that it's within 1% of that (or LATENCY_TOLERANCE, for the
+ * short cycles where the interrupt latency is more than 1%), that level 0
+ * lights nothing, and that a Timer2A one-shot that didn't fire before the
+ * slot was over gets cancelled by the next Timer0AInt() instead of turning
+ * off the next slot's rows. Slots dimmed to less than BCM_POLL_CYCLES get
+ * turned off by the refresh interrupt itself, and the Makefile also builds
+ * it with the shortest cycles polled, where the polling loop dims them.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many frames the light gets added up over
+#define FRAMES 32
+
+// How far a dimmed plane's lit time may be off, in SYSCLK cycles, when that's more than 1%:
+// Timer2AInt() and Timer0AInt() take a few cycles more or less to turn the rows off, and
+// that difference doesn't scale with the level
+#define LATENCY_TOLERANCE 12
+
+// The levels that get checked, the last one dims every slot by about a cycle
+static const uint8_t levels[] = {192, 128, 64, 16, BRIGHTNESS_MAX - 1};
+
+/**
+ * @brief	Waits for the refresh interrupt to show the frame that was drawn
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrame(void)
+{
+	PresentFrame();
+
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show FRAMES whole frames
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrames(void)
+{
+	uint8_t frame;
+
+	for(frame = 0; frame < FRAMES; ++frame)
+		ShowFrame();
+}
+
+/**
+ * @brief	Calibrates the BCM timing, as the firmware does at startup
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Calibrate(void)
+{
+	CalibrateMatrix(NULL);
+}
+
+/**
+ * @brief	Adds up how long every plane's pixel is lit over FRAMES frames,
+ * 			starting at the start of a frame, at a brightness
+ *
+ * @param	level The brightness
+ * @param	lit Where to store the lit time of every plane, per frame (in SYSCLK cycles)
+ * @param	dimmed Where to store how many times Timer2A turned the rows off, per frame
+ *
+ * @retval	none
+ */
+static void MeasurePlanes(uint8_t level, uint32_t lit[BCM_BITS], uint32_t *dimmed)
+{
+	uint32_t isrs;
+	uint8_t bcm;
+
+	// A whole frame at the new level before measuring
+	SetBrightness(level);
+	MockRun(ShowFrame, SECOND);
+	MockRun(ShowFrame, SECOND);
+	MockClearLit();
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER2A);
+	MockRun(ShowFrames, SECOND);
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		lit[bcm] = (uint32_t)((MockLitCycles(0, bcm, 0) + FRAMES / 2) / FRAMES);
+
+	*dimmed = (MockInterruptCount(MOCK_IRQ_TIMER2A) - isrs) / FRAMES;
+}
+
+int main(void)
+{
+	uint32_t full[BCM_BITS], lit[BCM_BITS], expected, dimmed;
+	uint64_t total;
+	uint8_t bcm, buffer, level;
+	int error, tolerance;
+
+	InitMatrixDriver();
+	TIMER0_CTL_R |= 0x1;
+
+	// Into both buffers, so every frame shows the same
+	for(buffer = 0; buffer < 2; ++buffer)
+	{
+		for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		{
+			SetColor(1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS));
+			DrawPixel(0, bcm);
+		}
+
+		MockRun(ShowFrame, SECOND);
+	}
+
+	MockRun(Calibrate, SECOND);
+	MeasurePlanes(BRIGHTNESS_MAX, full, &dimmed);
+	CHECK_MSG(dimmed == 0, "Timer2A turned the rows off %u times a frame at full brightness", dimmed);
+
+	printf("level,plane,full_cycles,expected_cycles,lit_cycles,error_percent\n");
+
+	for(level = 0; level < sizeof(levels); ++level)
+	{
+		MeasurePlanes(levels[level], lit, &dimmed);
+
+		for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		{
+			expected = (full[bcm] * levels[level] + BRIGHTNESS_MAX / 2) / BRIGHTNESS_MAX;
+			error = (int)lit[bcm] - (int)expected;
+			tolerance = ((int)expected / 100 > LATENCY_TOLERANCE) ? (int)expected / 100 : LATENCY_TOLERANCE;
+
+			printf("%u,%u,%u,%u,%u,%.3f\n", levels[level], bcm, full[bcm], expected, lit[bcm], 100.0 * error / expected);
+
+			CHECK_MSG(abs(error) <= tolerance, "at brightness %u, plane %u is lit %u cycles, not %u", levels[level], bcm, lit[bcm], expected);
+		}
+
+		// Timer2A fires at most once per slot with an interrupt of its own (slots dimmed to less than BCM_POLL_CYCLES don't start it)
+		CHECK_MSG(dimmed <= BCM_ISRS_PER_FRAME, "Timer2A turned the rows off %u times a frame, in %u slots", dimmed, BCM_ISRS_PER_FRAME);
+
+		if(level == 0)
+			CHECK_MSG(dimmed > 0, "Timer2A never turned the rows off at brightness %u", levels[level]);
+
+		// Every slot with an interrupt of its own starts Timer2A, the ones that dim by a cycle or so end before it fires
+		if(levels[level] == BRIGHTNESS_MAX - 1)
+			CHECK_MSG(dimmed < BCM_ISRS_PER_FRAME, "Timer2A fired for all %u slots of a frame, even the ones too short to dim", dimmed);
+	}
+
+	// Off, nothing gets lit at all
+	MeasurePlanes(0, lit, &dimmed);
+
+	for(bcm = 0, total = 0; bcm < BCM_BITS; ++bcm)
+		total += lit[bcm];
+
+	CHECK_MSG(total == 0, "brightness 0 still lights the planes for %u cycles a frame", (uint32_t)total);
+	CHECK(GetBrightness() == 0);
+
+	return TestResult();
+}
@@ -0,0 +1,177 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+
+/**
+ * Models the BCM timing before and after CalibrateMatrix(): lights one pixel
+ * per BCM cycle (pixel (0, bcm) has only that bit set) and adds up the light
+ * that comes out of the mock's panels over whole frames, with the timer
+ * periods at their targets and then calibrated. Prints the effective duty of
+ * every plane (the share of a frame it's lit for) as CSV, next to what the
+ * firmware measured itself, and checks that after calibrating every plane is
+ * lit for its target, and that the firmware's own measurement agrees.
+ * Built with a higher BCM_POLL_CYCLES (test_calibration_polled), the short
+ * cycles are polled, so this also checks that they skip their interrupts.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many frames the light gets added up over
+#define FRAMES 64
+
+// How far a plane's lit time may be off after calibrating, in SYSCLK cycles
+#define LIT_TOLERANCE 8
+
+// How far the firmware's measurement may be off from the light that came out of the panels
+#define MEASURE_TOLERANCE 8
+
+// What the firmware measured before and after calibrating
+static uint32_t measured_before[BCM_BITS], measured_after[BCM_BITS];
+
+/**
+ * @brief	Calibrates the BCM timing, keeping what the firmware measured
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Calibrate(void)
+{
+	CalibrateMatrix(measured_before);
+	MeasureLitTimes(measured_after);
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show the frame that was drawn
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrame(void)
+{
+	PresentFrame();
+
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show FRAMES whole frames
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrames(void)
+{
+	uint8_t frame;
+
+	for(frame = 0; frame < FRAMES; ++frame)
+		ShowFrame();
+}
+
+/**
+ * @brief	Adds up how long every plane's pixel is lit over FRAMES frames,
+ * 			starting at the start of a frame
+ *
+ * @param	lit Where to store the lit time of every plane, per frame (in SYSCLK cycles)
+ * @param	frame Where to store how long a frame takes (in SYSCLK cycles)
+ * @param	isrs Where to store how many refresh interrupts a frame takes
+ *
+ * @retval	none
+ */
+static void MeasurePlanes(uint32_t lit[BCM_BITS], uint32_t *frame, uint32_t *isrs)
+{
+	uint64_t start;
+	uint32_t start_isrs;
+	uint8_t bcm;
+
+	MockRun(ShowFrame, SECOND);
+	MockClearLit();
+	start = MockNow();
+	start_isrs = MockInterruptCount(MOCK_IRQ_TIMER0A);
+	MockRun(ShowFrames, SECOND);
+
+	*isrs = (MockInterruptCount(MOCK_IRQ_TIMER0A) - start_isrs + FRAMES / 2) / FRAMES;
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		lit[bcm] = (uint32_t)((MockLitCycles(0, bcm, 0) + FRAMES / 2) / FRAMES);
+
+	*frame = (uint32_t)((MockNow() - start + FRAMES / 2) / FRAMES);
+}
+
+/**
+ * @brief	Prints a lit time as a share of the frame, in percent
+ *
+ * @param	lit The lit time
+ * @param	frame How long a frame takes
+ *
+ * @retval	none
+ */
+static void PrintDuty(uint32_t lit, uint32_t frame)
+{
+	printf(",%.4f", 100.0 * lit / frame);
+}
+
+int main(void)
+{
+	uint32_t lit_before[BCM_BITS], lit_after[BCM_BITS], frame_before, frame_after, target, isrs_before, isrs_after;
+	uint8_t bcm, buffer;
+	int error_before = 0, error_after = 0, worst_measured = 0;
+
+	InitMatrixDriver();
+	TIMER0_CTL_R |= 0x1;
+
+	// Into both buffers, so every frame shows the same
+	for(buffer = 0; buffer < 2; ++buffer)
+	{
+		for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		{
+			SetColor(1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS));
+			DrawPixel(0, bcm);
+		}
+
+		MockRun(ShowFrame, SECOND);
+	}
+
+	// The periods start out at their targets
+	MeasurePlanes(lit_before, &frame_before, &isrs_before);
+	MockRun(Calibrate, SECOND);
+	MeasurePlanes(lit_after, &frame_after, &isrs_after);
+
+	printf("plane,target_cycles,lit_before,lit_after,measured_before,measured_after,duty_target,duty_before,duty_after\n");
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+	{
+		target = (uint32_t)BCM_BASE_TICKS << bcm;
+
+		printf("%u,%u,%u,%u,%u,%u", bcm, target, lit_before[bcm], lit_after[bcm], measured_before[bcm], measured_after[bcm]);
+		PrintDuty(target, frame_after);
+		PrintDuty(lit_before[bcm], frame_before);
+		PrintDuty(lit_after[bcm], frame_after);
+		printf("\n");
+
+		if(abs((int)(lit_before[bcm] - target)) > error_before)
+			error_before = abs((int)(lit_before[bcm] - target));
+
+		if(abs((int)(lit_after[bcm] - target)) > error_after)
+			error_after = abs((int)(lit_after[bcm] - target));
+
+		if(abs((int)(measured_before[bcm] - lit_before[bcm])) > worst_measured)
+			worst_measured = abs((int)(measured_before[bcm] - lit_before[bcm]));
+
+		if(abs((int)(measured_after[bcm] - lit_after[bcm])) > worst_measured)
+			worst_measured = abs((int)(measured_after[bcm] - lit_after[bcm]));
+	}
+
+	CHECK_MSG(error_after <= LIT_TOLERANCE, "a plane is lit %d cycles off from its target after calibrating", error_after);
+	CHECK_MSG(error_after < error_before, "calibrating took the worst error from %d to %d cycles", error_before, error_after);
+	CHECK_MSG(isrs_before == BCM_ISRS_PER_FRAME && isrs_after == BCM_ISRS_PER_FRAME, "%u and %u refresh interrupts a frame, the model says %u", isrs_before, isrs_after, BCM_ISRS_PER_FRAME);
+	CHECK_MSG(worst_measured <= MEASURE_TOLERANCE, "the firmware's measurement is %d cycles off from the light", worst_measured);
+
+	return TestResult();
+}
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "utility.h"
+
+/**
+ * Draws random lines, pixels, and grids, and checks that the frame the
+ * refresh interrupt shows is what drawing every pixel on its own would
+ * have made, so the run fills of DrawRowLine() and DrawGridArray() set the
+ * same bits in every bit-plane as DrawPixel(). With indexed colors, it also
+ * checks that SetColor() gets palette entries back once no buffer uses them.
+ */
+
+// How many things get drawn, and how many times
+#define DRAWS 200
+#define ROUNDS 8
+
+// Colors drawn with, the model of the frame, and the state of the random numbers
+static Color colors[4];
+static Color model[MAX_ROWS][MAX_COLS];
+static uint32_t seed = 1;
+
+/**
+ * @brief	Makes a random number
+ *
+ * @param	range How many numbers there are to pick from
+ *
+ * @retval	A number from 0 to range - 1
+ */
+static uint32_t Random(uint32_t range)
+{
+	seed = seed * 1103515245 + 12345;
+
+	return (seed >> 16) % range;
+}
+
+/**
+ * @brief	Picks one of the colors to draw with
+ *
+ * @param	none
+ *
+ * @retval	The color
+ */
+static Color PickColor(void)
+{
+	uint8_t index = Random(4);
+
+#ifdef MATRIX_INDEXED_COLOR
+	SetColorIndex(index + 1);
+#else
+	SetColor(colors[index].R, colors[index].G, colors[index].B);
+#endif
+
+	return colors[index];
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show the frame that was drawn
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrame(void)
+{
+	PresentFrame();
+
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+}
+
+int main(void)
+{
+	GridArray grid, mask;
+	Color color;
+	uint8_t row, col, length, index;
+	int round, draw, wrong;
+
+	for(index = 0; index < 4; ++index)
+	{
+		colors[index].R = Random(COLOR_MAX + 1);
+		colors[index].G = Random(COLOR_MAX + 1);
+		colors[index].B = Random(COLOR_MAX + 1);
+
+#ifdef MATRIX_INDEXED_COLOR
+		SetPaletteColor(index + 1, colors[index].R, colors[index].G, colors[index].B);
+#endif
+	}
+
+	InitMatrixDriver();
+	TIMER0_CTL_R |= 0x1;
+
+	for(round = 0; round < ROUNDS; ++round)
+	{
+		ClearMatrix();
+		memset(model, 0, sizeof(model));
+
+		for(draw = 0; draw < DRAWS; ++draw)
+		{
+			color = PickColor();
+
+			switch(Random(5))
+			{
+			case 0:
+				row = Random(MAX_ROWS);
+				col = Random(MAX_COLS);
+				length = 1 + Random(MAX_COLS - col);
+				DrawRowLine(row, col, length);
+
+				while(length--)
+					model[row][col + length] = color;
+				break;
+			case 1:
+				col = Random(MAX_COLS);
+				row = Random(MAX_ROWS);
+				length = 1 + Random(MAX_ROWS - row);
+				DrawColumnLine(col, row, length);
+
+				while(length--)
+					model[row + length][col] = color;
+				break;
+			case 2:
+				row = Random(MAX_ROWS);
+				col = Random(MAX_COLS);
+				DrawPixel(row, col);
+				model[row][col] = color;
+				break;
+			default:
+				// Grids of long runs, short runs, and everything in between
+				for(row = 0; row < MAX_ROWS; ++row)
+				{
+					grid[row] = 0;
+					mask[row] = GRIDROW_ALL;
+
+					for(col = Random(MAX_COLS); col < MAX_COLS; col += 1 + Random(MAX_COLS / 4))
+					{
+						length = 1 + Random(MAX_COLS - col);
+						grid[row] |= (length == MAX_COLS ? GRIDROW_ALL : (((GridRow)1 << length) - 1) << col);
+						col += length;
+					}
+
+					if(Random(2))
+						mask[row] = (GridRow)Random(0x10000) * 0x0001000100010001ULL;
+				}
+
+				if(Random(2))
+				{
+					DrawGridArray(grid);
+					memset(mask, 0xFF, sizeof(mask));
+				}
+				else
+					DrawGridArrayMasked(grid, mask);
+
+				for(row = 0; row < MAX_ROWS; ++row)
+					for(col = 0; col < MAX_COLS; ++col)
+						if(GET_GRIDARRAY_BIT(grid, row, col) && GET_GRIDARRAY_BIT(mask, row, col))
+							model[row][col] = color;
+				break;
+			}
+		}
+
+		CHECK(MockRun(ShowFrame, (uint64_t)SYSCLK) == MOCK_RETURNED);
+
+		wrong = 0;
+
+		for(row = 0; row < MAX_ROWS; ++row)
+		{
+			for(col = 0; col < MAX_COLS; ++col)
+			{
+				color = GetDisplayedPixel(row, col);
+
+				if(memcmp(&color, &model[row][col], sizeof(color)) != 0)
+					++wrong;
+			}
+		}
+
+		CHECK_MSG(wrong == 0, "round %d: %d pixels differ from drawing them one by one", round, wrong);
+	}
+
+#ifdef MATRIX_INDEXED_COLOR
+	// Frames of new colors each, many more than fit in the palette at once, all come out exact
+	wrong = 0;
+
+	for(round = 0; round < ROUNDS; ++round)
+	{
+		DrawSolidColor();
+
+		for(index = 0; index < 4; ++index)
+		{
+			SetColor(round, index, COLOR_MAX - round);
+			DrawPixel(index, index);
+		}
+
+		CHECK(MockRun(ShowFrame, (uint64_t)SYSCLK) == MOCK_RETURNED);
+
+		for(index = 0; index < 4; ++index)
+		{
+			color = GetDisplayedPixel(index, index);
+			wrong += (color.R != round || color.G != index || color.B != COLOR_MAX - round);
+		}
+	}
+
+	CHECK_MSG(wrong == 0, "%d pixels got the closest palette color instead of their own", wrong);
+#endif
+
+	return TestResult();
+}
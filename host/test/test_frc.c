@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+
+/**
+ * Checks the perceived brightness of frame rate control (BCM_FRC_BITS, see
+ * LedMatrix.h): draws random colors, plus a ramp of the dimmest ones where
+ * the fraction bits matter most, and adds up the light that comes out of the
+ * mock's panels over whole dither patterns. Averaged like that, every LED has
+ * to be lit for its color component's share of the frame, counting the
+ * fraction bits. Prints the worst and mean error, in steps of the color. The
+ * Makefile builds it with a few FRC settings.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many frames the light gets added up over, a whole number of dither patterns
+#define FRAMES (4 << BCM_FRC_BITS)
+
+// How far a component may be off, in steps (as in test_sim.c)
+#define TOLERANCE (1 + COLOR_MAX / 32)
+
+// How far a component of the ramp may be off, in steps: the dim colors are what the fraction bits are for, so every one has to round to itself
+#define RAMP_TOLERANCE 0.5
+
+// Colors drawn with (they fit in the palette with indexed colors): a ramp of grays through every step of the fraction bits, then random ones
+#define COLORS 15
+#define RAMP_COLORS 8
+
+// The ramp's row, every other row gets random colors
+#define RAMP_ROW 0
+
+static Color colors[COLORS];
+
+/**
+ * @brief	Waits for the refresh interrupt to show the frame that was drawn
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrame(void)
+{
+	PresentFrame();
+
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show FRAMES whole frames
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrames(void)
+{
+	uint8_t frame;
+
+	for(frame = 0; frame < FRAMES; ++frame)
+		ShowFrame();
+}
+
+/**
+ * @brief	Calibrates the BCM timing, as the firmware does at startup
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Calibrate(void)
+{
+	CalibrateMatrix(NULL);
+}
+
+/**
+ * @brief	Picks the color of a pixel
+ *
+ * @param	row The pixel's row
+ * @param	col The pixel's column
+ *
+ * @retval	Which of colors it is
+ */
+static uint8_t PixelColor(uint8_t row, uint8_t col)
+{
+	if(row == RAMP_ROW)
+		return col % RAMP_COLORS;
+
+	return (row * 7 + col * 3) % COLORS;
+}
+
+/**
+ * @brief	Finds how far the light of an LED is off from its color
+ * 			component, averaged over FRAMES frames
+ *
+ * @param	row The pixel's row
+ * @param	col The pixel's column
+ * @param	channel 0 for red, 1 for green, 2 for blue
+ * @param	value The color component
+ *
+ * @retval	The difference, in steps of the color component
+ */
+static double LitError(uint8_t row, uint8_t col, uint8_t channel, uint8_t value)
+{
+	// A step of the fraction bits is lit for its share of the shortest BCM cycle
+	double step = (double)BCM_BASE_TICKS * FRAMES / (1 << BCM_FRC_BITS);
+	double error = MockLitCycles(row, col, channel) / step - value;
+
+	return (error < 0) ? -error : error;
+}
+
+int main(void)
+{
+	Color color;
+	uint8_t row, col, channel, buffer, index, value[3];
+	double error, worst = 0, worst_ramp = 0, total = 0;
+	int wrong = 0;
+
+	srand(7);
+
+	for(index = 0; index < COLORS; ++index)
+	{
+		if(index < RAMP_COLORS)
+		{
+			colors[index].R = colors[index].G = colors[index].B = index;
+		}
+		else
+		{
+			colors[index].R = rand() % (COLOR_MAX + 1);
+			colors[index].G = rand() % (COLOR_MAX + 1);
+			colors[index].B = rand() % (COLOR_MAX + 1);
+		}
+
+#ifdef MATRIX_INDEXED_COLOR
+		SetPaletteColor(index + 1, colors[index].R, colors[index].G, colors[index].B);
+#endif
+	}
+
+	InitMatrixDriver();
+	TIMER0_CTL_R |= 0x1;
+
+	// Into both buffers, so every frame shows the same
+	for(buffer = 0; buffer < 2; ++buffer)
+	{
+		for(row = 0; row < MAX_ROWS; ++row)
+		{
+			for(col = 0; col < MAX_COLS; ++col)
+			{
+				index = PixelColor(row, col);
+#ifdef MATRIX_INDEXED_COLOR
+				SetColorIndex(index + 1);
+#else
+				SetColor(colors[index].R, colors[index].G, colors[index].B);
+#endif
+				DrawPixel(row, col);
+			}
+		}
+
+		MockRun(ShowFrame, SECOND);
+	}
+
+	MockRun(Calibrate, SECOND);
+
+	// Start at the start of a frame, so only whole frames (and so whole patterns) get added up
+	MockRun(ShowFrame, SECOND);
+	MockClearLit();
+	MockRun(ShowFrames, SECOND);
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			color = GetDisplayedPixel(row, col);
+			index = PixelColor(row, col);
+			wrong += (color.R != colors[index].R || color.G != colors[index].G || color.B != colors[index].B);
+			value[0] = color.R;
+			value[1] = color.G;
+			value[2] = color.B;
+
+			for(channel = 0; channel < 3; ++channel)
+			{
+				error = LitError(row, col, channel, value[channel]);
+				total += error;
+
+				if(row == RAMP_ROW && error > worst_ramp)
+					worst_ramp = error;
+
+				if(error > worst)
+					worst = error;
+			}
+		}
+	}
+
+	printf("frc_bits,color_bits,frames,worst_steps,worst_ramp_steps,mean_steps\n");
+	printf("%u,%u,%u,%.3f,%.3f,%.3f\n", BCM_FRC_BITS, COLOR_BITS, FRAMES, worst, worst_ramp, total / (MAX_ROWS * MAX_COLS * 3));
+
+	CHECK_MSG(wrong == 0, "%d pixels show the wrong color", wrong);
+	CHECK_MSG(worst <= TOLERANCE, "a pixel is %.2f steps off from its color", worst);
+	CHECK_MSG(worst_ramp <= RAMP_TOLERANCE, "a dim pixel is %.2f steps off from its color", worst_ramp);
+
+	return TestResult();
+}
@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <time.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "ghost.h"
+#include "pathfind.h"
+#include "utility.h"
+
+/**
+ * Checks the ghosts' worst case cost per game tick against
+ * GHOST_CYCLE_BUDGET, that targets the ghosts can't reach get moved to
+ * ones they can, and that a power pellet frightens them.
+ *
+ * The mock only charges time for register accesses, so the cost check
+ * counts the host's CPU time too (MockChargeHostTime()), scaled so one
+ * distance field of the built-in level takes SEARCH_SHARE of the budget.
+ * That makes four ghosts with new targets every tick (pacman keeps moving
+ * through the open room) need about twice the budget, so the check shows
+ * that MoveGhosts() stops searching when the budget runs out, on any host.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+#define GAME_TICK 20000000
+
+// Share of GHOST_CYCLE_BUDGET one distance field takes, in percent
+#define SEARCH_SHARE 40
+
+// How many game ticks the cost is measured over
+#define TICKS 300
+
+// How far over the budget a tick may go, in percent, since host timing jitters
+#define JITTER 25
+
+// The host's scheduler interrupts now and then land in a tick and add to its time,
+// so the worst tick is measured over a few runs and the lowest one is checked
+#define RUNS 10
+
+/**
+ * @brief	Reads the CPU time of this thread
+ *
+ * @param	none
+ *
+ * @retval	The time in nanoseconds
+ */
+static uint64_t CpuTime(void)
+{
+	struct timespec cpu;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+
+	return (uint64_t)cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+}
+
+/**
+ * @brief	Finds how long a distance field of the built-in level takes on the host
+ *
+ * @param	none
+ *
+ * @retval	The fastest of a few runs, in nanoseconds
+ */
+static uint64_t SearchTime(void)
+{
+	static DistanceField field;
+	uint64_t start, time, fastest = UINT64_MAX;
+	uint8_t i;
+
+	for(i = 0; i < 50; ++i)
+	{
+		start = CpuTime();
+		ComputeDistanceField(level, 1 + i % 30, 1, field);
+		time = CpuTime() - start;
+
+		if(time < fastest)
+			fastest = time;
+	}
+
+	return fastest != 0 ? fastest : 1;
+}
+
+/**
+ * @brief	Moves pacman around a loop through the open part of the level
+ *
+ * @param	tick Which tick of the loop
+ * @param	pacman Where to put pacman
+ * @param	dir Where to store pacman's direction
+ *
+ * @retval	none
+ */
+static void PacmanLoop(uint16_t tick, Character *pacman, PacmanDir *dir)
+{
+	uint8_t side = (tick / 23) % 4, step = tick % 23;
+
+	switch(side)
+	{
+		case 0:
+			pacman->row = 4;
+			pacman->col = 4 + step;
+			*dir = RIGHT;
+			break;
+		case 1:
+			pacman->row = 4 + step;
+			pacman->col = 27;
+			*dir = DOWN;
+			break;
+		case 2:
+			pacman->row = 27;
+			pacman->col = 27 - step;
+			*dir = LEFT;
+			break;
+		default:
+			pacman->row = 27 - step;
+			pacman->col = 4;
+			*dir = UP;
+			break;
+	}
+}
+
+/**
+ * @brief	Plays the ghosts against pacman going around the loop
+ *
+ * @param	none
+ *
+ * @retval	The most SYSCLK cycles MoveGhosts() took in a tick
+ */
+static uint32_t WorstTick(void)
+{
+	Character pacman = {0, 0, {0, 0, 0}};
+	PacmanDir dir;
+	uint32_t start, cycles, worst = 0;
+	uint16_t tick;
+
+	SetPathLevel(level);
+	ResetGhosts();
+
+	for(tick = 0; tick < TICKS; ++tick)
+	{
+		PacmanLoop(tick, &pacman, &dir);
+
+		start = CYCLE_COUNT();
+		MoveGhosts(pacman, dir);
+		cycles = CYCLE_COUNT() - start;
+
+		if(cycles > worst)
+			worst = cycles;
+	}
+
+	return worst;
+}
+
+int main(void)
+{
+	Character pacman = {12, 15, {0, 0, 0}};
+	uint32_t budgeted = UINT32_MAX, unbudgeted, ticks, worst;
+	uint8_t row, col, ghost, frightened = 0;
+	int dr, dc, farthest = 0;
+
+	SetGhostLevel();
+
+	// The cost of a tick, with and without the budget
+	MockChargeHostTime((uint32_t)((uint64_t)GHOST_CYCLE_BUDGET * SEARCH_SHARE / 100 * 1000 / SearchTime()));
+
+	for(ticks = 0; ticks < RUNS; ++ticks)
+	{
+		worst = WorstTick();
+
+		if(worst < budgeted)
+			budgeted = worst;
+	}
+
+	SetGhostDeterministic(1);
+	unbudgeted = WorstTick();
+	MockChargeHostTime(0);
+
+	CHECK_MSG(budgeted <= GHOST_CYCLE_BUDGET / 100 * (100 + JITTER), "worst tick took %u cycles, the budget is %u", budgeted, GHOST_CYCLE_BUDGET);
+	CHECK_MSG(unbudgeted > GHOST_CYCLE_BUDGET, "without the budget, the worst tick only took %u cycles", unbudgeted);
+
+	// Pinky aims 4 cells ahead of pacman, inside the closed off box in the middle
+	// of the level, so he has to circle the closest open cell below it instead
+	SetPathLevel(level);
+	ResetGhosts();
+
+	for(ticks = 0; ticks < 47 + 100; ++ticks)
+	{
+		MoveGhosts(pacman, DOWN);
+		GetGhostCell(1, &row, &col);
+
+		dr = row - 18;
+		dc = col - 15;
+
+		if(ticks >= 47 + 60 && dr * dr + dc * dc > farthest)
+			farthest = dr * dr + dc * dc;
+	}
+
+	CHECK_MSG(farthest <= 2, "Pinky strayed %d cells (squared) from the cell below the box", farthest);
+	SetGhostDeterministic(0);
+
+	// Pacman starts out going right along the top row, into the power pellet at its 12th column
+	BootFirmware(SECOND / 10);
+
+	for(ticks = 0; ticks < 16 && !frightened; ++ticks)
+	{
+		RunFirmware(GAME_TICK);
+
+		for(ghost = 0; ghost < GHOST_COUNT; ++ghost)
+			frightened |= IsGhostFrightened(ghost);
+	}
+
+	CHECK(frightened);
+	CHECK(ticks >= 11);
+
+	return TestResult();
+}
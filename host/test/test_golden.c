@@ -0,0 +1,352 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "capture.h"
+#include "protocol.h"
+#include "replay.h"
+
+/**
+ * Plays a few scenes of the game back to a chosen tick (see replay.h) and
+ * compares the display with the golden images in test/golden, twice: the
+ * frame captured over the UART (see capture.h), which is what the bit-planes
+ * hold, and the light that came out of the mock's panels over a few frames,
+ * which is what the refresh actually shows. Either may differ from the golden
+ * image by up to its tolerance in every component.
+ *
+ * When an image doesn't match, it's written to build/golden/<scene>.ppm (or
+ * <scene>_lit.ppm), next to a heatmap of the mismatch: pixels within the
+ * tolerance are a dim gray copy of the golden image, the others go from
+ * yellow (just over) to red (as far off as can be).
+ *
+ * The goldens are for the default display (one 32x32 panel). After a change
+ * that's meant to change what the game looks like, run make golden and
+ * look at the new images before checking them in.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// Every golden image is a binary PPM of the whole display, 8 bits per component
+typedef uint8_t Image[MAX_ROWS][MAX_COLS][3];
+
+// How far a component of the captured frame may be off (it's decoded from the same bits, so not at all)
+#define CAPTURE_TOLERANCE 0
+
+// How far a component of the light may be off: a step for rounding, plus the refresh's timing error (as in test_sim.c)
+#define LIT_TOLERANCE (((1 + COLOR_MAX / 32) * 255 + COLOR_MAX - 1) / COLOR_MAX + 1)
+
+#define GOLDEN_DIR "test/golden"
+#define OUTPUT_DIR "build/golden"
+
+// A point of the game to compare
+typedef struct Scene_t
+{
+	const char *name;
+	uint32_t ticks;			// How many ticks to play
+	const uint16_t *records;	// The steering (see replay.h), as recorded
+	uint8_t num_records;
+} Scene;
+
+// Left along the top row, down the left side, and right again, eating pellets on the way
+static const uint16_t steered_records[] =
+{
+	(LEFT << REPLAY_DIR_SHIFT) | 2,
+	(DOWN << REPLAY_DIR_SHIFT) | 10,
+	(RIGHT << REPLAY_DIR_SHIFT) | 12,
+};
+
+static const Scene scenes[] =
+{
+	{"start", 1, NULL, 0},
+	{"steered", 40, steered_records, sizeof(steered_records) / sizeof(steered_records[0])},
+	{"frightened", 14, NULL, 0},	// Right along the top row, into the power pellet (as in test_ghost.c)
+};
+
+static Image golden, captured, lit;
+
+/**
+ * @brief	Writes an image as a binary PPM file
+ *
+ * @param	path The file
+ * @param	image The image
+ *
+ * @retval	1 if it was written, 0 otherwise
+ */
+static int WritePpm(const char *path, const Image image)
+{
+	FILE *out = fopen(path, "wb");
+	int written;
+
+	if(out == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+
+	fprintf(out, "P6\n%d %d\n255\n", MAX_COLS, MAX_ROWS);
+	written = fwrite(image, sizeof(Image), 1, out) == 1;
+
+	return (fclose(out) == 0) && written;
+}
+
+/**
+ * @brief	Reads a binary PPM file of the whole display
+ *
+ * @param	path The file
+ * @param	image Where to store the image
+ *
+ * @retval	1 if it was read, 0 if it's missing or isn't the size of the display
+ */
+static int ReadPpm(const char *path, Image image)
+{
+	FILE *in = fopen(path, "rb");
+	int width, height, max, read;
+
+	if(in == NULL)
+		return 0;
+
+	// The header ends with a single whitespace character
+	read = fscanf(in, "P6 %d %d %d", &width, &height, &max) == 3 && fgetc(in) != EOF &&
+		width == MAX_COLS && height == MAX_ROWS && max == 255 &&
+		fread(image, sizeof(Image), 1, in) == 1;
+
+	fclose(in);
+
+	return read;
+}
+
+/**
+ * @brief	Compares an image with the golden image, writing it and a
+ * 			heatmap of where it differs if it's off by more than the tolerance
+ *
+ * @param	name What to call the files
+ * @param	image The image
+ * @param	tolerance How far each component may be off
+ *
+ * @retval	The number of pixels off by more than the tolerance
+ */
+static int CompareGolden(const char *name, const Image image, int tolerance)
+{
+	static Image heatmap;
+	char path[256];
+	uint8_t row, col, channel;
+	int diff, worst, wrong = 0;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			worst = 0;
+
+			for(channel = 0; channel < 3; ++channel)
+			{
+				diff = abs(image[row][col][channel] - golden[row][col][channel]);
+
+				if(diff > worst)
+					worst = diff;
+			}
+
+			if(worst > tolerance)
+			{
+				heatmap[row][col][0] = 255;
+				heatmap[row][col][1] = 255 - worst;
+				heatmap[row][col][2] = 0;
+				wrong++;
+			}
+			else
+			{
+				heatmap[row][col][0] = heatmap[row][col][1] = heatmap[row][col][2] =
+					(golden[row][col][0] + golden[row][col][1] + golden[row][col][2]) / 12;
+			}
+		}
+	}
+
+	if(wrong != 0)
+	{
+		mkdir(OUTPUT_DIR, 0777);
+		snprintf(path, sizeof(path), "%s/%s.ppm", OUTPUT_DIR, name);
+		WritePpm(path, image);
+		snprintf(path, sizeof(path), "%s/%s_heatmap.ppm", OUTPUT_DIR, name);
+		WritePpm(path, heatmap);
+		fprintf(stderr, "\t%s: %d pixels are off, see %s\n", name, wrong, path);
+	}
+
+	return wrong;
+}
+
+/**
+ * @brief	Plays a scene back and runs the firmware until the playback is over
+ *
+ * @param	scene The scene
+ *
+ * @retval	1 if the playback finished after the scene's ticks
+ */
+static int PlayScene(const Scene *scene)
+{
+	uint8_t payload[PROTOCOL_MAX_PAYLOAD], opcode, length, i;
+	uint16_t waited;
+
+	// Unpauses the game after the last scene, and clears any records
+	SendFrame(OP_REPLAY_STOP, 0, 0);
+
+	for(i = 0; i < scene->num_records; ++i)
+	{
+		payload[2 * i] = scene->records[i];
+		payload[2 * i + 1] = scene->records[i] >> 8;
+	}
+
+	if(scene->num_records != 0)
+		SendFrame(OP_REPLAY_DATA, payload, 2 * scene->num_records);
+
+	WRITE_LE32(&payload[0], 1234);
+	WRITE_LE32(&payload[4], scene->ticks);
+	SendFrame(OP_REPLAY_PLAY, payload, 8);
+
+	// A tick is a quarter of a second
+	for(waited = 0; waited < 4 * scene->ticks + 20; ++waited)
+	{
+		RunFirmware(SECOND / 4);
+
+		while(ReceiveFrame(&opcode, payload, &length))
+		{
+			if(opcode == OP_REPLAY_RESULT && length == 8)
+				return READ_LE32(payload) == scene->ticks;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Captures the displayed frame over the UART
+ *
+ * @param	none
+ *
+ * @retval	1 if the whole image came, and its hash matched
+ */
+static int Capture(void)
+{
+	uint8_t payload[PROTOCOL_MAX_PAYLOAD], file[64 + sizeof(Image)], opcode, length;
+	uint32_t hash = 2166136261UL;
+	size_t size = 0, header, i;
+	int width, height, max, end = 0;
+
+	// The capture gets cut short if the firmware stops running in the middle of it
+	SendFrame(OP_CAPTURE, 0, 0);
+	RunFirmware(SECOND / 5);
+
+	while(ReceiveFrame(&opcode, payload, &length))
+	{
+		if(opcode == OP_CAPTURE_DATA && length != 0 && size + length <= sizeof(file))
+		{
+			memcpy(&file[size], payload, length);
+			size += length;
+		}
+		else if(opcode == OP_CAPTURE_HASH && length == 4)
+		{
+			if(sscanf((char *)file, "P6 %d %d %d%n", &width, &height, &max, &end) != 3 ||
+				width != MAX_COLS || height != MAX_ROWS || max != 255)
+				return 0;
+
+			header = end + 1;
+
+			if(size != header + sizeof(Image))
+				return 0;
+
+			for(i = header; i < size; ++i)
+				hash = (hash ^ file[i]) * 16777619UL;
+
+			memcpy(captured, &file[header], sizeof(Image));
+
+			return hash == READ_LE32(payload);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Adds up the light that comes out of every LED over a quarter of
+ * 			a second, as an image with 8 bits per component
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void MeasureLight(void)
+{
+	uint64_t step, steps;
+	uint32_t isrs, frames;
+	uint8_t row, col, channel;
+
+	MockClearLit();
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER0A);
+	RunFirmware(SECOND / 4);
+	frames = (MockInterruptCount(MOCK_IRQ_TIMER0A) - isrs) / BCM_ISRS_PER_FRAME;
+
+	// A step of the fraction bits is lit for its share of the shortest BCM cycle
+	step = ((uint64_t)BCM_BASE_TICKS * frames) >> BCM_FRC_BITS;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			for(channel = 0; channel < 3; ++channel)
+			{
+				steps = (MockLitCycles(row, col, channel) + step / 2) / step;
+
+				if(steps > COLOR_MAX)
+					steps = COLOR_MAX;
+
+				lit[row][col][channel] = (uint8_t)((steps * 255 + COLOR_MAX / 2) / COLOR_MAX);
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	uint8_t baud[4];
+	char path[256], name[64];
+	int update = getenv("GOLDEN_UPDATE") != NULL;
+	uint8_t i;
+
+	BootFirmware(SECOND / 10);
+
+	// Fast enough that a capture takes a few tens of milliseconds
+	WRITE_LE32(baud, 921600);
+	SendFrame(OP_SET_BAUD, baud, sizeof(baud));
+	RunFirmware(SECOND / 10);
+
+	for(i = 0; i < sizeof(scenes) / sizeof(scenes[0]); ++i)
+	{
+		snprintf(path, sizeof(path), "%s/%s.ppm", GOLDEN_DIR, scenes[i].name);
+
+		CHECK_MSG(PlayScene(&scenes[i]), "%s: the playback didn't finish", scenes[i].name);
+		CHECK_MSG(Capture(), "%s: the capture didn't come through", scenes[i].name);
+
+		if(update)
+		{
+			CHECK_MSG(WritePpm(path, captured), "%s: couldn't write it", path);
+			printf("wrote %s\n", path);
+		}
+
+		if(!ReadPpm(path, golden))
+		{
+			CHECK_MSG(0, "%s is missing, run make golden", path);
+			continue;
+		}
+
+		MeasureLight();
+
+		snprintf(name, sizeof(name), "%s_lit", scenes[i].name);
+		CHECK(CompareGolden(scenes[i].name, captured, CAPTURE_TOLERANCE) == 0);
+		CHECK(CompareGolden(name, lit, LIT_TOLERANCE) == 0);
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "mazegraph.h"
+#include "pathfind.h"
+#include "pacman.h"
+#include "protocol.h"
+
+/**
+ * Checks that src/mazelevel.c is what host/mazegen.c makes of the built-in
+ * level (an open room, which has too many junctions for a graph), and, on
+ * a maze, that the graph's distances match a search of the cells and that
+ * the ghosts use it instead of computing distance fields.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// A maze with 44 junctions, which keeps the built-in level's closed off box, ghost starts, and pacman's start, and has a wrapping tunnel
+static GridArray maze =
+{
+	0xFFFFFFFF,
+	0x80018001,
+	0xBDFDBFBD,
+	0xBDFDBFBD,
+	0xBDFDBFBD,
+	0x80000001,
+	0xFDEFF7BF,
+	0xFDEFF7BF,
+	0xFDEFF7BF,
+	0x00000000,
+	0xFDFE7FBF,
+	0xFDFE7FBF,
+	0xFC00003F,
+	0xFDFFFFBF,
+	0xFDFFFFBF,
+	0xFD8001BF,
+	0xFDFFFFBF,
+	0xFDFFFFBF,
+	0xFDFFFFBF,
+	0xFC00003F,
+	0xFDEFF7BF,
+	0xFDEFF7BF,
+	0x80018001,
+	0xBDFDBFBD,
+	0xBDFDBFBD,
+	0xBDFDBFBD,
+	0x80000001,
+	0xBDDFFBBD,
+	0xBDDFFBBD,
+	0xBDDFFBBD,
+	0x80000001,
+	0xFFFFFFFF,
+};
+
+
+/**
+ * @brief	Counts the cells whose distance field is cached
+ *
+ * @param	none
+ *
+ * @retval	The number of cached fields
+ */
+static uint16_t CachedFields(void)
+{
+	uint16_t count = 0;
+	uint8_t row, col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+			count += IsDistanceFieldCached(row, col);
+	}
+
+	return count;
+}
+
+int main(void)
+{
+	static MazeNode nodes[MAZE_MAX_NODES];
+	static uint8_t distance[MAZE_MAX_NODES * MAZE_MAX_NODES];
+	static DistanceField field;
+	uint8_t payload[sizeof(GridArray)], pellets[sizeof(GridArray)];
+	MazeGraph graph;
+	uint8_t row, col, to_row, to_col, mismatches = 0;
+
+	// The table is up to date (run "make -C host mazelevel" if it isn't)
+	if(BuildMazeGraph(level, nodes, distance, &graph))
+	{
+		CHECK(builtin_maze_graph != 0);
+		CHECK(graph.num_nodes == builtin_maze_graph->num_nodes);
+		CHECK(memcmp(nodes, builtin_maze_graph->nodes, graph.num_nodes * sizeof(MazeNode)) == 0);
+		CHECK(memcmp(distance, builtin_maze_graph->distance, graph.num_nodes * graph.num_nodes) == 0);
+	}
+	else
+	{
+		CHECK(builtin_maze_graph == 0);
+	}
+
+	// The graph of the maze finds the same distances as a search, between every pair of open cells
+	CHECK(BuildMazeGraph(maze, nodes, distance, &graph));
+	CHECK_MSG(graph.num_nodes == 44, "the maze has %u nodes", graph.num_nodes);
+	SetMazeGraph(maze, &graph);
+
+	for(to_row = 0; to_row < MAX_ROWS; ++to_row)
+	{
+		for(to_col = 0; to_col < MAX_COLS; ++to_col)
+		{
+			if(GET_GRIDARRAY_BIT(maze, to_row, to_col) == 1)
+				continue;
+
+			ComputeDistanceField(maze, to_row, to_col, field);
+
+			for(row = 0; row < MAX_ROWS; ++row)
+			{
+				for(col = 0; col < MAX_COLS; ++col)
+				{
+					if(GET_GRIDARRAY_BIT(maze, row, col) == 1 ||
+						MazeGraphDistance(row, col, to_row, to_col) == field[row][col])
+						continue;
+
+					CHECK_MSG(mismatches++ < 8, "(%u, %u) to (%u, %u) is %u on the graph, %u by searching", row, col, to_row, to_col,
+						MazeGraphDistance(row, col, to_row, to_col), field[row][col]);
+				}
+			}
+		}
+	}
+
+	CHECK(mismatches == 0);
+
+	// The firmware loads the built-in level with the graph it has
+	BootFirmware(SECOND / 10);
+	CHECK(IsMazeGraphValid() == (builtin_maze_graph != 0));
+
+	// Upload the maze (without pellets) and hand the ghosts its graph, then they never need a distance field
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		WRITE_LE32(&payload[4 * row], maze[row]);
+		WRITE_LE32(&pellets[4 * row], 0);
+	}
+
+	SendFrame(OP_LEVEL_WALLS, payload, sizeof(payload));
+	SendFrame(OP_LEVEL_PELLETS, pellets, sizeof(pellets));
+	RunFirmware(SECOND / 2);
+	CHECK(memcmp(level, maze, sizeof(maze)) == 0);
+
+	SetMazeGraph(level, &graph);
+	SetPathLevel(level);
+	RunFirmware(20 * SECOND);
+	CHECK_MSG(CachedFields() == 0, "%u distance fields were computed", CachedFields());
+
+	// Without the graph, they do
+	SetMazeGraph(level, 0);
+	RunFirmware(20 * SECOND);
+	CHECK(CachedFields() != 0);
+
+	return TestResult();
+}
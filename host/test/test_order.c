@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+
+/**
+ * Times the BCM order the firmware was built with (BCM_ORDER, see
+ * LedMatrix.h) on the mock's panels: lights one pixel per BCM cycle (pixel
+ * (0, bcm) has only that bit set) and a white one next to them, and prints
+ * as CSV how long each was lit per frame and the longest it went dark in
+ * between, next to EmissionGap()'s model of that gap. Checks that every
+ * order still lights each cycle for its target, and that the worst-case
+ * gaps are what the model says (it's an upper bound, as it charges every
+ * slot the device's SCANOUT_CYCLES), and that the refresh interrupt runs as
+ * often as BCM_ISRS_PER_FRAME says, so BCM cycles shorter than
+ * BCM_POLL_CYCLES really get polled. The Makefile builds it once per order,
+ * and once with the shortest cycles polled.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many frames the light gets added up over
+#define FRAMES 16
+
+// How far a cycle's lit time may be off, in SYSCLK cycles (as in test_calibration.c, but split cycles lose a few per slot)
+#define LIT_TOLERANCE(target) (((target) / 256 > 8) ? (target) / 256 : 8)
+
+// How much shorter a gap may be than the model, which takes every slot to cost SCANOUT_CYCLES on top of its period (the mock charges less)
+#define GAP_TOLERANCE(model) ((model) / 8)
+
+#if BCM_ORDER == BCM_ORDER_ROW_MAJOR
+#define ORDER_NAME "row_major"
+#elif BCM_ORDER == BCM_ORDER_PLANE_MAJOR
+#define ORDER_NAME "plane_major"
+#else
+#define ORDER_NAME "split"
+#endif
+
+/**
+ * @brief	Waits for the refresh interrupt to show the frame that was drawn
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrame(void)
+{
+	PresentFrame();
+
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+}
+
+/**
+ * @brief	Waits for the refresh interrupt to show FRAMES whole frames
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ShowFrames(void)
+{
+	uint8_t frame;
+
+	for(frame = 0; frame < FRAMES; ++frame)
+		ShowFrame();
+}
+
+/**
+ * @brief	Calibrates the BCM timing, as the firmware does at startup
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Calibrate(void)
+{
+	CalibrateMatrix(NULL);
+}
+
+/**
+ * @brief	Prints a pixel's line of the CSV and checks it against the model
+ *
+ * @param	bcm The BCM cycle the pixel shows, or BCM_BITS for the white one
+ * @param	target How long it should be lit per frame
+ *
+ * @retval	none
+ */
+static void CheckPixel(uint8_t bcm, uint32_t target)
+{
+	uint32_t lit = (uint32_t)((MockLitCycles(0, bcm, 0) + FRAMES / 2) / FRAMES);
+	uint32_t gap = (uint32_t)MockLongestDark(0, bcm, 0);
+	uint32_t model = EmissionGap(bcm);
+
+	if(bcm == BCM_BITS)
+		printf("%s,all,%u,%u,%u,%u\n", ORDER_NAME, target, lit, model, gap);
+	else
+		printf("%s,%u,%u,%u,%u,%u\n", ORDER_NAME, bcm, target, lit, model, gap);
+
+	CHECK_MSG(abs((int)(lit - target)) <= LIT_TOLERANCE(target), "cycle %u is lit %u cycles per frame, not %u", bcm, lit, target);
+	CHECK_MSG(gap <= model && gap >= model - GAP_TOLERANCE(model), "cycle %u goes dark for up to %u cycles, the model says %u", bcm, gap, model);
+}
+
+int main(void)
+{
+	uint32_t isrs;
+	uint8_t bcm, buffer;
+
+	InitMatrixDriver();
+	TIMER0_CTL_R |= 0x1;
+
+	// Into both buffers, so every frame shows the same
+	for(buffer = 0; buffer < 2; ++buffer)
+	{
+		for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		{
+			SetColor(1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS), 1 << (bcm + BCM_FRC_BITS));
+			DrawPixel(0, bcm);
+		}
+
+		SetColor(COLOR_MAX, COLOR_MAX, COLOR_MAX);
+		DrawPixel(0, BCM_BITS);
+		MockRun(ShowFrame, SECOND);
+	}
+
+	MockRun(Calibrate, SECOND);
+
+	// Start at the start of a frame, so only whole frames get added up
+	MockRun(ShowFrame, SECOND);
+	MockClearLit();
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER0A);
+	MockRun(ShowFrames, SECOND);
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER0A) - isrs;
+
+	printf("order,plane,target_cycles,lit_cycles,gap_model,gap_measured\n");
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		CheckPixel(bcm, (uint32_t)BCM_BASE_TICKS << bcm);
+
+	// The dither slot is lit for a white pixel too
+	CheckPixel(BCM_BITS, BCM_LIT_CYCLES);
+
+	// The polled cycles are shown without an interrupt of their own
+	CHECK_MSG(isrs == FRAMES * BCM_ISRS_PER_FRAME, "%u refresh interrupts in %u frames, with %u polled cycles that's %u", isrs, FRAMES, BCM_POLLED_PLANES, FRAMES * BCM_ISRS_PER_FRAME);
+
+	return TestResult();
+}
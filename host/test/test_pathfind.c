@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <string.h>
+#include "harness.h"
+#include "LedMatrix.h"
+#include "pathfind.h"
+#include "pacman.h"
+
+/**
+ * Checks the bit-parallel distance fields against a plain queue based
+ * breadth first search (with the same wrap-around tunnels) on the built-in
+ * level and on random levels, and checks the cache of distance fields.
+ */
+
+// How many random levels, and how many targets on each
+#define LEVELS 20
+#define TARGETS 8
+
+static uint32_t seed = 1;
+
+/**
+ * @brief	Makes a random number
+ *
+ * @param	range How many numbers there are to pick from
+ *
+ * @retval	A number from 0 to range - 1
+ */
+static uint32_t Random(uint32_t range)
+{
+	seed = seed * 1103515245 + 12345;
+
+	return (seed >> 16) % range;
+}
+
+/**
+ * @brief	Fills in a distance field one cell at a time, with a queue
+ *
+ * @param	walls The walls of the level
+ * @param	row The row of the target cell
+ * @param	col The column of the target cell
+ * @param	field Where to store the distances
+ *
+ * @retval	none
+ */
+static void QueueDistanceField(GridArray walls, uint8_t row, uint8_t col, DistanceField field)
+{
+	static uint16_t queue[MAX_ROWS * MAX_COLS];
+	static const int8_t moves[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+	uint16_t head = 0, tail = 0, dist;
+	uint8_t r, c, next_r, next_c, i;
+
+	memset(field, PATH_UNREACHABLE, sizeof(DistanceField));
+	field[row][col] = 0;
+	queue[tail++] = row * MAX_COLS + col;
+
+	while(head != tail)
+	{
+		r = queue[head] / MAX_COLS;
+		c = queue[head] % MAX_COLS;
+		head++;
+		dist = field[r][c] + 1;
+
+		for(i = 0; i < 4; ++i)
+		{
+			next_r = (r + MAX_ROWS + moves[i][0]) % MAX_ROWS;
+			next_c = (c + MAX_COLS + moves[i][1]) % MAX_COLS;
+
+			if(GET_GRIDARRAY_BIT(walls, next_r, next_c) || field[next_r][next_c] != PATH_UNREACHABLE)
+				continue;
+
+			// Same cap on long distances as ComputeDistanceField()
+			field[next_r][next_c] = (dist < PATH_UNREACHABLE - 1) ? dist : PATH_UNREACHABLE - 1;
+			queue[tail++] = next_r * MAX_COLS + next_c;
+		}
+	}
+}
+
+/**
+ * @brief	Checks the distance field of a target against the queue based search
+ *
+ * @param	walls The walls of the level
+ * @param	row The row of the target cell
+ * @param	col The column of the target cell
+ *
+ * @retval	none
+ */
+static void CheckTarget(GridArray walls, uint8_t row, uint8_t col)
+{
+	static DistanceField expected, field;
+
+	QueueDistanceField(walls, row, col, expected);
+	ComputeDistanceField(walls, row, col, field);
+
+	CHECK_MSG(memcmp(expected, field, sizeof(field)) == 0, "target %u,%u", row, col);
+}
+
+int main(void)
+{
+	static GridArray walls;
+	const DistanceField *field;
+	uint8_t row, col, i, target;
+
+	// The built-in level, from every open cell of its first row and a wall
+	for(col = 1; col < 31; ++col)
+		CheckTarget(level, 1, col);
+
+	CheckTarget(level, 0, 0);
+
+	// Random levels, some open enough to wrap around, some cut into pieces
+	for(i = 0; i < LEVELS; ++i)
+	{
+		for(row = 0; row < MAX_ROWS; ++row)
+		{
+			walls[row] = 0;
+
+			for(col = 0; col < MAX_COLS; ++col)
+				if(Random(100) < 10 + i * 2u)
+					SET_GRIDARRAY_BIT(walls, row, col);
+		}
+
+		for(target = 0; target < TARGETS; ++target)
+			CheckTarget(walls, Random(MAX_ROWS), Random(MAX_COLS));
+	}
+
+	// A field stays cached until PATH_CACHE_SIZE other targets were asked for since it was last used
+	SetPathLevel(level);
+	CHECK(!IsDistanceFieldCached(1, 1));
+
+	field = GetDistanceField(1, 1);
+	CHECK(IsDistanceFieldCached(1, 1));
+	CHECK(GetDistanceField(1, 1) == field);
+	CHECK(PathDistance(1, 2, 1, 1) == 1);
+
+	for(i = 0; i < PATH_CACHE_SIZE - 1; ++i)
+		GetDistanceField(2, 1 + i);
+
+	CHECK(IsDistanceFieldCached(1, 1));
+
+	GetDistanceField(3, 1);
+	CHECK(!IsDistanceFieldCached(1, 1));
+
+	// Changing the level throws every field away
+	GetDistanceField(1, 1);
+	SetPathLevel(level);
+	CHECK(!IsDistanceFieldCached(1, 1));
+
+	return TestResult();
+}
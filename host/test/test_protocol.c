@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "protocol.h"
+
+/**
+ * Feeds the protocol parser garbage followed by good frames over the mock's
+ * UART: a stray SYNC with a corrupt length in front of ASCII input and a
+ * frame, a frame with a bad CRC that swallows the start of the next one, and
+ * random bytes. Checks that the good frames and the ASCII bytes after the
+ * garbage all still get handled, in order, and that the garbage is counted
+ * as dropped frames. The firmware's handlers are swapped for ones that only
+ * record what they get, so nothing the garbage happens to decode as runs.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// An opcode nothing else uses
+#define OP_TEST 0x0F
+
+// How many random bytes come before the last frame
+#define GARBAGE 600
+
+// What the handlers got
+static uint8_t frames, frame_payload[PROTOCOL_MAX_PAYLOAD], frame_length;
+static uint8_t ascii[64], ascii_length;
+
+/**
+ * @brief	Handles OP_TEST, keeps its payload
+ *
+ * @param	data The payload
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void TestCommand(const uint8_t *data, uint8_t length)
+{
+	frames++;
+	memcpy(frame_payload, data, length);
+	frame_length = length;
+}
+
+/**
+ * @brief	Keeps the bytes received outside of a frame
+ *
+ * @param	data The byte
+ *
+ * @retval	none
+ */
+static void TestAscii(uint8_t data)
+{
+	if(ascii_length < sizeof(ascii))
+		ascii[ascii_length++] = data;
+}
+
+/**
+ * @brief	Forgets what the handlers got
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ClearReceived(void)
+{
+	frames = 0;
+	frame_length = 0;
+	ascii_length = 0;
+}
+
+int main(void)
+{
+	static const uint8_t stray[] = {PROTOCOL_SYNC, 'w', 'a', 's', 'd'};
+	static const uint8_t bad_crc[] = {PROTOCOL_SYNC, OP_TEST, 2};
+	uint8_t garbage[GARBAGE];
+	uint32_t errors;
+	uint16_t i;
+	uint8_t opcode;
+
+	BootFirmware(SECOND / 10);
+
+	for(opcode = 0; opcode < PROTOCOL_MAX_OPCODES; ++opcode)
+		ProtocolRegister(opcode, 0);
+
+	ProtocolRegister(OP_TEST, TestCommand);
+	ProtocolSetAsciiHandler(TestAscii);
+
+	// A good frame on its own
+	SendFrame(OP_TEST, (const uint8_t *)"ok", 2);
+	RunFirmware(SECOND / 2);
+	CHECK(frames == 1 && frame_length == 2 && memcmp(frame_payload, "ok", 2) == 0);
+	CHECK(ProtocolErrors() == 0);
+
+	// A stray SYNC takes "wa" as its opcode and length, so it waits for 97 bytes that never come
+	ClearReceived();
+	errors = ProtocolErrors();
+	MockUARTReceive(stray, sizeof(stray));
+	SendFrame(OP_TEST, (const uint8_t *)"frame", 5);
+	RunFirmware(SECOND);
+	CHECK_MSG(ascii_length == 4 && memcmp(ascii, "wasd", 4) == 0, "got %u ASCII bytes after a stray SYNC", ascii_length);
+	CHECK_MSG(frames == 1 && frame_length == 5 && memcmp(frame_payload, "frame", 5) == 0, "got %u frames after a stray SYNC", frames);
+	CHECK(ProtocolErrors() == errors + 1);
+
+	// Keys typed after a stray SYNC at the end of the input get through once it times out
+	ClearReceived();
+	MockUARTReceive(stray, 1);
+	RunFirmware(SECOND / 2);
+	MockUARTReceive(&stray[1], sizeof(stray) - 1);
+	RunFirmware(SECOND / 2);
+	CHECK_MSG(ascii_length == 4 && memcmp(ascii, "wasd", 4) == 0, "got %u ASCII bytes typed after a stray SYNC", ascii_length);
+
+	// A frame with a bad CRC takes the next frame's SYNC and opcode as its payload, and its length as the CRC
+	ClearReceived();
+	errors = ProtocolErrors();
+	MockUARTReceive(bad_crc, sizeof(bad_crc));
+	SendFrame(OP_TEST, (const uint8_t *)"abc", 3);
+	RunFirmware(SECOND / 2);
+	CHECK_MSG(frames == 1 && frame_length == 3 && memcmp(frame_payload, "abc", 3) == 0, "got %u frames after a bad CRC", frames);
+	CHECK(ProtocolErrors() == errors + 1);
+
+	// Random bytes, with plenty of SYNCs in them, right before a frame
+	ClearReceived();
+	errors = ProtocolErrors();
+	srand(3);
+
+	for(i = 0; i < GARBAGE; ++i)
+		garbage[i] = (rand() % 8 == 0) ? PROTOCOL_SYNC : (uint8_t)rand();
+
+	MockUARTReceive(garbage, GARBAGE);
+	SendFrame(OP_TEST, (const uint8_t *)"last", 4);
+	RunFirmware(2 * SECOND);
+	CHECK_MSG(frame_length == 4 && memcmp(frame_payload, "last", 4) == 0, "the frame after %u random bytes was lost", GARBAGE);
+	CHECK(ProtocolErrors() > errors);
+
+	return TestResult();
+}
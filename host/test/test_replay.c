@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "protocol.h"
+#include "replay.h"
+#include "utility.h"
+
+/**
+ * Records a game steered by random input over the UART, plays the records
+ * back (with more random input, which has to be ignored), and checks that
+ * both end in the same state. The recording ends with a turn that arrives
+ * after the last tick but before OP_REPLAY_STOP, which no tick applied and
+ * so must not count as part of the game. Asking for the benchmarks during
+ * the playback only gets a line saying they were skipped.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+#define GAME_TICK 20000000
+
+// How many game ticks get recorded
+#define TICKS 80
+
+static uint8_t records[2 * REPLAY_BUFFER_SIZE];
+static uint16_t records_length;
+static uint32_t result_ticks, result_hash;
+static uint8_t got_result;
+static uint8_t steered = RIGHT;	// The direction pacman was last steered in (RIGHT after a reset)
+
+/**
+ * @brief	Takes every frame the firmware sent, keeping the records and the result
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Collect(void)
+{
+	uint8_t payload[PROTOCOL_MAX_PAYLOAD], opcode, length;
+
+	while(ReceiveFrame(&opcode, payload, &length))
+	{
+		if(opcode == OP_REPLAY_DATA && records_length + length <= sizeof(records))
+		{
+			memcpy(&records[records_length], payload, length);
+			records_length += length;
+		}
+		else if(opcode == OP_REPLAY_RESULT && length == 8)
+		{
+			result_ticks = READ_LE32(&payload[0]);
+			result_hash = READ_LE32(&payload[4]);
+			got_result = 1;
+		}
+	}
+}
+
+/**
+ * @brief	Runs the firmware until just after the next game tick
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void NextTick(void)
+{
+	uint32_t ticks = MockInterruptCount(MOCK_IRQ_TIMER1A);
+
+	while(MockInterruptCount(MOCK_IRQ_TIMER1A) == ticks)
+		RunFirmware(SECOND / 1000);
+
+	RunFirmware(SECOND / 100);
+}
+
+/**
+ * @brief	Steers pacman in a random direction now and then
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void RandomInput(void)
+{
+	uint8_t dir = LEFT + rand() % 4;
+
+	if(rand() % 4 == 0)
+	{
+		SendFrame(OP_INPUT, &dir, 1);
+		steered = dir;
+	}
+}
+
+int main(void)
+{
+	uint8_t payload[8], text[256], dir;
+	uint32_t recorded_ticks, recorded_hash, ticks;
+	uint16_t i, part;
+
+	srand(3);
+	BootFirmware(SECOND / 10);
+
+	// Record
+	WRITE_LE32(&payload[0], 0xC0FFEE);
+	SendFrame(OP_REPLAY_RECORD, payload, 4);
+
+	for(i = 0; i < TICKS; ++i)
+	{
+		NextTick();
+		RandomInput();
+
+		// Exporting in the middle of a recording is fine
+		if(i == TICKS / 2)
+			SendFrame(OP_REPLAY_EXPORT, 0, 0);
+
+		Collect();
+	}
+
+	NextTick();
+
+	// A turn after the last tick, then the end of the recording, before the next tick
+	ticks = MockInterruptCount(MOCK_IRQ_TIMER1A);
+	dir = (steered == UP) ? DOWN : UP;
+	SendFrame(OP_INPUT, &dir, 1);
+	SendFrame(OP_REPLAY_STOP, 0, 0);
+	SendFrame(OP_REPLAY_EXPORT, 0, 0);
+	RunFirmware(SECOND / 50);
+	CHECK(MockInterruptCount(MOCK_IRQ_TIMER1A) == ticks);
+
+	RunFirmware(SECOND / 2);
+	Collect();
+
+	CHECK(got_result && result_ticks == TICKS + 1);
+	CHECK_MSG(records_length >= 2 * 8 && records_length % 2 == 0, "%u bytes of records", records_length);
+
+	recorded_ticks = result_ticks;
+	recorded_hash = result_hash;
+	got_result = 0;
+
+	// Play back, while the live input keeps coming
+	for(i = 0; i < records_length; i += part)
+	{
+		part = (records_length - i < PROTOCOL_MAX_PAYLOAD - 1) ? records_length - i : PROTOCOL_MAX_PAYLOAD - 1;
+		SendFrame(OP_REPLAY_DATA, &records[i], part);
+	}
+
+	WRITE_LE32(&payload[0], 0xC0FFEE);
+	WRITE_LE32(&payload[4], recorded_ticks);
+	SendFrame(OP_REPLAY_PLAY, payload, 8);
+
+	for(i = 0; i < TICKS + 10 && !got_result; ++i)
+	{
+		NextTick();
+		RandomInput();
+
+		// The benchmarks run extra game ticks, so they have to refuse to run
+		if(i == TICKS / 2)
+		{
+			SendFrame(OP_BENCHMARK, 0, 0);
+			RunFirmware(SECOND / 5);
+			text[MockUARTTake(text, sizeof(text) - 1)] = 0;
+			CHECK_MSG(strstr((char *)text, "skipped") && !strstr((char *)text, "min_cycles"), "got \"%s\"", text);
+		}
+
+		Collect();
+	}
+
+	CHECK(got_result);
+	CHECK(result_ticks == recorded_ticks);
+	CHECK_MSG(result_hash == recorded_hash, "the playback ended in state %08x, the recording in %08x", result_hash, recorded_hash);
+
+	SendFrame(OP_REPLAY_STOP, 0, 0);
+	RunFirmware(SECOND / 20);
+
+	return TestResult();
+}
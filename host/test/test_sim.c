@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "pacman.h"
+
+/**
+ * Boots the firmware on the peripheral mock and checks that the interrupts
+ * run at the rates the firmware sets up, and that the light coming out of
+ * the panel is the level the firmware drew.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// The color of the walls (wall_color in pacman.c)
+static const uint8_t wall[3] = {0, COLOR_MAX, COLOR_MAX};
+
+/**
+ * @brief	Finds how far the light of an LED is off from its color component
+ *
+ * @param	lit How long the LED was lit
+ * @param	frames How many frames it was lit over
+ * @param	value The color component
+ *
+ * @retval	The difference, in steps of the color component
+ */
+static int LitError(uint64_t lit, uint32_t frames, uint8_t value)
+{
+	// A step of the fraction bits is lit for its share of the shortest BCM cycle
+	uint64_t step = ((uint64_t)BCM_BASE_TICKS * frames) >> BCM_FRC_BITS;
+
+	return abs((int)((lit + step / 2) / step) - value);
+}
+
+int main(void)
+{
+	uint32_t isrs, frames;
+	uint8_t row, col, channel;
+	int worst = 0, error;
+
+	BootFirmware(SECOND / 2);
+
+	// Game ticks every 20000000 cycles, and the refresh interrupt at its modeled rate (within the model's accuracy)
+	CHECK(MockInterruptCount(MOCK_IRQ_TIMER1A) >= 1);
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER0A);
+	CHECK_MSG(isrs > BCM_ISR_RATE_HZ / 2 * 8 / 10 && isrs < BCM_ISR_RATE_HZ / 2 * 12 / 10, "%u refresh interrupts in 0.5 s, the model says %u", isrs, (uint32_t)BCM_ISR_RATE_HZ / 2);
+
+	// Every LED of a wall has to be lit for its color component's share of every frame
+	MockClearLit();
+	isrs = MockInterruptCount(MOCK_IRQ_TIMER0A);
+	RunFirmware(SECOND / 2);
+	frames = (MockInterruptCount(MOCK_IRQ_TIMER0A) - isrs) / BCM_ISRS_PER_FRAME;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			if(!GET_GRIDARRAY_BIT(level, row, col))
+				continue;
+
+			for(channel = 0; channel < 3; ++channel)
+			{
+				error = LitError(MockLitCycles(row, col, channel), frames, wall[channel]);
+
+				if(error > worst)
+					worst = error;
+			}
+		}
+	}
+
+	CHECK(frames > 0);
+	CHECK_MSG(worst <= 1 + COLOR_MAX / 32, "a wall pixel is %d steps off from its color", worst);
+
+	return TestResult();
+}
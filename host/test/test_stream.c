@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "stream.h"
+#include "protocol.h"
+#include "UART.h"
+#include "streamenc.h"
+
+/**
+ * Streams frames encoded by host/streamenc.c to the firmware and checks
+ * that the display shows them, also when they come back to back (so a frame
+ * begins before the last one is on the display, and has to wait for it
+ * outside of its command handler), and that skip tokens running
+ * past the end of a frame can't wrap around into it.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many random frames get streamed
+#define ROUNDS 12
+
+static const uint8_t palette[STREAM_PALETTE_SIZE][3] =
+{
+	{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 255, 0},
+	{0, 0, 255}, {255, 255, 0}, {0, 255, 255}, {255, 0, 255},
+	{128, 0, 0}, {0, 128, 0}, {0, 0, 128}, {128, 128, 0},
+	{0, 128, 128}, {128, 0, 128}, {64, 64, 64}, {192, 192, 192},
+};
+
+static StreamImage prev, next;
+static uint8_t tokens[STREAM_MAX_TOKENS];
+
+/**
+ * @brief	Runs the firmware until everything sent was received and the frame is on the display
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Drain(void)
+{
+	while(MockUARTPending() != 0)
+		RunFirmware(SECOND / 100);
+
+	RunFirmware(SECOND / 20);
+}
+
+/**
+ * @brief	Counts the pixels on the display that don't match a frame
+ *
+ * @param	image The frame
+ *
+ * @retval	The number of pixels that differ
+ */
+static int WrongPixels(const StreamImage image)
+{
+	Color color;
+	uint8_t row, col;
+	int wrong = 0;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			color = GetDisplayedPixel(row, col);
+
+			wrong += (color.R != image[row][col][0] >> (8 - COLOR_BITS) ||
+				color.G != image[row][col][1] >> (8 - COLOR_BITS) ||
+				color.B != image[row][col][2] >> (8 - COLOR_BITS));
+		}
+	}
+
+	return wrong;
+}
+
+/**
+ * @brief	Changes some runs of pixels of the next frame, to palette or random colors
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void ChangeRuns(void)
+{
+	uint8_t *pixels = &next[0][0][0], color[3];
+	uint16_t start, length, i;
+	uint8_t runs = 1 + rand() % 24;
+
+	while(runs--)
+	{
+		start = rand() % (MAX_ROWS * MAX_COLS);
+		length = 1 + rand() % 100;
+
+		if(rand() % 2)
+			memcpy(color, palette[rand() % STREAM_PALETTE_SIZE], 3);
+		else
+			color[0] = rand(), color[1] = rand(), color[2] = rand();
+
+		for(i = start; i < start + length && i < MAX_ROWS * MAX_COLS; ++i)
+			memcpy(&pixels[3 * i], color, 3);
+	}
+}
+
+int main(void)
+{
+	uint8_t *pixels = &next[0][0][0], on = 1, waited = 0;
+	uint16_t i, round;
+	size_t length;
+
+	srand(7);
+	BootFirmware(SECOND / 10);
+	SendFrame(OP_STREAM_MODE, &on, 1);
+	StreamSendPalette(palette, STREAM_PALETTE_SIZE, SendFrame);
+
+	// The first frame sets every pixel (encoded against a frame where every pixel differs)
+	for(i = 0; i < MAX_ROWS * MAX_COLS * 3; ++i)
+		pixels[i] = rand();
+
+	for(i = 0; i < MAX_ROWS * MAX_COLS * 3; ++i)
+		(&prev[0][0][0])[i] = ~pixels[i];
+
+	for(round = 0; round < ROUNDS; ++round)
+	{
+		length = StreamEncode(prev, next, palette, STREAM_PALETTE_SIZE, tokens);
+		StreamSend(tokens, length, SendFrame);
+		Drain();
+
+		CHECK_MSG(WrongPixels(next) == 0, "round %u: %d pixels are wrong", round, WrongPixels(next));
+
+		memcpy(prev, next, sizeof(prev));
+		ChangeRuns();
+	}
+
+	CHECK(UARTRxOverflows() == 0);
+
+	// Frames back to back, each one begins while the last one still waits to be displayed
+	for(round = 0; round < ROUNDS; ++round)
+	{
+		memcpy(prev, next, sizeof(prev));
+		ChangeRuns();
+		length = StreamEncode(prev, next, palette, STREAM_PALETTE_SIZE, tokens);
+		StreamSend(tokens, length, SendFrame);
+	}
+
+	// The firmware gets back to its scheduler while a frame waits
+	while(MockUARTPending() != 0)
+	{
+		RunFirmware(SECOND / 1000);
+		waited |= IsStreamWaiting();
+	}
+
+	Drain();
+
+	CHECK_MSG(waited, "no frame had to wait for the last one");
+	CHECK_MSG(WrongPixels(next) == 0, "%d pixels are wrong after frames back to back", WrongPixels(next));
+	CHECK(UARTRxOverflows() == 0);
+	memcpy(prev, next, sizeof(prev));
+
+	// Skipping 65536 pixels (where a 16 bit cursor would wrap back to the first pixel) draws nothing
+	SendFrame(OP_STREAM_BEGIN, 0, 0);
+	memset(tokens, 0x7F, 0x10000 / 0x80);
+
+	for(i = 0; i < 0x10000 / 0x80; i += length)
+	{
+		length = (0x10000 / 0x80 - i < PROTOCOL_MAX_PAYLOAD) ? 0x10000 / 0x80 - i : PROTOCOL_MAX_PAYLOAD;
+		SendFrame(OP_STREAM_DATA, &tokens[i], length);
+	}
+
+	tokens[0] = 0xC0 | 0x3F;
+	tokens[1] = 1;
+	SendFrame(OP_STREAM_DATA, tokens, 2);
+	SendFrame(OP_STREAM_END, 0, 0);
+	Drain();
+
+	CHECK_MSG(WrongPixels(prev) == 0, "%d pixels got drawn after skipping past the end", WrongPixels(prev));
+
+	return TestResult();
+}
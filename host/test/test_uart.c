@@ -0,0 +1,177 @@
+#include <stdint.h>
+#include <string.h>
+#include "harness.h"
+#include "mock.h"
+#include "UART.h"
+#include "profiler.h"
+
+/**
+ * Sends profiler reports, more of them than fit in the transmit buffer,
+ * with interrupts masked. UART4Int() can't run then, so UARTTransmit() has to
+ * move the bytes into the transmit FIFO itself, and ProfilerReport() has
+ * to leave the interrupts masked the way it found them.
+ *
+ * Then receives bursts of back to back bytes at every baud rate up to
+ * MAX_BAUD_RATE while the main loop is busy (and the refresh and game
+ * interrupts keep coming), and checks that the receive buffer gets every
+ * byte, in order, without overflowing. Many bursts in a row take the ring
+ * buffer's indexes around the buffer and past their own wrap-around, and
+ * a burst too big for the buffer counts exactly the bytes that didn't fit.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many reports get sent
+#define REPORTS 4
+
+// PRIMASK after the report
+static uint32_t primask_after;
+
+// Baud rates the bursts are received at
+static const uint32_t bauds[] = {9600, 115200, 460800, MAX_BAUD_RATE};
+
+// How many bursts wrap the ring buffer's 16 bit indexes around
+#define BURSTS (65536 / (UART_RX_BUFFER_SIZE * 3 / 4) + 2)
+
+// The baud rate to set, how long to keep the main loop busy, and what was read
+static uint32_t baud;
+static uint32_t busy_cycles;
+static uint8_t received[2 * UART_RX_BUFFER_SIZE];
+static uint16_t received_length;
+
+/**
+ * @brief	Sends the profiler report a few times with interrupts masked
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void MaskedReport(void)
+{
+	uint8_t i;
+
+	MockSetPrimask(1);
+
+	for(i = 0; i < REPORTS; ++i)
+		ProfilerReport();
+
+	primask_after = MockSetPrimask(0);
+}
+
+/**
+ * @brief	Sets the baud rate to baud
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void SetBaud(void)
+{
+	UARTSetBaudRate(baud);
+}
+
+/**
+ * @brief	Keeps the main loop busy for busy_cycles, without reading the
+ * 			receive buffer, then reads everything in it
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void BusyThenRead(void)
+{
+	uint32_t start = CYCLE_COUNT();
+	uint16_t length;
+
+	while(CYCLE_COUNT() - start < busy_cycles);
+
+	received_length = 0;
+
+	do
+	{
+		length = UARTRead(&received[received_length], sizeof(received) - received_length);
+		received_length += length;
+	} while(length != 0);
+}
+
+/**
+ * @brief	Receives a burst of bytes while the main loop is busy
+ *
+ * @param	length How many bytes
+ * @param	seed Where the bytes' pattern starts
+ *
+ * @retval	How many of the bytes read back are missing or out of order
+ */
+static uint16_t ReceiveBurst(uint16_t length, uint32_t seed)
+{
+	static uint8_t burst[2 * UART_RX_BUFFER_SIZE];
+	uint16_t i, wrong = 0;
+
+	for(i = 0; i < length; ++i)
+		burst[i] = (uint8_t)((seed + i) * 167 >> 3);
+
+	MockUARTReceive(burst, length);
+
+	// Every byte takes 10 bits, and a bit more for the receive timeout to pass the last ones on
+	busy_cycles = (uint32_t)((uint64_t)SYSCLK * 10 * (length + 64) / baud);
+	MockRun(BusyThenRead, 2 * (uint64_t)busy_cycles + SYSCLK / 10);
+
+	for(i = 0; i < length && i < received_length; ++i)
+		wrong += (received[i] != burst[i]);
+
+	return wrong + ((length > received_length) ? length - received_length : 0);
+}
+
+int main(void)
+{
+	uint32_t overflows;
+	uint16_t burst, wrong;
+	uint8_t i;
+	static uint8_t report[4096];
+	size_t length;
+
+	BootFirmware(SECOND / 10);
+	MockUARTTake(report, sizeof(report));
+
+	CHECK(MockRun(MaskedReport, SECOND) == MOCK_RETURNED);
+	CHECK(primask_after == 1);
+
+	// Let the rest of the reports go out (at 9600 baud by default)
+	RunFirmware(2 * SECOND);
+	length = MockUARTTake(report, sizeof(report) - 1);
+	report[length] = '\0';
+
+	CHECK_MSG(length > UART_TX_BUFFER_SIZE, "the reports are only %zu bytes", length);
+	CHECK(memcmp(report, "bcm bits=", 9) == 0);
+	CHECK(strstr((char *)report + 1, "bcm bits=") != NULL);
+	CHECK(strstr((char *)report, "MoveGhosts n=") != NULL);
+	CHECK(length >= 2 && memcmp(&report[length - 2], "\r\n", 2) == 0);
+
+	// A burst that nearly fills the receive buffer, at every baud rate
+	for(i = 0; i < sizeof(bauds) / sizeof(bauds[0]); ++i)
+	{
+		baud = bauds[i];
+		MockRun(SetBaud, SECOND);
+
+		wrong = ReceiveBurst(UART_RX_BUFFER_SIZE - 1, i);
+		CHECK_MSG(wrong == 0 && received_length == UART_RX_BUFFER_SIZE - 1, "at %u baud, %u of %u bytes were lost or out of order (%u read)",
+			baud, wrong, UART_RX_BUFFER_SIZE - 1, received_length);
+	}
+
+	CHECK_MSG(UARTRxOverflows() == 0, "%u bytes overflowed", UARTRxOverflows());
+
+	// Bursts of three quarters of the buffer, until the indexes wrap around (at the fastest rate)
+	for(burst = 0, wrong = 0; burst < BURSTS; ++burst)
+		wrong += ReceiveBurst(UART_RX_BUFFER_SIZE * 3 / 4, burst * 31);
+
+	CHECK_MSG(wrong == 0, "%u bytes were lost or out of order over %u bursts", wrong, BURSTS);
+	CHECK(UARTRxOverflows() == 0);
+
+	// A burst bigger than the buffer keeps its start and counts the rest as overflows
+	wrong = ReceiveBurst(UART_RX_BUFFER_SIZE + 100, 0);
+	overflows = UARTRxOverflows();
+	CHECK_MSG(received_length == UART_RX_BUFFER_SIZE && overflows == 100, "%u bytes read, %u overflowed", received_length, overflows);
+	CHECK(wrong == 100);
+
+	return TestResult();
+}
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "harness.h"
+#include "mock.h"
+#include "LedMatrix.h"
+#include "pacman.h"
+#include "protocol.h"
+
+/**
+ * Plays the built-in 32x32 level on a display of 2x2 panels, with random
+ * steering, and checks after every game tick that nothing but walls shows
+ * up outside of the level: pacman and the ghosts (which scatter towards
+ * the corners of the whole display) have to stay inside of it.
+ */
+
+#define SECOND ((uint64_t)SYSCLK)
+
+// How many game ticks get played
+#define TICKS 60
+
+// Size of the built-in level
+#define LEVEL_ROWS 32
+#define LEVEL_COLS 32
+
+/**
+ * @brief	Counts the pixels outside of the level that aren't a wall
+ *
+ * @param	wall The color of the walls
+ *
+ * @retval	The number of pixels
+ */
+static int PixelsOutside(Color wall)
+{
+	Color color;
+	uint8_t row, col;
+	int outside = 0;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			if(row < LEVEL_ROWS && col < LEVEL_COLS)
+				continue;
+
+			color = GetDisplayedPixel(row, col);
+			outside += (color.R != wall.R || color.G != wall.G || color.B != wall.B);
+		}
+	}
+
+	return outside;
+}
+
+int main(void)
+{
+	uint32_t ticks;
+	uint16_t i;
+	uint8_t dir;
+	int outside, worst = 0, worst_tick = 0;
+	Color wall;
+
+	srand(5);
+	BootFirmware(SECOND / 2);
+
+	// The top left corner of the level is a wall, and so is the bottom right one of the display
+	wall = GetDisplayedPixel(0, 0);
+	CHECK(GET_GRIDARRAY_BIT(level, MAX_ROWS - 1, (MAX_COLS - 1)));
+
+	for(i = 0; i < TICKS; ++i)
+	{
+		ticks = MockInterruptCount(MOCK_IRQ_TIMER1A);
+
+		while(MockInterruptCount(MOCK_IRQ_TIMER1A) == ticks)
+			RunFirmware(SECOND / 100);
+
+		// Let the tick's frame get displayed
+		RunFirmware(SECOND / 20);
+
+		outside = PixelsOutside(wall);
+
+		if(outside > worst)
+		{
+			worst = outside;
+			worst_tick = i;
+		}
+
+		if(rand() % 4 == 0)
+		{
+			dir = LEFT + rand() % 4;
+			SendFrame(OP_INPUT, &dir, 1);
+		}
+	}
+
+	CHECK_MSG(worst == 0, "tick %d: %d pixels outside of the level aren't walls", worst_tick, worst);
+
+	return TestResult();
+}
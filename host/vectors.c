@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include "mock.h"
+
+// The interrupt handlers of the firmware, hooked up like in tm4c123gh6pm_startup_ccs.c
+extern void Timer0AInt(void);
+extern void Timer1Int(void);
+extern void Timer2AInt(void);
+extern void UART4Int(void);
+
+const MockVector mock_vectors[] =
+{
+	{MOCK_IRQ_TIMER0A, Timer0AInt},
+	{MOCK_IRQ_TIMER1A, Timer1Int},
+	{MOCK_IRQ_TIMER2A, Timer2AInt},
+	{MOCK_IRQ_UART4, UART4Int},
+	{0, 0}
+};
@@ -2,6 +2,7 @@
 #define LEDMATRIX_H
 
 #include "inc/tm4c123gh6pm.h"
+#include "utility.h"
 
 /**
  * GPIO MAP:
@@ -20,9 +21,208 @@
  * OE = PB6
  */
 
+// Size of one panel
+#define PANEL_ROWS 32
+#define PANEL_COLS 32
+
+/**
+ * Number of panels across and down. All of the panels are daisy-chained on
+ * the same connector: panel 0 (wired to the board) is at the top left, the
+ * chain continues to the right, then along the next row of panels, and every
+ * panel is upright. The first data clocked out ends up in the last panel.
+ */
+#ifndef PANELS_X
+#define PANELS_X 1
+#endif
+#ifndef PANELS_Y
+#define PANELS_Y 1
+#endif
+
+// A GridArray row holds a whole row of the display, so at most 64 columns. Past 4 panels,
+// everything that grows with the display (the frame buffers, the pathfinding cache, the
+// layers, the level grids) no longer fits in the 32KB of RAM, even with MATRIX_INDEXED_COLOR.
+#if PANELS_X < 1 || PANELS_X > 2 || PANELS_Y < 1 || PANELS_Y > 4 || PANELS_X * PANELS_Y > 4
+#error "PANELS_X must be 1 or 2, and PANELS_Y between 1 and 4, for at most 4 panels"
+#endif
+
 // Max row and cols
-#define MAX_ROWS 32
-#define MAX_COLS 32
+#define MAX_ROWS (PANEL_ROWS * PANELS_Y)
+#define MAX_COLS (PANEL_COLS * PANELS_X)
+
+// Every panel lights two rows at a time (row n and row n + SCAN_ROWS), and all panels scan in parallel
+#define SCAN_ROWS (PANEL_ROWS / 2)
+#define CHAIN_PANELS (PANELS_X * PANELS_Y)
+#define CHAIN_COLS (PANEL_COLS * CHAIN_PANELS)	// Columns clocked out for every pair of rows
+
+// Bits of color per channel, each bit gets its own binary coded modulation (BCM) cycle.
+// Every extra bit doubles the length of a frame, so this trades color depth for refresh rate.
+#ifndef BCM_BITS
+#define BCM_BITS 7
+#endif
+
+// Length of the shortest BCM cycle in SYSCLK cycles (every following cycle is twice as long)
+#ifndef BCM_BASE_TICKS
+#define BCM_BASE_TICKS 240
+#endif
+
+#if BCM_BITS < 3 || BCM_BITS > 8
+#error "BCM_BITS must be between 3 and 8"
+#endif
+
+/**
+ * Extra bits of color per channel shown with frame rate control (FRC), 0 to 3.
+ * These fraction bits don't get BCM cycles of their own: every frame has one
+ * extra BCM_BASE_TICKS long slot (the dither slot), which shows fraction bit
+ * k every 2^(BCM_FRC_BITS - k)th frame, following the ruler sequence, and
+ * nothing every 2^BCM_FRC_BITS th frame. Averaged over 2^BCM_FRC_BITS frames,
+ * the fraction adds its value / 2^BCM_FRC_BITS of the shortest BCM cycle, so
+ * dim colors and fades get finer steps for the cost of one short slot per
+ * frame. The pattern repeats at BCM_REFRESH_HZ / 2^BCM_FRC_BITS, so more
+ * bits need a higher refresh rate to not shimmer.
+ */
+#ifndef BCM_FRC_BITS
+#define BCM_FRC_BITS 0
+#endif
+
+#if BCM_FRC_BITS < 0 || BCM_FRC_BITS > 3 || BCM_BITS + BCM_FRC_BITS > 8
+#error "BCM_FRC_BITS must be between 0 and 3, with at most 8 bits of color in total"
+#endif
+
+#define BCM_FRC_SLOTS ((BCM_FRC_BITS > 0) ? 1 : 0)	// Dither slots in the schedule
+
+// Bits of every color component, each one is stored as a bit-plane
+#define COLOR_BITS (BCM_BITS + BCM_FRC_BITS)
+
+// The brightest value of a color component
+#define COLOR_MAX ((1 << COLOR_BITS) - 1)
+
+/**
+ * Order the BCM cycles of every row pair are shown in (BCM_ORDER):
+ *
+ * BCM_ORDER_ROW_MAJOR shows every cycle of a row pair, then moves on to the
+ * next row pair. The long cycles of a row are back to back, so each row is
+ * lit in one burst per frame, which flickers the most (and shows on camera).
+ *
+ * BCM_ORDER_PLANE_MAJOR shows one cycle of every row pair, then the next
+ * cycle, so the bursts of every cycle are spread over the frame.
+ *
+ * BCM_ORDER_SPLIT splits every cycle from BCM_SPLIT_PLANE on into slots of
+ * BCM_SPLIT_PLANE's length, and spreads them out over BCM_PASSES passes
+ * through every row pair. The shorter cycles are shown in the first pass.
+ * Every row gets lit BCM_PASSES times a frame, at the cost of more slots
+ * (and so more scanout time) per frame.
+ *
+ * The total time every cycle is lit for is the same in every order.
+ * RunCalibration() reports the longest time a row goes dark between two
+ * slots of each cycle. With BCM_FRC_BITS, the dither slot is the last slot
+ * of the last pass (a pass of its own with BCM_ORDER_PLANE_MAJOR).
+ */
+#define BCM_ORDER_ROW_MAJOR 0
+#define BCM_ORDER_PLANE_MAJOR 1
+#define BCM_ORDER_SPLIT 2
+
+#ifndef BCM_ORDER
+#define BCM_ORDER BCM_ORDER_ROW_MAJOR
+#endif
+
+#if BCM_ORDER == BCM_ORDER_ROW_MAJOR
+#define BCM_SLOTS (BCM_BITS + BCM_FRC_SLOTS)	// Slots every row pair is shown in, each frame
+#define BCM_PASSES 1	// Times every row pair gets its turn, each frame
+#elif BCM_ORDER == BCM_ORDER_PLANE_MAJOR
+#define BCM_SLOTS (BCM_BITS + BCM_FRC_SLOTS)
+#define BCM_PASSES (BCM_BITS + BCM_FRC_SLOTS)
+#elif BCM_ORDER == BCM_ORDER_SPLIT
+#ifndef BCM_SPLIT_PLANE
+#define BCM_SPLIT_PLANE (BCM_BITS - 3)
+#endif
+#if BCM_SPLIT_PLANE < 0 || BCM_SPLIT_PLANE < BCM_BITS - 4 || BCM_SPLIT_PLANE > BCM_BITS - 1
+#error "BCM_SPLIT_PLANE must be between BCM_BITS - 4 and BCM_BITS - 1"
+#endif
+#define BCM_PASSES ((1 << (BCM_BITS - BCM_SPLIT_PLANE)) - 1)
+#define BCM_SLOTS (BCM_SPLIT_PLANE + BCM_PASSES + BCM_FRC_SLOTS)
+#else
+#error "Unknown BCM_ORDER"
+#endif
+
+/**
+ * BCM cycles shorter than BCM_POLL_CYCLES don't get an interrupt of their
+ * own: the refresh interrupt shows them back to back, busy waiting on the
+ * cycle counter, and only hands the first longer cycle to the timer. The
+ * wait takes as much CPU time as the cycle itself, so this only frees up
+ * CPU time for cycles shorter than the cost of taking an interrupt (which
+ * the Timer0AInt profile and the ScanoutFrame benchmark show), e.g. with
+ * a small BCM_BASE_TICKS. Only the cycles at the start of a pass that
+ * aren't its last slot can be polled, so the refresh interrupt never runs
+ * past the end of a pass (and never polls with BCM_ORDER_PLANE_MAJOR).
+ * A slot dimmed by SetBrightness() to less than BCM_POLL_CYCLES gets its
+ * rows turned off the same way, instead of by Timer2A.
+ */
+#ifndef BCM_POLL_CYCLES
+#define BCM_POLL_CYCLES 100
+#endif
+
+#if BCM_ORDER == BCM_ORDER_ROW_MAJOR
+#define BCM_POLL_LIMIT (BCM_BITS - 1)
+#elif BCM_ORDER == BCM_ORDER_PLANE_MAJOR
+#define BCM_POLL_LIMIT 0
+#else
+#define BCM_POLL_LIMIT BCM_SPLIT_PLANE
+#endif
+
+// Only cycles below BCM_POLL_LIMIT can be polled, so counting the first 7 covers every cycle up to 8 bits
+#define BCM_CYCLE_POLLED(bcm) ((bcm) < BCM_POLL_LIMIT && (BCM_BASE_TICKS << (bcm)) < BCM_POLL_CYCLES)
+#define BCM_POLLED_PLANES (BCM_CYCLE_POLLED(0) + BCM_CYCLE_POLLED(1) + BCM_CYCLE_POLLED(2) + BCM_CYCLE_POLLED(3) + \
+	BCM_CYCLE_POLLED(4) + BCM_CYCLE_POLLED(5) + BCM_CYCLE_POLLED(6))
+
+#if BCM_POLL_LIMIT > 7
+#error "BCM_POLLED_PLANES only counts the first 7 BCM cycles"
+#endif
+
+// Define MATRIX_INDEXED_COLOR to store 4-bit palette indices instead of full colors for
+// every pixel, which takes the frame buffers from about 6.5KB each down to 512 bytes (per panel).
+// The refresh interrupt turns pixel pairs into port values with a lookup table per bit-plane
+// that costs MATRIX_LUT_BYTES more (1.75KB at the default 7 color bits, the same for any
+// number of panels), so both buffers together save about 10KB on one panel.
+// Up to MATRIX_PALETTE_SIZE different colors can be on screen, and changing a palette
+// entry changes every pixel drawn with it on the very next refresh.
+#define MATRIX_PALETTE_SIZE 16
+
+// Size of one frame buffer, both of them have to fit in RAM next to everything else
+#ifdef MATRIX_INDEXED_COLOR
+#define MATRIX_BUFFER_BYTES (SCAN_ROWS * CHAIN_COLS)
+#define MATRIX_LUT_BYTES ((COLOR_BITS + BCM_FRC_SLOTS) * 256)	// Shared by both buffers
+#else
+#define MATRIX_BUFFER_BYTES (MAX_ROWS * MAX_COLS * 3 + COLOR_BITS * SCAN_ROWS * CHAIN_COLS)
+#define MATRIX_LUT_BYTES 0
+#endif
+
+#if 2 * MATRIX_BUFFER_BYTES + MATRIX_LUT_BYTES > 16384
+#error "The frame buffers don't fit in RAM, define MATRIX_INDEXED_COLOR or use fewer panels"
+#endif
+
+/**
+ * Refresh model. The rows are dark while the refresh interrupt clocks out a
+ * row pair (the timer for the next slot only starts once they're lit), which
+ * takes about SCANOUT_CYCLES. So every BCM slot costs its lit time plus
+ * SCANOUT_CYCLES, and a longer chain makes every slot longer, lowering both the
+ * refresh rate and the brightness (BCM_DUTY_PERCENT). The per column cost can
+ * be measured with the ScanoutFrame benchmark (divide by BCM_SLOTS * SCAN_ROWS).
+ */
+#define SCANOUT_OVERHEAD_CYCLES 150	// Interrupt entry, demux, latch, and timer setup
+#define SCANOUT_CYCLES_PER_COL 12	// One port write and two SCLK edges
+#define SCANOUT_CYCLES (SCANOUT_OVERHEAD_CYCLES + SCANOUT_CYCLES_PER_COL * CHAIN_COLS)
+
+// Resulting timing of the display
+#define BCM_LIT_CYCLES (BCM_BASE_TICKS * ((1 << BCM_BITS) - 1 + BCM_FRC_SLOTS))	// SYSCLK cycles a row pair can be lit for in one frame
+#define BCM_FRAME_CYCLES ((BCM_LIT_CYCLES + BCM_SLOTS * SCANOUT_CYCLES) * SCAN_ROWS)	// SYSCLK cycles to display every row once
+#define BCM_REFRESH_HZ (SYSCLK / BCM_FRAME_CYCLES)	// Full frames per second
+#define BCM_ISRS_PER_FRAME ((BCM_SLOTS - BCM_POLLED_PLANES) * SCAN_ROWS)	// Refresh interrupts in a frame
+#define BCM_ISR_RATE_HZ (BCM_REFRESH_HZ * BCM_ISRS_PER_FRAME)	// Refresh interrupts per second
+#define BCM_DUTY_PERCENT (100 * BCM_LIT_CYCLES * SCAN_ROWS / BCM_FRAME_CYCLES)	// Time the LEDs can be lit, out of the whole frame
+
+#if BCM_REFRESH_HZ < 100
+#warning "BCM settings give a refresh rate below 100Hz, expect visible flicker"
+#endif
 
 // Port registers for all of the data pins (RGB0 and RGB1)
 #define DATAPORT GPIO_PORTA_DATA_R
@@ -72,13 +272,32 @@ typedef struct Color_t
 	uint8_t B;
 } Color;
 
+// One row of a GridArray, bit n is column n
+#if MAX_COLS == 32
+typedef uint32_t GridRow;
+#define GRIDROW_CTZ(x) COUNT_TRAILING_ZEROS(x)
+#define GRIDROW_CLZ(x) COUNT_LEADING_ZEROS(x)
+#else
+typedef uint64_t GridRow;
+#define GRIDROW_CTZ(x) ((uint32_t)(x) != 0 ? COUNT_TRAILING_ZEROS((uint32_t)(x)) : 32 + COUNT_TRAILING_ZEROS((uint32_t)((x) >> 32)))
+#define GRIDROW_CLZ(x) ((uint32_t)((x) >> 32) != 0 ? COUNT_LEADING_ZEROS((uint32_t)((x) >> 32)) : 32 + COUNT_LEADING_ZEROS((uint32_t)(x)))
+#endif
+
+// A row with every column set
+#define GRIDROW_ALL ((GridRow)~(GridRow)0)
+
 // A type used to create an array that stores 1-bit per pixel for the LED matrix
-typedef uint32_t GridArray[MAX_ROWS];
+typedef GridRow GridArray[MAX_ROWS];
+
+// Layers and sprites drawn by ComposeFrame(). Higher layers are drawn over lower ones,
+// sprites are drawn over every layer, and higher sprites over lower ones.
+#define MATRIX_LAYERS 2
+#define MATRIX_SPRITES 8
 
 // Convenience macros for getting, setting, and clearing bits in a GridArray
 #define GET_GRIDARRAY_BIT(array,row,col) ((array[row] >> col) & 1)
-#define SET_GRIDARRAY_BIT(array,row,col) ((array[row]) |= (1 << col))
-#define CLEAR_GRIDARRAY_BIT(array,row,col) ((array[row]) &= ~(1 << col))
+#define SET_GRIDARRAY_BIT(array,row,col) ((array[row]) |= ((GridRow)1 << col))
+#define CLEAR_GRIDARRAY_BIT(array,row,col) ((array[row]) &= ~((GridRow)1 << col))
 
 // Initializes timer and gpio ports needed to drive the LED matrix
 void InitMatrixDriver(void);
@@ -86,7 +305,7 @@ void InitMatrixDriver(void);
 // Sets the current drawing color
 void SetColor(uint8_t r, uint8_t g, uint8_t b);
 
-// Clears every pixel on the display
+// Clears every pixel of the frame being drawn
 void ClearMatrix();
 
 // Draws every pixel on the display to a certain color
@@ -104,4 +323,69 @@ void DrawPixel(uint8_t rownum, uint8_t colnum);
 // Draws an array of bits (if bit is zero, dont display, if one, display color)
 void DrawGridArray(GridArray array);
 
+// Draws only the bits of an array that are also set in mask
+void DrawGridArrayMasked(GridArray array, GridArray mask);
+
+// Copies the masked pixels of the displayed frame into the back buffer
+void CopyFrontPixels(GridArray mask);
+
+// Returns the color a pixel is being displayed in (decoded from the bit-planes)
+Color GetDisplayedPixel(uint8_t rownum, uint8_t colnum);
+
+// Sets which cells of a layer are lit, and their color
+void SetLayer(uint8_t layer, GridArray bits, Color color);
+
+// Lights (on = 1) or clears (on = 0) a single cell of a layer
+void SetLayerBit(uint8_t layer, uint8_t rownum, uint8_t colnum, uint8_t on);
+
+// Moves a sprite to a cell and sets its color, showing it if it was hidden
+void SetSprite(uint8_t sprite, uint8_t rownum, uint8_t colnum, Color color);
+
+// Stops drawing a sprite
+void HideSprite(uint8_t sprite);
+
+// Has the next ComposeFrame() redraw every cell (after drawing to the matrix directly)
+void InvalidateLayers(void);
+
+// Redraws the cells whose layers or sprites changed and presents the frame, returns 0 if the last frame is still pending
+uint8_t ComposeFrame(void);
+
+#ifdef MATRIX_INDEXED_COLOR
+// Changes a palette entry (index 0 is what ClearMatrix() clears to)
+void SetPaletteColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+
+// Sets the current drawing color to a palette entry
+void SetColorIndex(uint8_t index);
+#endif
+
+// Runs the refresh interrupt through one whole frame and puts the refresh back where it was, for timing it (with interrupts masked)
+void ScanoutFrame(void);
+
+// Number of times the lit time of every slot gets measured (a multiple of SCAN_ROWS, so it's whole frames)
+#define CALIBRATION_SAMPLES 64
+
+// Measures how long a row pair actually stays lit for each BCM cycle in a frame (in SYSCLK cycles)
+void MeasureLitTimes(uint32_t lit[BCM_BITS]);
+
+// Models the longest time a row goes dark between two slots of a BCM cycle (BCM_BITS for any cycle)
+uint32_t EmissionGap(uint8_t bcm);
+
+// Adjusts the BCM timer periods so every cycle is lit for exactly BCM_BASE_TICKS << bcm cycles
+void CalibrateMatrix(uint32_t lit_before[BCM_BITS]);
+
+// Brightest setting of SetBrightness(), the display's full brightness
+#define BRIGHTNESS_MAX 255
+
+// Dims the whole display by turning the rows off early in every slot (0 is off)
+void SetBrightness(uint8_t level);
+
+// Returns the brightness set by SetBrightness()
+uint8_t GetBrightness(void);
+
+// Shows everything drawn so far once the display finishes its current frame
+void PresentFrame(void);
+
+// Returns 1 while a presented frame is still waiting to be displayed
+uint8_t FramePending(void);
+
 #endif
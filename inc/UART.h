@@ -5,12 +5,34 @@
 #include "utility.h"
 
 #define BAUD_RATE 9600	// Wanted baud rate
-//#define IBRD (SYSCLK / (16 * BAUD_RATE))	// Integer baud rate divisor
+#define MAX_BAUD_RATE 921600	// Fastest supported baud rate
+
+// Sizes of the receive and transmit ring buffers (must be powers of two)
+#define UART_RX_BUFFER_SIZE 1024	// Room for the token stream of a streamed frame that changes a few hundred pixels, a quarter of one that changes every pixel (see stream.h)
+#define UART_TX_BUFFER_SIZE 512
 
 // Initialize the UART and GPIO needed to use the UART
-void InitUART(uint16_t IBRD);
+void InitUART(uint32_t baud);
+
+// Change the baud rate (waits for everything queued to be sent first)
+void UARTSetBaudRate(uint32_t baud);
+
+// Queue data to be sent over the UART, returns how many bytes fit in the transmit buffer
+uint16_t UARTWrite(const uint8_t *buf, uint16_t len);
+
+// Take up to len received bytes, returns how many there were
+uint16_t UARTRead(uint8_t *buf, uint16_t len);
 
-// Send a byte of data over the UART
+// Returns how many received bytes were lost because the receive buffer was full
+uint32_t UARTRxOverflows(void);
+
+// Send a byte of data over the UART (waits only if the transmit buffer is full, works with interrupts masked)
 void UARTTransmit(uint8_t data);
 
+// Send a null terminated string over the UART
+void UARTWriteString(const char *str);
+
+// Send an unsigned number over the UART as decimal text
+void UARTWriteNumber(uint32_t num);
+
 #endif /* UART_H_ */
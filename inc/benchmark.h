@@ -0,0 +1,41 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <stdint.h>
+
+/**
+ * Times the drawing and refresh hot paths on the device with the DWT cycle
+ * counter, and sends the results over the UART as CSV:
+ *
+ * 		benchmark,iterations,min_cycles,mean_cycles,max_cycles,min_ns
+ *
+ * Every iteration runs with interrupts masked, so the numbers don't include
+ * time spent in other interrupts. ScanoutFrame is the CPU time the display
+ * takes every frame, BCM_REFRESH_HZ times a second, and the refresh goes
+ * on from where it was afterwards. The benchmarks draw over the back buffer
+ * and run extra game ticks, so the game skips ahead a little. That would
+ * break a recording or playback (see replay.h), so while one is going on
+ * nothing runs and a single line saying so is sent instead.
+ */
+
+// Number of times each benchmark runs
+#define BENCHMARK_ITERATIONS 32
+
+// Runs every benchmark and sends the results
+void RunBenchmarks(void);
+
+/**
+ * Calibrates the BCM timing (see CalibrateMatrix()) and sends how long the
+ * rows were lit during each BCM cycle before and after, as CSV:
+ *
+ * 		plane,target_cycles,lit_before,lit_after,ideal_share,share_before,share_after,max_gap_cycles
+ *
+ * A share is how much of a full white pixel's light comes from that plane,
+ * in hundredths of a percent. Before calibrating, the low planes get more
+ * than their ideal share, which is what makes dim colors come out wrong.
+ * max_gap_cycles is the longest a row goes dark between two slots of the
+ * plane (see EmissionGap()), the last line ("all") covers every plane.
+ */
+void RunCalibration(void);
+
+#endif /* BENCHMARK_H_ */
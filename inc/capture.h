@@ -0,0 +1,32 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+
+/**
+ * Captures the image on the display, as decoded back out of the bit-planes
+ * the refresh interrupt scans out (see GetDisplayedPixel()), and sends it
+ * over the UART (framing in protocol.h) as a binary PPM (P6) file with 8 bits
+ * per component, split across OP_CAPTURE_DATA frames. An empty
+ * OP_CAPTURE_DATA frame ends the image, followed by OP_CAPTURE_HASH with a
+ * 4 byte FNV-1a hash of the pixel data, so a capture can be compared with a
+ * golden image without sending it again.
+ *
+ * To capture the frame of a certain game tick, play a recording back for
+ * that many ticks (see replay.h). The game stays paused afterwards, so the
+ * capture always shows the frame of that exact tick. host/test/test_golden.c
+ * compares captures like that against golden images.
+ */
+
+// Opcodes used by captures
+#define OP_CAPTURE 0x1F			// No payload: capture the displayed frame
+#define OP_CAPTURE_DATA 0x20	// Sent by the device: the next part of the PPM file
+#define OP_CAPTURE_HASH 0x21	// Sent by the device: 4 byte hash of the pixel data
+
+// Registers the capture command with the protocol
+void InitCapture(void);
+
+// Sends the displayed frame over the UART
+void CaptureFrame(void);
+
+#endif /* CAPTURE_H_ */
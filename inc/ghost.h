@@ -0,0 +1,58 @@
+#ifndef GHOST_H_
+#define GHOST_H_
+
+#include <stdint.h>
+#include "pacman.h"
+
+// Number of ghosts in the level (each one uses the next of Blinky, Pinky, Inky, and Clyde's targeting)
+#ifndef GHOST_COUNT
+#define GHOST_COUNT 4
+#endif
+
+#if GHOST_COUNT < 1 || GHOST_COUNT > 4
+#error "GHOST_COUNT must be between 1 and 4"
+#endif
+
+// Most SYSCLK cycles MoveGhosts() may spend on pathfinding each game tick (0.5ms)
+#define GHOST_CYCLE_BUDGET (SYSCLK / 2000)
+
+// Ghost n is drawn with sprite GHOST_SPRITE + n
+#define GHOST_SPRITE 0
+
+// Returned by GhostCollision() when there's no ghost at a cell
+#define NO_GHOST 0xFF
+
+// What the ghosts are currently trying to do
+typedef enum {SCATTER, CHASE, FRIGHTENED} GhostMode;
+
+// Finds the cells the ghosts can get to in the current level
+void SetGhostLevel(void);
+
+// Puts every ghost back at its starting position
+void ResetGhosts(void);
+
+// Moves every ghost one cell and updates their sprites
+void MoveGhosts(Character pacman, PacmanDir pacman_dir);
+
+// Returns the index of the ghost at a cell, or NO_GHOST
+uint8_t GhostCollision(uint8_t row, uint8_t col);
+
+// Returns 1 if a ghost can currently be eaten
+uint8_t IsGhostFrightened(uint8_t ghost);
+
+// Sends an eaten ghost back to its starting position
+void EatGhost(uint8_t ghost);
+
+// Makes every ghost run away from pacman for a number of game ticks
+void FrightenGhosts(uint16_t ticks);
+
+// Seeds the random number generator used by frightened ghosts
+void SeedGhostRandom(uint32_t seed);
+
+// Makes the ghosts ignore the pathfinding budget (on = 1), so their moves don't depend on timing
+void SetGhostDeterministic(uint8_t on);
+
+// Gets the cell a ghost is in
+void GetGhostCell(uint8_t ghost, uint8_t *row, uint8_t *col);
+
+#endif /* GHOST_H_ */
@@ -0,0 +1,52 @@
+#ifndef MAZEGRAPH_H_
+#define MAZEGRAPH_H_
+
+#include <stdint.h>
+#include "LedMatrix.h"
+
+// Most junctions (and dead ends) a level can have for its graph to be built
+#define MAZE_MAX_NODES 64
+
+// Returned for nodes and distances that don't exist
+#define MAZE_NO_NODE 0xFF
+#define MAZE_NO_PATH 0xFF
+
+// Directions to leave a cell in (also the index of a node's corridors)
+typedef enum {MAZE_UP, MAZE_LEFT, MAZE_DOWN, MAZE_RIGHT, MAZE_DIRS} MazeDir;
+
+// A junction or dead end, and the corridors leading away from it
+typedef struct MazeNode_t
+{
+	uint8_t row;
+	uint8_t col;
+	uint8_t neighbor[MAZE_DIRS];	// The node at the other end of each corridor (MAZE_NO_NODE if it's a wall)
+	uint8_t length[MAZE_DIRS];		// The number of moves along each corridor
+} MazeNode;
+
+// The compiled graph of a level, small enough to live in flash
+typedef struct MazeGraph_t
+{
+	uint8_t num_nodes;
+	const MazeNode *nodes;
+	const uint8_t *distance;	// Shortest path lengths between every pair of nodes, num_nodes x num_nodes
+} MazeGraph;
+
+// The graph of the built-in level (see pacman.c), generated into mazelevel.c by host/mazegen.c, 0 if it has too many junctions
+extern const MazeGraph *const builtin_maze_graph;
+
+// Compiles the walls of a level into a graph in the storage given, returns 1 on success (and uses the graph)
+uint8_t BuildMazeGraph(GridArray walls, MazeNode nodes[MAZE_MAX_NODES], uint8_t distance[MAZE_MAX_NODES * MAZE_MAX_NODES], MazeGraph *graph);
+
+// Uses a compiled graph for the distances in a level, or no graph if it's 0
+void SetMazeGraph(GridArray walls, const MazeGraph *graph);
+
+// Returns 1 if a graph is being used
+uint8_t IsMazeGraphValid(void);
+
+// Returns the number of junctions (and dead ends) in the graph
+uint8_t MazeNodeCount(void);
+
+// Returns the shortest path length between two open cells using the graph
+uint8_t MazeGraphDistance(uint8_t from_row, uint8_t from_col, uint8_t to_row, uint8_t to_col);
+
+#endif /* MAZEGRAPH_H_ */
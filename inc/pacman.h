@@ -15,6 +15,18 @@ typedef enum {NONE, LEFT, RIGHT, UP, DOWN} PacmanDir;
 // Initializes the hardware needed to play the game
 void InitGame(void);
 
+// Task that handles the input received over the UART
+void ProcessInput(void);
+
+// Restarts the current level with a seed for the random numbers
+void ResetGame(uint32_t seed);
+
+// Stops (pause = 1) or restarts the game ticks
+void PauseGame(uint8_t pause);
+
+// Returns a hash of the game's state (to check that a replay matches its recording)
+uint32_t GameStateHash(void);
+
 extern GridArray level;
 
 #endif /* PACMAN_H_ */
@@ -0,0 +1,34 @@
+#ifndef PATHFIND_H_
+#define PATHFIND_H_
+
+#include <stdint.h>
+#include "LedMatrix.h"
+
+// Distance stored for cells that can't reach the target
+#define PATH_UNREACHABLE 0xFF
+
+// How many distance fields are kept around (one per target cell), fewer on bigger displays to save RAM
+#define PATH_CACHE_SIZE ((MAX_ROWS * MAX_COLS <= 1024) ? 4 : (MAX_ROWS * MAX_COLS <= 2048) ? 2 : 1)
+
+// The shortest path length from every cell to one target cell
+typedef uint8_t DistanceField[MAX_ROWS][MAX_COLS];
+
+// Sets the walls used for pathfinding (and throws away every cached distance field)
+void SetPathLevel(GridArray walls);
+
+// Fills in a distance field from a target cell using a bit-parallel breadth first search
+void ComputeDistanceField(GridArray walls, uint8_t row, uint8_t col, DistanceField field);
+
+// Adds every cell that can be reached from a cell to a GridArray
+void ReachableCells(GridArray walls, uint8_t row, uint8_t col, GridArray reached);
+
+// Returns the distance field for a target cell, computing it only if it isn't cached
+const DistanceField *GetDistanceField(uint8_t row, uint8_t col);
+
+// Returns 1 if the distance field for a target cell is already cached
+uint8_t IsDistanceFieldCached(uint8_t row, uint8_t col);
+
+// Returns the shortest path length between two cells of the current level
+uint8_t PathDistance(uint8_t from_row, uint8_t from_col, uint8_t to_row, uint8_t to_col);
+
+#endif /* PATHFIND_H_ */
@@ -0,0 +1,39 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+#include "utility.h"
+
+// Interrupts (and other time critical code) that can be profiled
+typedef enum {PROFILE_TIMER0A, PROFILE_GAME_TICK, PROFILE_UART4, PROFILE_GHOSTS, PROFILE_COUNT} ProfileId;
+
+// Number of histogram buckets, bucket n counts durations of 2^n to 2^(n+1) - 1 cycles
+#define PROFILE_BUCKETS 32
+
+/**
+ * Place PROFILE_ISR_ENTER() as the first statement of an interrupt and
+ * PROFILE_ISR_EXIT() as its last. A budget of zero means the interrupt has
+ * no deadline, otherwise every run longer than the budget (in SYSCLK
+ * cycles) gets counted as a missed deadline.
+ *
+ * Profiling is opt-in: define PROFILE_ISRS in the build to enable it,
+ * otherwise these macros compile to nothing.
+ */
+#ifdef PROFILE_ISRS
+#define PROFILE_ISR_ENTER() uint32_t profile_start = CYCLE_COUNT()
+#define PROFILE_ISR_EXIT(id, budget) ProfileRecord((id), CYCLE_COUNT() - profile_start, (budget))
+#else
+#define PROFILE_ISR_ENTER()
+#define PROFILE_ISR_EXIT(id, budget)
+#endif
+
+// Clears all of the collected statistics
+void ResetProfiler(void);
+
+// Adds one run of an interrupt to its statistics
+void ProfileRecord(ProfileId id, uint32_t cycles, uint32_t budget);
+
+// Sends a report of every interrupt's statistics over the UART and resets them
+void ProfilerReport(void);
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,77 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <stdint.h>
+#include "utility.h"
+
+/**
+ * Binary command protocol used over the UART. Every frame looks like:
+ *
+ * 		SYNC | opcode | length | payload (length bytes) | CRC8
+ *
+ * The CRC8 (polynomial 0x07, initial value 0) covers the opcode, length,
+ * and payload. Frames with a bad CRC are dropped, and so are frames whose
+ * next byte doesn't come within PROTOCOL_BYTE_TIMEOUT. A dropped frame's
+ * bytes after its SYNC go through the parser again, so a stray SYNC or a
+ * corrupt length only costs that frame and not the ones after it. Any byte
+ * received outside of a frame that isn't SYNC is handed to the ASCII
+ * handler, so single character commands (like "wasd") keep working.
+ *
+ * The device sends replies and bulk data back using the same framing.
+ * Multi-byte values are little endian.
+ */
+#define PROTOCOL_SYNC 0xA5
+
+// Largest payload a frame can carry
+#define PROTOCOL_MAX_PAYLOAD 255
+
+// Longest a frame may go without its next byte before it gets dropped, in SYSCLK cycles (50ms, about 50 bytes at 9600 baud)
+#define PROTOCOL_BYTE_TIMEOUT (SYSCLK / 20)
+
+// Number of opcodes (handlers can be registered for opcodes 0 to PROTOCOL_MAX_OPCODES - 1)
+#define PROTOCOL_MAX_OPCODES 32
+
+// Opcodes
+#define OP_INPUT 0x01			// Payload: 1 byte, the direction to move pacman in (a PacmanDir)
+#define OP_SET_BAUD 0x02		// Payload: 4 bytes, the new baud rate (applied after everything queued is sent)
+#define OP_PROFILE 0x03			// No payload: send the profiling report (as ASCII text)
+#define OP_BENCHMARK 0x04		// No payload: run the benchmarks and send the results (as CSV text)
+#define OP_CALIBRATE 0x05		// No payload: calibrate the BCM timing and send the lit time of every plane (as CSV text)
+#define OP_BRIGHTNESS 0x06		// Payload: 1 byte, the brightness of the whole display (0 to BRIGHTNESS_MAX)
+#define OP_LEVEL_WALLS 0x10		// Payload: the walls of a new level, a whole GridArray (128 bytes on one panel: 32 rows, 4 bytes each) or a first row number followed by rows
+#define OP_LEVEL_PELLETS 0x11	// Payload: the pellets of the new level (same layout), loads the level once its last row is sent
+
+// Called with the payload of every good frame with a certain opcode
+typedef void (*CommandHandler)(const uint8_t *payload, uint8_t length);
+
+// Called with every byte received outside of a frame
+typedef void (*AsciiHandler)(uint8_t data);
+
+// Registers the built-in commands
+void InitProtocol(void);
+
+// Sets which function handles frames with an opcode
+void ProtocolRegister(uint8_t opcode, CommandHandler handler);
+
+// Sets which function handles bytes received outside of a frame
+void ProtocolSetAsciiHandler(AsciiHandler handler);
+
+// Feeds one received byte into the protocol
+void ProtocolReceive(uint8_t data);
+
+// Drops a frame whose next byte is overdue (call it once every received byte has been fed in)
+void ProtocolCheckTimeout(void);
+
+// Sends a frame
+void ProtocolSend(uint8_t opcode, const uint8_t *payload, uint8_t length);
+
+// Returns the number of frames dropped because of a bad CRC or a timeout
+uint32_t ProtocolErrors(void);
+
+// Reads a little endian 32-bit value from a payload
+#define READ_LE32(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+// Writes a little endian 32-bit value into a payload
+#define WRITE_LE32(p, v) ((p)[0] = (uint8_t)(v), (p)[1] = (uint8_t)((v) >> 8), (p)[2] = (uint8_t)((v) >> 16), (p)[3] = (uint8_t)((v) >> 24))
+
+#endif /* PROTOCOL_H_ */
@@ -0,0 +1,71 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include "pacman.h"
+
+/**
+ * Records the direction pacman is steered in at every game tick, and plays
+ * it back at exactly the same ticks. A game is reset with a seed before it
+ * gets recorded or played back, and the ghosts ignore their pathfinding
+ * budget while either is going on, so playing a recording back always
+ * gives the same game (and the same GameStateHash()) as when it was recorded.
+ *
+ * Each record is 16 bits: the direction in the top 3 bits, and the number of
+ * ticks since the record before it (or since the reset) in the low 13 bits.
+ * A record is only stored when the direction changes, or when 8191 ticks
+ * went by without a change.
+ *
+ * Over the UART (framing in protocol.h):
+ *
+ * 		OP_REPLAY_RECORD	Payload: 4 byte seed. Resets the game and starts recording.
+ * 		OP_REPLAY_STOP		No payload. Stops a recording and replies with
+ * 							OP_REPLAY_RESULT, or stops a playback, or clears the
+ * 							records if neither is running. Always unpauses the game.
+ * 		OP_REPLAY_EXPORT	No payload. Sends (and removes) the buffered records as
+ * 							OP_REPLAY_DATA frames. Can be used while recording.
+ * 		OP_REPLAY_DATA		Payload: records (2 bytes each). Sent by the device
+ * 							when exporting, and to the device to queue records
+ * 							for playback (also while playing back).
+ * 		OP_REPLAY_PLAY		Payload: 4 byte seed, 4 byte tick count. Resets the game
+ * 							and plays the queued records back for that many ticks,
+ * 							then replies with OP_REPLAY_RESULT. The game stays
+ * 							paused afterwards until OP_REPLAY_STOP.
+ * 		OP_REPLAY_RESULT	Sent by the device. Payload: 4 byte tick count,
+ * 							4 byte GameStateHash() after the last tick.
+ *
+ * Live input is ignored during a playback. Uploading a level during a
+ * recording makes it impossible to play back.
+ */
+
+// Number of records buffered on the device (must be a power of two)
+#define REPLAY_BUFFER_SIZE 512
+
+// Opcodes used by the recorder
+#define OP_REPLAY_RECORD 0x19
+#define OP_REPLAY_PLAY 0x1A
+#define OP_REPLAY_STOP 0x1B
+#define OP_REPLAY_EXPORT 0x1C
+#define OP_REPLAY_DATA 0x1D
+#define OP_REPLAY_RESULT 0x1E
+
+// Packing of a record
+#define REPLAY_DIR_SHIFT 13
+#define REPLAY_MAX_DELTA ((1 << REPLAY_DIR_SHIFT) - 1)
+
+// Registers the replay commands with the protocol
+void InitReplay(void);
+
+// Called at the start of every game tick, returns the direction pacman should move in
+PacmanDir ReplayTick(PacmanDir dir);
+
+// Called at the end of every game tick, finishes a playback after its last tick
+void ReplayTickDone(void);
+
+// Returns 1 while a recording or a playback is going on
+uint8_t IsReplaying(void);
+
+// Returns the number of records lost because the buffer was full
+uint32_t ReplayOverflows(void);
+
+#endif /* REPLAY_H_ */
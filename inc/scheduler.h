@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+/**
+ * A run-to-completion scheduler. Interrupts only post events, and the task
+ * registered for each event runs later in thread mode, where it can be
+ * preempted by any interrupt (so the matrix refresh is never held up).
+ * Tasks never preempt each other. When several events are pending, the one
+ * listed first runs first, and the core sleeps (WFI) when none are pending.
+ */
+typedef enum
+{
+	EVENT_TICK,				// The game timer expired
+	EVENT_FRAME_PRESENTED,	// The refresh interrupt swapped in a presented frame
+	EVENT_INPUT,			// Bytes arrived in the UART's receive buffer
+	EVENT_COUNT
+} Event;
+
+// A task, run once for every time its event gets posted (posts before it runs are merged)
+typedef void (*TaskHandler)(void);
+
+// Sets the task that runs when an event is posted
+void SchedulerRegister(Event event, TaskHandler handler);
+
+// Marks an event as pending, safe to call from any interrupt
+void PostEvent(Event event);
+
+// Runs an event's task right away, without posting the event
+void RunTask(Event event);
+
+// Runs the tasks of posted events forever
+void RunScheduler(void);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,58 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stdint.h>
+#include "LedMatrix.h"
+
+/**
+ * Streaming mode turns the display into a remote framebuffer fed over the
+ * UART (using the framing in protocol.h). While streaming, the game is paused.
+ *
+ * A frame is sent as OP_STREAM_BEGIN, any number of OP_STREAM_DATA frames,
+ * and OP_STREAM_END. The data frames together hold a token stream that
+ * describes the pixels in row major order (row 0 col 0, row 0 col 1, ...),
+ * as changes against the previous frame. Tokens may be split across data frames.
+ *
+ * 		0x00 - 0x7F			Skip n + 1 pixels (unchanged from the previous frame)
+ * 		0x80 - 0xBF, R, G, B	Set the next n + 1 pixels to a color
+ * 		0xC0 - 0xFF, index		Set the next n + 1 pixels to a palette color
+ *
+ * where n is the token's low 7 (skip) or 6 (color) bits. Colors are 8 bits
+ * per component and get scaled down to COLOR_MAX. Pixels that aren't
+ * covered by the tokens are unchanged. The previous frame of the first frame
+ * is whatever was displayed when streaming started.
+ *
+ * Throughput at 8N1 (each byte takes 10 bits, plus 4 bytes of framing per
+ * 255 bytes of data): a frame in which every pixel differs from its
+ * neighbors costs 4096 bytes with colors or 2048 bytes with palette
+ * indices, so at 921600 baud that's about 22 or 44 frames per second,
+ * and about 2 frames per second at 9600 baud. Frames where only a few
+ * sprites move cost a few dozen bytes and are limited by the display's
+ * refresh rate (BCM_REFRESH_HZ) rather than the link. host/streamenc.c
+ * encodes frames on a PC, and host/bench/bench_stream.c measures the
+ * frame rates of a few kinds of animation at a few baud rates.
+ */
+
+// Number of colors in the streaming palette
+#define STREAM_PALETTE_SIZE 16
+
+// Opcodes used by streaming mode
+#define OP_STREAM_MODE 0x14		// Payload: 1 byte, 1 to start streaming, 0 to go back to the game
+#define OP_STREAM_PALETTE 0x15	// Payload: first index, then R, G, B for each color starting at that index
+#define OP_STREAM_BEGIN 0x16	// No payload: starts decoding a new frame (once the last one is displayed)
+#define OP_STREAM_DATA 0x17		// Payload: the next part of the frame's token stream
+#define OP_STREAM_END 0x18		// No payload: displays the decoded frame
+
+// Registers the streaming commands with the protocol
+void InitStream(void);
+
+// Starts a frame that waited for the last one to be displayed (call it for EVENT_FRAME_PRESENTED)
+void StreamFramePresented(void);
+
+// Returns 1 while a frame waits for the last one to be displayed, so the received bytes have to wait too
+uint8_t IsStreamWaiting(void);
+
+// Returns 1 while streaming mode is on
+uint8_t IsStreaming(void);
+
+#endif /* STREAM_H_ */
@@ -8,6 +8,75 @@
 #define ST_US (SYSCLK / 1000000)
 #define ST_MS (SYSCLK / 1000)
 
+// Counts the leading/trailing zero bits of a 32-bit value (using the CLZ instruction). Undefined for zero.
+#if defined(__TI_COMPILER_VERSION__)
+#define COUNT_LEADING_ZEROS(x) ((uint8_t)_norm(x))
+#else
+#define COUNT_LEADING_ZEROS(x) ((uint8_t)__builtin_clz(x))
+#endif
+#define COUNT_TRAILING_ZEROS(x) (31 - COUNT_LEADING_ZEROS((x) & (0 - (x))))
+
+// Data watchpoint and trace (DWT) cycle counter registers (not part of tm4c123gh6pm.h)
+#if defined(HOST_BUILD)
+#include "mock.h"	// The host build's peripheral mock (see host/mock.h)
+#define DEMCR_R (*MockRegister(MOCK_DEMCR))
+#define DWT_CTRL_R (*MockRegister(MOCK_DWT_CTRL))
+#define DWT_CYCCNT_R (*MockRegister(MOCK_DWT_CYCCNT))
+#else
+#define DEMCR_R (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL_R (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT_R (*((volatile uint32_t *)0xE0001004))
+#endif
+
+// Reads the free running SYSCLK cycle counter. Define CYCLE_COUNT before
+// including this file to substitute another counter (e.g. a mock).
+#ifndef CYCLE_COUNT
+#define CYCLE_COUNT() DWT_CYCCNT_R
+#endif
+
+// Masks/unmasks every configurable interrupt
+#if defined(HOST_BUILD)
+#define DISABLE_INTERRUPTS() MockSetPrimask(1)
+#define ENABLE_INTERRUPTS() MockSetPrimask(0)
+#elif defined(__TI_COMPILER_VERSION__)
+#define DISABLE_INTERRUPTS() __asm(" cpsid i")
+#define ENABLE_INTERRUPTS() __asm(" cpsie i")
+#else
+#define DISABLE_INTERRUPTS() __asm volatile ("cpsid i")
+#define ENABLE_INTERRUPTS() __asm volatile ("cpsie i")
+#endif
+
+// Masks every configurable interrupt and returns whether they were masked
+// before (PRIMASK), for RESTORE_INTERRUPTS() to put back. Unlike the pair
+// above, this nests, so it's safe in code that may be called with
+// interrupts already masked.
+#if defined(HOST_BUILD)
+#define SAVE_AND_DISABLE_INTERRUPTS() MockSetPrimask(1)
+#define RESTORE_INTERRUPTS(state) ((void)MockSetPrimask(state))
+#elif defined(__TI_COMPILER_VERSION__)
+#define SAVE_AND_DISABLE_INTERRUPTS() _disable_IRQ()
+#define RESTORE_INTERRUPTS(state) _restore_interrupts(state)
+#else
+static inline uint32_t SaveAndDisableInterrupts(void)
+{
+	uint32_t primask;
+
+	__asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+	return primask;
+}
+#define SAVE_AND_DISABLE_INTERRUPTS() SaveAndDisableInterrupts()
+#define RESTORE_INTERRUPTS(state) __asm volatile ("msr primask, %0" :: "r" (state) : "memory")
+#endif
+
+// Sleeps until an interrupt is pending (even a masked one)
+#if defined(HOST_BUILD)
+#define WAIT_FOR_INTERRUPT() MockWaitForInterrupt()
+#elif defined(__TI_COMPILER_VERSION__)
+#define WAIT_FOR_INTERRUPT() __asm(" wfi")
+#else
+#define WAIT_FOR_INTERRUPT() __asm volatile ("wfi")
+#endif
+
 // Macro to set the system clock to the defined SYSCLK
 #define INITIALIZE_PLL() InitPLL((400000000 / SYSCLK) - 1)
 
@@ -17,4 +86,7 @@ void InitPLL(uint8_t div);
 // Delays using the SysTick timer
 void SysTickDelay(uint32_t delay);
 
+// Starts the DWT cycle counter read by CYCLE_COUNT()
+void InitCycleCounter(void);
+
 #endif /* CONFIG_H_ */
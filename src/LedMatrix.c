@@ -4,32 +4,170 @@
 #include "inc/hw_timer.h"
 #include "inc/hw_gpio.h"
 #include "LedMatrix.h"
+#include "utility.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+#ifdef MATRIX_INDEXED_COLOR
+// What gets stored for every pixel, an index into the palette
+typedef uint8_t PixelValue;
+#else
+typedef Color PixelValue;
+#endif
 
 // Global display variables (initialized to zero thanks to C standard!)
 static uint8_t cur_row;	// Current row
-static Color cur_draw_color;	// Current color to draw with
-static Color matrix[MAX_ROWS][MAX_COLS];	// The framebuffer for the display
+static PixelValue cur_draw_color;	// Current color to draw with
+#ifndef MATRIX_INDEXED_COLOR
+static uint8_t cur_draw_bits[COLOR_BITS];	// Bits of the current color in each bit-plane, for both halves of a panel
+#endif
 
 // Variables needed to perform binary coded modulation (BCM)
-static uint8_t cur_bcm_cycle;	// 0-7, which cycle we're currently on
+static uint8_t cur_slot;	// 0 to BCM_SLOTS - 1, which slot of the schedule we're currently on
+static uint8_t pass_start;	// First slot of the current pass
 
 // Correct demux values based on the current row
-static const uint8_t demux_vals[] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+static const uint8_t demux_vals[SCAN_ROWS] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+
+/**
+ * One slot of the BCM schedule. Every row pair goes through the slots of a
+ * pass in order, then the next pass starts over from the first row pair
+ * (see BCM_ORDER). Generated by InitMatrixDriver().
+ */
+typedef struct BcmSlot_t
+{
+	uint8_t plane;		// The BCM cycle (bit of the colors) shown
+	uint8_t pass_end;	// 1 for the last slot of a pass
+	uint32_t target;	// How long the rows should stay lit for (in SYSCLK cycles)
+	uint32_t length;	// The timer period that lights them for that long, adjusted by CalibrateMatrix()
+	uint32_t dark;		// How much sooner than that the rows get turned off, set by SetBrightness()
+} BcmSlot;
+
+static BcmSlot schedule[BCM_SLOTS];
+static uint8_t brightness = BRIGHTNESS_MAX;	// Global brightness (see SetBrightness())
+
+#if BCM_FRC_BITS > 0
+#define BCM_FRC_SLOT (BCM_SLOTS - 1)	// The dither slot (see BCM_FRC_BITS)
+#define BCM_DARK_PLANE COLOR_BITS		// Bit-plane number that lights nothing
+
+static uint8_t frc_frame;	// 0 to 2^BCM_FRC_BITS - 1, where the dither slot is in its pattern
+#endif
+
+// Measurement of how long the rows actually stay lit (see MeasureSlots())
+static uint32_t lit_start;	// CYCLE_COUNT() when the rows were last turned on
+static uint8_t lit_slot;	// The slot they were turned on for
+static volatile uint16_t lit_samples;	// Slots left to measure, 0 when not measuring
+static uint32_t lit_total[BCM_SLOTS];	// Lit time of every measured slot, added up for each slot of the schedule
+
+#ifdef MATRIX_INDEXED_COLOR
+/**
+ * A complete frame for the display.
+ *
+ * pixels[scan_row] holds the row pair in the order it gets clocked out (see
+ * ChainColumn()). Each byte holds the palette index of a pixel of the top half
+ * of its panel in its low nibble and of the pixel SCAN_ROWS below it in its
+ * high nibble, which are the two pixels that get clocked out together. plane_lut
+ * turns such a byte straight into the DATAPORT value for each BCM cycle, so the
+ * refresh interrupt only does one extra load.
+ */
+typedef struct FrameBuffer_t
+{
+	uint8_t pixels[SCAN_ROWS][CHAIN_COLS];
+} FrameBuffer;
+
+static Color palette[MATRIX_PALETTE_SIZE];	// Shared by both buffers, index 0 starts out black
+static uint8_t plane_lut[COLOR_BITS + BCM_FRC_SLOTS][256];	// DATAPORT value of every pixel pair for each bit-plane (and the dark plane, all zeros)
+
+// Palette entries (bit n for entry n) the pixels of each buffer might use, and the
+// ones set by SetPaletteColor(). SetColor() only hands out entries in none of them.
+static volatile uint16_t palette_front = 1;
+static volatile uint16_t palette_back = 1;
+static uint16_t palette_pinned;
+#else
+/**
+ * A complete frame for the display.
+ *
+ * planes is a bit-plane copy of matrix, laid out exactly as it gets written to DATAPORT.
+ * planes[bit][scan_row] holds a row pair in the order it gets clocked out (see ChainColumn()),
+ * with the bit "bit" of every color of a pixel in the top half of its panel in R0/G0/B0
+ * and of the pixel SCAN_ROWS below it in R1/G1/B1, so the refresh interrupt never has to
+ * touch the Color structs. Kept up to date by every drawing function through WritePixel().
+ */
+typedef struct FrameBuffer_t
+{
+	Color matrix[MAX_ROWS][MAX_COLS];
+	uint8_t planes[COLOR_BITS][SCAN_ROWS][CHAIN_COLS];
+} FrameBuffer;
+
+#if BCM_FRC_BITS > 0
+static const uint8_t dark_row[CHAIN_COLS];	// Shown instead of a bit-plane for the dark plane
+#endif
+#endif
+
+// Double buffering: the refresh interrupt scans out the front buffer while everything draws to the back buffer
+static FrameBuffer buffers[2];
+static FrameBuffer * volatile front = &buffers[0];	// The frame currently being displayed
+static FrameBuffer * volatile back = &buffers[1];	// The frame currently being drawn
+static volatile uint8_t present_pending;	// Set by PresentFrame(), cleared when the buffers get swapped
+
+// A layer of the composited frame, lighting every set cell in one color
+typedef struct Layer_t
+{
+	GridArray bits;
+	Color color;
+} Layer;
+
+// A single cell character drawn over the layers
+typedef struct Sprite_t
+{
+	uint8_t row;
+	uint8_t col;
+	uint8_t visible;
+	Color color;
+} Sprite;
+
+static Layer layers[MATRIX_LAYERS];
+static Sprite sprites[MATRIX_SPRITES];
+
+// Cells whose layers or sprites changed since each buffer was last composed
+static GridArray stale[2];
+
+#if BCM_FRC_BITS > 0
+/**
+ * @brief	Finds the bit-plane the dither slot shows during a frame of
+ * 			the FRC pattern: fraction bit k when the frame number (counting
+ * 			from 1) has BCM_FRC_BITS - 1 - k trailing zeros, or nothing
+ * 			for the last frame of the pattern
+ *
+ * @param	frame The frame of the pattern (0 to 2^BCM_FRC_BITS - 1)
+ *
+ * @retval	The bit-plane
+ */
+static uint8_t FrcPlane(uint8_t frame)
+{
+	uint8_t zeros = COUNT_TRAILING_ZEROS(frame + 1);
 
-// How long each bcm cycle should be (in terms of SYSCLK cycles)
-static const uint32_t bcm_length[] = {
-		240,
-		480,
-		960,
-		1920,
-		3840,
-		7680,
-		15360,
-		30720
- };
+	return (zeros >= BCM_FRC_BITS) ? BCM_DARK_PLANE : BCM_FRC_BITS - 1 - zeros;
+}
+#endif
 
-// Maximum number of binary coded modulation cycles
-static const uint8_t MAX_BCM = 6;
+/**
+ * @brief	Sets up one slot of the BCM schedule
+ *
+ * @param	slot The slot
+ * @param	bcm The BCM cycle shown during it
+ * @param	weight The BCM cycle whose length it's lit for
+ * @param	pass_end 1 if it's the last slot of its pass
+ *
+ * @retval	none
+ */
+static void SetSlot(uint8_t slot, uint8_t bcm, uint8_t weight, uint8_t pass_end)
+{
+	schedule[slot].plane = bcm + BCM_FRC_BITS;	// The fraction bits come first
+	schedule[slot].pass_end = pass_end;
+	schedule[slot].target = (uint32_t)BCM_BASE_TICKS << weight;
+	schedule[slot].length = schedule[slot].target;
+}
 
 /**
  * @brief	Function that initializes the timer and GPIO
@@ -45,6 +183,32 @@ static const uint8_t MAX_BCM = 6;
  */
 void InitMatrixDriver(void)
 {
+	uint8_t bcm;
+
+	// Every BCM cycle is twice as long as the one before it
+#if BCM_ORDER == BCM_ORDER_ROW_MAJOR
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		SetSlot(bcm, bcm, bcm, BCM_FRC_BITS == 0 && bcm == BCM_BITS - 1);
+#elif BCM_ORDER == BCM_ORDER_PLANE_MAJOR
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+		SetSlot(bcm, bcm, bcm, 1);
+#else
+	// The short cycles start off the first pass, then every pass gets one BCM_SPLIT_PLANE long
+	// slot. Which cycle a pass's slot belongs to follows the ruler sequence, so cycle n gets
+	// every 2^(BCM_BITS - 1 - n)th pass, and its slots are evenly spread over the frame.
+	for(bcm = 0; bcm < BCM_SPLIT_PLANE; ++bcm)
+		SetSlot(bcm, bcm, bcm, 0);
+
+	for(bcm = 1; bcm <= BCM_PASSES; ++bcm)
+		SetSlot(BCM_SPLIT_PLANE + bcm - 1, BCM_BITS - 1 - COUNT_TRAILING_ZEROS(bcm), BCM_SPLIT_PLANE, bcm < BCM_PASSES || BCM_FRC_BITS == 0);
+#endif
+
+#if BCM_FRC_BITS > 0
+	// The dither slot is as long as the shortest BCM cycle, and ends the last pass
+	SetSlot(BCM_FRC_SLOT, 0, 0, 1);
+	schedule[BCM_FRC_SLOT].plane = FrcPlane(frc_frame);
+#endif
+
 	// Timer initialization
 	TIMER0_CTL_R &= ~0x1;	// Disable timer
 	TIMER0_CFG_R = 0;		// 32-bit timer
@@ -56,6 +220,15 @@ void InitMatrixDriver(void)
 	// Enable Timer0A interrupt in NVIC
 	NVIC_EN0_R |= 0x80000;
 
+	// Timer2 turns the rows off partway through a slot when the display is dimmed
+	TIMER2_CTL_R &= ~0x1;	// Disable timer
+	TIMER2_CFG_R = 0;		// 32-bit timer
+	TIMER2_TAMR_R |= 0x31;	// Set it to one-shot mode, counting up, interrupt enabled
+	TIMER2_IMR_R |= 0x10;	// Enable timer A match interrupt
+
+	// Enable Timer2A interrupt in NVIC, at the same priority as Timer0A so they never preempt each other
+	NVIC_EN0_R |= 0x800000;
+
 	// Set DATAPORT and CTRLPORT pins as outputs
 	DATAPORT_DIR |= ALL_DATAPORT_PINS;
 	CTRLPORT_DIR |= ALL_CTRLPORT_PINS;
@@ -73,24 +246,58 @@ void InitMatrixDriver(void)
 	CTRLPORT_DEN |= ALL_CTRLPORT_PINS;
 }
 
+// Turns a byte of a frame buffer row pair into its DATAPORT value and clocks it in
+#ifdef MATRIX_INDEXED_COLOR
+#define CLOCK_COLUMN(byte) do { DATAPORT = lut[byte]; CTRLPORT |= SCLK; CTRLPORT &= ~SCLK; } while(0)
+#else
+#define CLOCK_COLUMN(byte) do { DATAPORT = (byte); CTRLPORT |= SCLK; CTRLPORT &= ~SCLK; } while(0)
+#endif
+
+// Which row pair a row is scanned out in, and whether it's lit through RGB1 (the bottom half of its panel)
+#define SCAN_ROW(rownum) ((rownum) % SCAN_ROWS)
+#define IS_BOTTOM_HALF(rownum) (((rownum) % PANEL_ROWS) >= SCAN_ROWS)
+
 /**
-* @brief	Interrupt for Timer0 Subtimer A when it reaches its match value
-*
-* @param 	none
-*
-* @retval 	none
-*/
-void Timer0AInt(void)
+ * @brief	Finds where a pixel goes in its row pair of a frame buffer,
+ * 			which is in the order the chain gets clocked out: the last
+ * 			panel's columns first, and panel 0's columns last.
+ *
+ * @param	rownum The row number of the pixel
+ * @param	colnum The column number of the pixel
+ *
+ * @retval	The pixel's index in the row pair
+ */
+static uint16_t ChainColumn(uint8_t rownum, uint8_t colnum)
 {
-	uint8_t i = 0;
-	int cur_row_other = cur_row + 16;	// The other row that needs to be displayed
+	uint8_t panel = (rownum / PANEL_ROWS) * PANELS_X + colnum / PANEL_COLS;
 
-	// Disable timer
-	TIMER0_CTL_R &= ~0x1;	// Disable timer
+	return (CHAIN_PANELS - 1 - panel) * PANEL_COLS + colnum % PANEL_COLS;
+}
 
-	// Clear interrupt flags
-	TIMER0_ICR_R |= TIMER_ICR_TAMCINT; // Clear the interrupt flag
-	NVIC_UNPEND0_R |= 0x80000;			// Clear interrupt pending flag in NVIC
+/**
+ * @brief	Shows the current slot of the current row pair: turns the
+ * 			rows off, clocks out their bits for the slot's BCM cycle,
+ * 			and turns them back on. Then moves on to the next slot of
+ * 			the pass, or at the end of the pass to the next row pair
+ * 			(and pass, swapping the buffers at the end of a frame).
+ *
+ * @param	none
+ *
+ * @retval	The slot that's now being shown
+ */
+static uint8_t ScanoutSlot(void)
+{
+	const uint8_t shown = cur_slot;
+#ifdef MATRIX_INDEXED_COLOR
+	const uint8_t *data = front->pixels[cur_row];	// Palette indices of both rows being displayed
+	const uint8_t *lut = plane_lut[schedule[shown].plane];	// Their port values for this cycle
+#elif BCM_FRC_BITS > 0
+	const uint8_t plane = schedule[shown].plane;
+	const uint8_t *data = (plane == BCM_DARK_PLANE) ? dark_row : front->planes[plane][cur_row];	// Port values for both rows being displayed
+#else
+	const uint8_t *data = front->planes[schedule[shown].plane][cur_row];	// Port values for both rows being displayed
+#endif
+	const uint8_t *end = data + CHAIN_COLS;
 
 	// Set Demux pins based off of row, and set OE high (turn off display)
 	CTRLPORT |= OE;
@@ -98,182 +305,1222 @@ void Timer0AInt(void)
 	CTRLPORT |= demux_vals[cur_row] & 0xF;
 	// Latch is currently low because pins were cleared
 
+	// The rows that were just turned off were lit since lit_start. The first BCM_SLOTS
+	// slots measured are skipped, they may have started before the measurement did.
+	if(lit_samples != 0)
+	{
+		if(lit_samples <= CALIBRATION_SAMPLES * BCM_SLOTS)
+			lit_total[lit_slot] += CYCLE_COUNT() - lit_start;
+
+		lit_samples--;
+	}
+
 	// Clear dataport values
 	DATAPORT &= ~ALL_DATAPORT_PINS;
 
-	for(i = 0; i < 32; i++)
+	// Clock out every panel of the chain, 8 columns at a time (CHAIN_COLS is a multiple of 32)
+	for(; data != end; data += 8)
 	{
-		DATAPORT = 	(((matrix[cur_row][i].R >> cur_bcm_cycle) & 1) << R0S) |
-					(((matrix[cur_row][i].G >> cur_bcm_cycle) & 1) << G0S) |
-					(((matrix[cur_row][i].B >> cur_bcm_cycle) & 1) << B0S) |
-					(((matrix[cur_row_other][i].R >> cur_bcm_cycle) & 1) << R1S) |
-					(((matrix[cur_row_other][i].G >> cur_bcm_cycle) & 1) << G1S) |
-					(((matrix[cur_row_other][i].B >> cur_bcm_cycle) & 1) << B1S);
-
-		CTRLPORT |= SCLK;
-		CTRLPORT &= ~SCLK;
+		CLOCK_COLUMN(data[0]);
+		CLOCK_COLUMN(data[1]);
+		CLOCK_COLUMN(data[2]);
+		CLOCK_COLUMN(data[3]);
+		CLOCK_COLUMN(data[4]);
+		CLOCK_COLUMN(data[5]);
+		CLOCK_COLUMN(data[6]);
+		CLOCK_COLUMN(data[7]);
 	}
 
 	// Strobe the latch signal
 	CTRLPORT |= LATCH;
 	CTRLPORT &= ~LATCH;
 
-	// Clear the OE, aka, turn these two rows on
-	CTRLPORT &= ~OE;
+	// Clear the OE, aka, turn these two rows on (unless the display is turned all the way down)
+	if(brightness != 0)
+		CTRLPORT &= ~OE;
+	lit_start = CYCLE_COUNT();
+	lit_slot = shown;
+
+	// Increment the slot, and if at the end of the pass, proceed to drawing the next row
+	if(schedule[shown].pass_end)
+	{
+		if(cur_row == SCAN_ROWS - 1)
+		{
+			cur_row = 0;
+
+			// Every row has been through this pass, start the next one
+			if(shown == BCM_SLOTS - 1)
+			{
+				cur_slot = 0;
+
+#if BCM_FRC_BITS > 0
+				// The next frame's dither slot shows the next step of the pattern
+				frc_frame = (frc_frame + 1) & ((1 << BCM_FRC_BITS) - 1);
+				schedule[BCM_FRC_SLOT].plane = FrcPlane(frc_frame);
+#endif
+
+				// The whole frame has been displayed, so this is the only safe time to swap buffers
+				if(present_pending)
+				{
+					FrameBuffer *displayed = front;
+#ifdef MATRIX_INDEXED_COLOR
+					uint16_t displayed_palette = palette_front;
+#endif
+					front = back;
+					back = displayed;
+#ifdef MATRIX_INDEXED_COLOR
+					palette_front = palette_back;
+					palette_back = displayed_palette;
+#endif
+					present_pending = 0;
+					PostEvent(EVENT_FRAME_PRESENTED);
+				}
+			}
+			else
+				cur_slot++;
+
+			pass_start = cur_slot;
+		}
+		else
+		{
+			cur_row++;
+			cur_slot = pass_start;
+		}
+	}
+	else
+		cur_slot++;
+
+	return shown;
+}
+
+/**
+ * @brief	Finds how long into a dimmed slot the rows get turned off
+ *
+ * @param	slot The slot
+ *
+ * @retval	The time (in SYSCLK cycles, like the slot's length)
+ */
+static uint32_t DimmedLength(uint8_t slot)
+{
+	return (schedule[slot].length > schedule[slot].dark) ? schedule[slot].length - schedule[slot].dark : 1;
+}
+
+/**
+* @brief	Interrupt for Timer0 Subtimer A when it reaches its match value
+*
+* @param 	none
+*
+* @retval 	none
+*/
+void Timer0AInt(void)
+{
+	PROFILE_ISR_ENTER();
+
+	uint8_t slot;
+
+	// Disable timer
+	TIMER0_CTL_R &= ~0x1;	// Disable timer
+
+	// Clear interrupt flags
+	TIMER0_ICR_R |= TIMER_ICR_TAMCINT; // Clear the interrupt flag
+	NVIC_UNPEND0_R |= 0x80000;			// Clear interrupt pending flag in NVIC
+
+	// If the rows weren't turned off early yet (a slot too short to dim), don't let Timer2A turn off the next ones
+	TIMER2_CTL_R &= ~0x1;
+	TIMER2_ICR_R |= TIMER_ICR_TAMCINT;
+	NVIC_UNPEND0_R |= 0x800000;
+
+#if BCM_POLLED_PLANES > 0
+	// The polled BCM cycles are too short to be worth an interrupt each, so they're
+	// shown back to back, waiting out each one on the cycle counter
+	for(slot = ScanoutSlot(); slot < BCM_POLLED_PLANES; slot = ScanoutSlot())
+	{
+		// Dimmed, the rows get turned off early but the slot still lasts as long
+		if(schedule[slot].dark != 0)
+		{
+			while(CYCLE_COUNT() - lit_start < DimmedLength(slot));
+			CTRLPORT |= OE;
+		}
+
+		while(CYCLE_COUNT() - lit_start < schedule[slot].length);
+	}
+#else
+	slot = ScanoutSlot();
+#endif
 
 	// Set the period for the next binary coded modulation cycle
 	TIMER0_TAV_R = 0;
-	TIMER0_TAILR_R = bcm_length[cur_bcm_cycle];
-	TIMER0_TAMATCHR_R = bcm_length[cur_bcm_cycle];
+	TIMER0_TAILR_R = schedule[slot].length;
+	TIMER0_TAMATCHR_R = schedule[slot].length;
 
 	// Enable timer
 	TIMER0_CTL_R |= 0x1;
 
-	// Increment binary coded modulation cycle, and if at the end, proceed to drawing the next row
-	if(cur_bcm_cycle >= MAX_BCM)
+	// When dimmed, Timer2A turns the rows off before the slot is over
+	if(schedule[slot].dark != 0)
 	{
-		if(cur_row == 15)
-			cur_row = 0;
+		// Sooner than an interrupt could get there, the rows get turned off by waiting here
+		if(schedule[slot].target - schedule[slot].dark < BCM_POLL_CYCLES)
+		{
+			while(CYCLE_COUNT() - lit_start < schedule[slot].target - schedule[slot].dark);
+			CTRLPORT |= OE;
+		}
 		else
-			cur_row++;
-
-		cur_bcm_cycle = 0;
+		{
+			TIMER2_TAV_R = 0;
+			TIMER2_TAILR_R = DimmedLength(slot);
+			TIMER2_TAMATCHR_R = DimmedLength(slot);
+			TIMER2_CTL_R |= 0x1;
+		}
 	}
-	else
-		cur_bcm_cycle++;
+
+	// Taking longer than the slot it just started means the rows spend more time dark than lit
+	PROFILE_ISR_EXIT(PROFILE_TIMER0A, schedule[slot].length);
 }
 
 /**
- * @brief	Sets the current drawing color
+ * @brief	Runs the refresh interrupt through one whole frame (every BCM
+ * 			cycle of every row pair, including the waits for polled
+ * 			cycles), to time it, then puts the refresh back where it was:
+ * 			same row, slot, and dither step, and no buffers swapped or lit
+ * 			times measured. Call it with interrupts masked.
  *
- * @param	r The red component of the drawing color
- * @param	g The green component of the drawing color
- * @param	b The blue component of the drawing color
+ * @param	none
  *
  * @retval	none
  */
-void SetColor(uint8_t r, uint8_t g, uint8_t b)
+void ScanoutFrame(void)
 {
-	Color new_color = {r, g, b};
-	cur_draw_color = new_color;
+	uint8_t row = cur_row, slot = cur_slot, start = pass_start, shown = lit_slot;
+	uint8_t pending = present_pending;
+	uint16_t samples = lit_samples;
+	uint32_t lit = lit_start;
+	uint16_t i;
+#if BCM_FRC_BITS > 0
+	uint8_t frame = frc_frame;
+	uint8_t frc_plane = schedule[BCM_FRC_SLOT].plane;
+#endif
+
+	present_pending = 0;
+	lit_samples = 0;
+
+	for(i = 0; i < BCM_ISRS_PER_FRAME; ++i)
+		Timer0AInt();
+
+	cur_row = row;
+	cur_slot = slot;
+	pass_start = start;
+	lit_slot = shown;
+	lit_start = lit;
+	lit_samples = samples;
+	present_pending = pending;
+#if BCM_FRC_BITS > 0
+	frc_frame = frame;
+	schedule[BCM_FRC_SLOT].plane = frc_plane;
+#endif
 }
 
 /**
- * @brief	Clears every pixel on the display
+* @brief	Interrupt for Timer2 Subtimer A when it reaches its match value,
+* 			turns the rows off early to dim the display
+*
+* @param 	none
+*
+* @retval 	none
+*/
+void Timer2AInt(void)
+{
+	// Set OE high (turn off display)
+	CTRLPORT |= OE;
+
+	// Clear interrupt flags (the timer stops by itself in one-shot mode)
+	TIMER2_ICR_R |= TIMER_ICR_TAMCINT;	// Clear the interrupt flag
+	NVIC_UNPEND0_R |= 0x800000;			// Clear interrupt pending flag in NVIC
+}
+
+/**
+ * @brief	Sets the brightness of the whole display by turning the rows
+ * 			off early in every slot, so every BCM cycle (and so every
+ * 			color) keeps its share of the light, without touching the
+ * 			frame buffers. Takes effect within a frame.
  *
- * @param 	none
+ * @param	level The brightness, from 0 (off) to BRIGHTNESS_MAX (full)
  *
- * @retval 	none
+ * @retval	none
  */
-void ClearMatrix()
+void SetBrightness(uint8_t level)
 {
-	memset(matrix, 0, sizeof(matrix));
+	uint8_t slot;
+
+	brightness = level;
+
+	for(slot = 0; slot < BCM_SLOTS; ++slot)
+		schedule[slot].dark = (schedule[slot].target * (BRIGHTNESS_MAX - level) + BRIGHTNESS_MAX / 2) / BRIGHTNESS_MAX;
 }
 
 /**
- * @brief	Draws a solid color to every pixel on the display
+ * @brief	Gets the brightness of the whole display
  *
- * 			If you want to clear (turn off) every pixel,
- * 			use the ClearMatrix() function, it's more optimized
- * 			for clearing every pixel.
+ * @param	none
  *
- * 	@param	none
+ * @retval	The brightness, from 0 (off) to BRIGHTNESS_MAX (full)
+ */
+uint8_t GetBrightness(void)
+{
+	return brightness;
+}
+
+/**
+ * @brief	Measures how long the rows actually stay lit during each slot
+ * 			of the schedule, CALIBRATION_SAMPLES times (whole frames) each.
+ * 			Besides the timer period (or the wait, for polled slots), the
+ * 			rows stay lit while the refresh interrupt starts the timer, and
+ * 			while the next one gets going and turns them off. The display
+ * 			has to be running. Leaves the totals in lit_total.
  *
- * 	@retval none
+ * @param	none
+ *
+ * @retval	none
  */
-void DrawSolidColor()
+static void MeasureSlots(void)
 {
-	int row = 0, col = 0;
+	uint8_t level = brightness;
 
-	for (; row < MAX_ROWS; ++row)
-	{
-		for (col = 0; col < MAX_COLS; ++col)
-			matrix[row][col] = cur_draw_color;
-	}
+	// A dimmed slot's rows go dark before the slot is over, so measure at full brightness
+	SetBrightness(BRIGHTNESS_MAX);
+	memset(lit_total, 0, sizeof(lit_total));
+
+	lit_samples = (CALIBRATION_SAMPLES + 1) * BCM_SLOTS;
+	while(lit_samples != 0)
+		WAIT_FOR_INTERRUPT();
+
+	SetBrightness(level);
 }
 
 /**
- * @brief	Sets a line (straight along a row) to a certain color
+ * @brief	Measures how long a row pair actually stays lit for each BCM
+ * 			cycle in a frame (adding up every slot of the cycle)
  *
- * @param 	rownum 	The row number (0 to MAX_ROWS - 1). If this number is above
- * 					MAX_ROWS - 1, the result is undefined.
+ * @param	lit Where to store the lit time of every BCM cycle (in SYSCLK cycles)
  *
- * @param	startcol The column number (0 to MAX_COLS - 1) to start at. If this
- * 					 number is above MAX_COLS - 1, the result is undefined
+ * @retval	none
+ */
+void MeasureLitTimes(uint32_t lit[BCM_BITS])
+{
+	uint8_t slot;
+
+	MeasureSlots();
+
+	memset(lit, 0, BCM_BITS * sizeof(lit[0]));
+
+	// The dither slot doesn't belong to any BCM cycle
+	for(slot = 0; slot < BCM_SLOTS - BCM_FRC_SLOTS; ++slot)
+		lit[schedule[slot].plane - BCM_FRC_BITS] += (lit_total[slot] + CALIBRATION_SAMPLES / 2) / CALIBRATION_SAMPLES;
+}
+
+/**
+ * @brief	Adjusts the timer period of every slot so the rows stay lit
+ * 			for exactly as long as they should (BCM_BASE_TICKS << bcm in
+ * 			total for each BCM cycle). The time the rows are lit outside
+ * 			of the timer period is the same for every slot, so without
+ * 			this the short cycles are too bright compared to the long
+ * 			ones, which distorts dim colors.
  *
- * @param	length The number of pixels to set after startcol. If this number
- * 				   is above MAX_COLS - startcol - 1, the result is undefined
+ * 			Starts over from the uncalibrated periods, so the result
+ * 			doesn't depend on any earlier calibration.
  *
- * @retval none
+ * @param	lit_before Where to store the lit times of every BCM cycle before calibrating (can be NULL)
+ *
+ * @retval	none
  */
-void DrawRowLine(uint8_t rownum, uint8_t startcol, uint8_t length)
+void CalibrateMatrix(uint32_t lit_before[BCM_BITS])
 {
-	int curcol = 0;
+	uint32_t lit;
+	int32_t length;
+	uint8_t slot;
 
-	for(; curcol < length; curcol++)
+	for(slot = 0; slot < BCM_SLOTS; ++slot)
+		schedule[slot].length = schedule[slot].target;
+
+	MeasureSlots();
+
+	if(lit_before != NULL)
+		memset(lit_before, 0, BCM_BITS * sizeof(lit_before[0]));
+
+	for(slot = 0; slot < BCM_SLOTS; ++slot)
 	{
-		matrix[rownum][startcol + curcol] = cur_draw_color;
+		lit = (lit_total[slot] + CALIBRATION_SAMPLES / 2) / CALIBRATION_SAMPLES;
+
+		// The extra lit time doesn't depend on the period, so take it off of the period
+		length = (int32_t)schedule[slot].target - (int32_t)(lit - schedule[slot].target);
+		schedule[slot].length = (length < 1) ? 1 : (uint32_t)length;
+
+		if(lit_before != NULL && slot < BCM_SLOTS - BCM_FRC_SLOTS)
+			lit_before[schedule[slot].plane - BCM_FRC_BITS] += lit;
 	}
 }
 
 /**
- * @brief	Sets a line (straight along a column) to a certain color
- *
- * @param 	colnum 		The column number (0 to MAX_COLS - 1). If this number is above
- * 						MAX_COLS - 1, the result is undefined.
- *
- * @param	startrow 	The row number (0 to MAX_ROWS - 1) to start at. If this
- * 					 	number is above MAX_ROWS - 1, the result is undefined
+ * @brief	Models the longest time a row goes dark between two slots of
+ * 			a BCM cycle, for a pixel with only that bit set. Every slot is
+ * 			taken to last its timer period plus SCANOUT_CYCLES. Every row
+ * 			pair goes through the same schedule, so row pair 0 stands in
+ * 			for all of them.
  *
- * @param	length 		The number of pixels to set after startrow. If this number
- * 				   		is above MAX_ROWS - startrow - 1, the result is undefined
+ * @param	bcm The BCM cycle, or BCM_BITS for a pixel with every bit set
  *
- * @retval none
+ * @retval	The longest dark time in SYSCLK cycles
  */
-void DrawColumnLine(uint8_t colnum, uint8_t startrow, uint8_t length)
+uint32_t EmissionGap(uint8_t bcm)
 {
-	int currow = 0;
+	uint32_t now = 0, last_end = 0, gap = 0;
+	uint8_t frame, pass, row, slot;
+	uint8_t seen = 0;
 
-	for(; currow < length; currow++)
+	// Go through two frames, so the gap that wraps around the end of a frame counts too
+	for(frame = 0; frame < 2; ++frame)
 	{
-		matrix[startrow + currow][colnum] = cur_draw_color;
+		for(pass = 0; pass < BCM_SLOTS; pass = slot)
+		{
+			for(row = 0; row < SCAN_ROWS; ++row)
+			{
+				slot = pass;
+
+				do
+				{
+					now += SCANOUT_CYCLES;
+
+					if(row == 0 && (bcm == BCM_BITS || schedule[slot].plane == bcm + BCM_FRC_BITS))
+					{
+						if(seen && now - last_end > gap)
+							gap = now - last_end;
+
+						seen = 1;
+						last_end = now + schedule[slot].length;
+					}
+
+					now += schedule[slot].length;
+				} while(!schedule[slot++].pass_end);
+			}
+		}
 	}
+
+	return gap;
 }
 
+#ifdef MATRIX_INDEXED_COLOR
 /**
- * @brief	Sets a pixel to the passed in color
- *
- * @param	color The color to change the pixel to
+ * @brief	Gets the DATAPORT bits of a color for one BCM cycle
  *
- * @param	rownum The row number of the pixel
- *
- * @param	colnum The column number of the pixel
+ * @param	color The color
+ * @param	bcm The BCM cycle (which bit of the color)
+ * @param	bottom 1 to get the bits for the bottom half of the display
  *
- * @retval	none
+ * @retval	The color's bits, shifted onto the RGB0 or RGB1 pins
  */
-void DrawPixel(uint8_t rownum, uint8_t colnum)
+static uint8_t PlaneBits(Color color, uint8_t bcm, uint8_t bottom)
 {
-	matrix[rownum][colnum] = cur_draw_color;
+	if(bottom)
+		return (((color.R >> bcm) & 1) << R1S) |
+			(((color.G >> bcm) & 1) << G1S) |
+			(((color.B >> bcm) & 1) << B1S);
+
+	return (((color.R >> bcm) & 1) << R0S) |
+		(((color.G >> bcm) & 1) << G0S) |
+		(((color.B >> bcm) & 1) << B0S);
 }
 
 /**
- *  @brief	Draws an array of bits (if bit is zero, dont display, if one, display color)
+ * @brief	Sets a palette entry and rebuilds every pixel pair in the
+ * 			lookup tables that uses it
  *
- *  @param 	array The 32bit by 32bit array to draw from
- *  @param 	color The color to make each "one" bit in the array
+ * @param	index The palette index
+ * @param	color The new color
  *
- *  @retval none
+ * @retval	none
  */
-void DrawGridArray(GridArray array)
+static void WritePalette(uint8_t index, Color color)
 {
-	uint8_t row, col;
+	uint8_t bcm, other;
+	uint8_t *lut;
+
+	palette[index] = color;
 
-	for(row = 0; row < 32; ++row)
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
 	{
-		for(col = 0; col < 32; ++col)
+		lut = plane_lut[bcm];
+
+		for(other = 0; other < MATRIX_PALETTE_SIZE; ++other)
 		{
-			if(GET_GRIDARRAY_BIT(array, row, col) == 1)
-				matrix[row][col] = cur_draw_color;
+			lut[index | (other << 4)] = PlaneBits(color, bcm, 0) | PlaneBits(palette[other], bcm, 1);
+			lut[other | (index << 4)] = PlaneBits(palette[other], bcm, 0) | PlaneBits(color, bcm, 1);
 		}
 	}
 }
+
+/**
+ * @brief	Sets a pixel in the back buffer
+ *
+ * @param	rownum The row number of the pixel
+ * @param	colnum The column number of the pixel
+ * @param	index The palette index to change the pixel to
+ *
+ * @retval	none
+ */
+static void WritePixel(uint8_t rownum, uint8_t colnum, PixelValue index)
+{
+	uint8_t *pair = &back->pixels[SCAN_ROW(rownum)][ChainColumn(rownum, colnum)];
+
+	// The bottom half of each panel is kept in the high nibble
+	if(IS_BOTTOM_HALF(rownum))
+		*pair = (*pair & 0x0F) | (index << 4);
+	else
+		*pair = (*pair & 0xF0) | index;
+}
+
+/**
+ * @brief	Sets a run of pixels along a row in the back buffer to the
+ * 			current drawing color. The run has to stay on one panel, so
+ * 			its pixels are next to each other.
+ *
+ * @param	rownum The row number of the pixels
+ * @param	colnum The column number of the first pixel
+ * @param	length The number of pixels
+ *
+ * @retval	none
+ */
+static void WriteRun(uint8_t rownum, uint8_t colnum, uint8_t length)
+{
+	uint8_t *pair = &back->pixels[SCAN_ROW(rownum)][ChainColumn(rownum, colnum)];
+	uint8_t *end = pair + length;
+	uint8_t keep = 0xF0, value = cur_draw_color;
+
+	// The bottom half of each panel is kept in the high nibble
+	if(IS_BOTTOM_HALF(rownum))
+	{
+		keep = 0x0F;
+		value = cur_draw_color << 4;
+	}
+
+	for(; pair != end; ++pair)
+		*pair = (*pair & keep) | value;
+}
+
+/**
+ * @brief	Gets a pixel of a frame
+ *
+ * @param	frame The frame to read from
+ * @param	rownum The row number of the pixel
+ * @param	colnum The column number of the pixel
+ *
+ * @retval	The palette index of the pixel
+ */
+static PixelValue ReadPixel(const FrameBuffer *frame, uint8_t rownum, uint8_t colnum)
+{
+	uint8_t pair = frame->pixels[SCAN_ROW(rownum)][ChainColumn(rownum, colnum)];
+
+	return IS_BOTTOM_HALF(rownum) ? (pair >> 4) : (pair & 0x0F);
+}
+
+/**
+ * @brief	Finds the palette entry for a color. Colors that aren't in the
+ * 			palette get an entry no pixel of either buffer uses, or the
+ * 			closest entry if there's none.
+ *
+ * @param	color The color to look for
+ *
+ * @retval	The palette index to draw the color with
+ */
+static uint8_t FindPaletteIndex(Color color)
+{
+	uint8_t index, closest = 0;
+	int16_t dr, dg, db;
+	uint32_t distance, closest_distance = 0xFFFFFFFF;
+	uint16_t in_use = palette_front | palette_back | palette_pinned;
+
+	for(index = 0; index < MATRIX_PALETTE_SIZE; ++index)
+	{
+		dr = (int16_t)palette[index].R - color.R;
+		dg = (int16_t)palette[index].G - color.G;
+		db = (int16_t)palette[index].B - color.B;
+		distance = dr * dr + dg * dg + db * db;
+
+		if(distance == 0)
+			break;
+
+		if(distance < closest_distance && (in_use & (1 << index)))
+		{
+			closest_distance = distance;
+			closest = index;
+		}
+	}
+
+	if(index == MATRIX_PALETTE_SIZE)
+	{
+		index = closest;
+
+		if(in_use != 0xFFFF)
+		{
+			index = COUNT_TRAILING_ZEROS((uint32_t)(uint16_t)~in_use);
+			WritePalette(index, color);
+		}
+	}
+
+	palette_back |= 1 << index;
+	return index;
+}
+
+/**
+ * @brief	Changes a palette entry. Every pixel drawn with it changes
+ * 			color on the next refresh, in both buffers.
+ *
+ * @param	index The palette index (0 to MATRIX_PALETTE_SIZE - 1)
+ * @param	r The red component of the new color
+ * @param	g The green component of the new color
+ * @param	b The blue component of the new color
+ *
+ * @retval	none
+ */
+void SetPaletteColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b)
+{
+	Color color = {r, g, b};
+
+	if(index >= MATRIX_PALETTE_SIZE)
+		return;
+
+	WritePalette(index, color);
+
+	// SetColor() shouldn't hand out an entry that's already being used
+	palette_pinned |= 1 << index;
+}
+
+/**
+ * @brief	Sets the current drawing color to a palette entry
+ *
+ * @param	index The palette index (0 to MATRIX_PALETTE_SIZE - 1)
+ *
+ * @retval	none
+ */
+void SetColorIndex(uint8_t index)
+{
+	if(index < MATRIX_PALETTE_SIZE)
+	{
+		cur_draw_color = index;
+		palette_back |= 1 << index;
+	}
+}
+
+/**
+ * @brief	Sets the current drawing color
+ *
+ * 			The color is looked up in the palette (see FindPaletteIndex()).
+ *
+ * @param	r The red component of the drawing color
+ * @param	g The green component of the drawing color
+ * @param	b The blue component of the drawing color
+ *
+ * @retval	none
+ */
+void SetColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	Color new_color = {r, g, b};
+	cur_draw_color = FindPaletteIndex(new_color);
+}
+#else
+/**
+ * @brief	Sets a pixel in the back buffer and updates its bits in every bit-plane
+ *
+ * @param	rownum The row number of the pixel
+ * @param	colnum The column number of the pixel
+ * @param	color The color to change the pixel to
+ *
+ * @retval	none
+ */
+static void WritePixel(uint8_t rownum, uint8_t colnum, Color color)
+{
+	uint8_t bcm;
+	uint8_t rs = R0S, gs = G0S, bs = B0S;
+	uint8_t mask = R0 | G0 | B0;
+	uint8_t *plane_byte = &back->planes[0][SCAN_ROW(rownum)][ChainColumn(rownum, colnum)];
+
+	// The bottom half of each panel is clocked out on the RGB1 pins
+	if(IS_BOTTOM_HALF(rownum))
+	{
+		rs = R1S;
+		gs = G1S;
+		bs = B1S;
+		mask = R1 | G1 | B1;
+	}
+
+	back->matrix[rownum][colnum] = color;
+
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
+	{
+		*plane_byte = (*plane_byte & ~mask) |
+					(((color.R >> bcm) & 1) << rs) |
+					(((color.G >> bcm) & 1) << gs) |
+					(((color.B >> bcm) & 1) << bs);
+
+		plane_byte += sizeof(back->planes[0]);
+	}
+}
+
+/**
+ * @brief	Sets a run of pixels along a row in the back buffer to the
+ * 			current drawing color, filling their bits in each bit-plane with
+ * 			the color's bits (see SetColor()). The run has to stay on one
+ * 			panel, so its pixels are next to each other.
+ *
+ * @param	rownum The row number of the pixels
+ * @param	colnum The column number of the first pixel
+ * @param	length The number of pixels
+ *
+ * @retval	none
+ */
+static void WriteRun(uint8_t rownum, uint8_t colnum, uint8_t length)
+{
+	uint8_t bcm, i, bits;
+	uint8_t mask = R0 | G0 | B0;
+	uint8_t *plane_run = &back->planes[0][SCAN_ROW(rownum)][ChainColumn(rownum, colnum)];
+	Color *pixel = &back->matrix[rownum][colnum];
+
+	// The bottom half of each panel is clocked out on the RGB1 pins
+	if(IS_BOTTOM_HALF(rownum))
+		mask = R1 | G1 | B1;
+
+	for(i = 0; i < length; ++i)
+		pixel[i] = cur_draw_color;
+
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
+	{
+		bits = cur_draw_bits[bcm] & mask;
+
+		for(i = 0; i < length; ++i)
+			plane_run[i] = (plane_run[i] & ~mask) | bits;
+
+		plane_run += sizeof(back->planes[0]);
+	}
+}
+
+/**
+ * @brief	Gets a pixel of a frame
+ *
+ * @param	frame The frame to read from
+ * @param	rownum The row number of the pixel
+ * @param	colnum The column number of the pixel
+ *
+ * @retval	The color of the pixel
+ */
+static PixelValue ReadPixel(const FrameBuffer *frame, uint8_t rownum, uint8_t colnum)
+{
+	return frame->matrix[rownum][colnum];
+}
+
+/**
+ * @brief	Sets the current drawing color
+ *
+ * @param	r The red component of the drawing color
+ * @param	g The green component of the drawing color
+ * @param	b The blue component of the drawing color
+ *
+ * @retval	none
+ */
+void SetColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	Color new_color = {r, g, b};
+	uint8_t bcm;
+
+	cur_draw_color = new_color;
+
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
+	{
+		cur_draw_bits[bcm] =
+			(((r >> bcm) & 1) << R0S) |
+			(((g >> bcm) & 1) << G0S) |
+			(((b >> bcm) & 1) << B0S) |
+			(((r >> bcm) & 1) << R1S) |
+			(((g >> bcm) & 1) << G1S) |
+			(((b >> bcm) & 1) << B1S);
+	}
+}
+#endif
+
+/**
+ * @brief	Clears every pixel on the display
+ *
+ * @param 	none
+ *
+ * @retval 	none
+ */
+void ClearMatrix()
+{
+	memset(back, 0, sizeof(*back));
+
+#ifdef MATRIX_INDEXED_COLOR
+	// The other palette entries are free again, as far as this buffer goes
+	palette_back = 1;
+#endif
+}
+
+/**
+ * @brief	Draws a solid color to every pixel on the display
+ *
+ * 			If you want to clear (turn off) every pixel,
+ * 			use the ClearMatrix() function, it's more optimized
+ * 			for clearing every pixel.
+ *
+ * 	@param	none
+ *
+ * 	@retval none
+ */
+void DrawSolidColor()
+{
+#ifdef MATRIX_INDEXED_COLOR
+	memset(back->pixels, cur_draw_color | (cur_draw_color << 4), sizeof(back->pixels));
+	palette_back = 1 << cur_draw_color;
+#else
+	int row = 0, col = 0;
+	uint8_t bcm;
+
+	for (; row < MAX_ROWS; ++row)
+	{
+		for (col = 0; col < MAX_COLS; ++col)
+			back->matrix[row][col] = cur_draw_color;
+	}
+
+	// Every byte of a bit-plane is the same, so just fill each plane
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
+		memset(back->planes[bcm], cur_draw_bits[bcm], sizeof(back->planes[bcm]));
+#endif
+}
+
+/**
+ * @brief	Sets a line (straight along a row) to a certain color
+ *
+ * @param 	rownum 	The row number (0 to MAX_ROWS - 1). If this number is above
+ * 					MAX_ROWS - 1, the result is undefined.
+ *
+ * @param	startcol The column number (0 to MAX_COLS - 1) to start at. If this
+ * 					 number is above MAX_COLS - 1, the result is undefined
+ *
+ * @param	length The number of pixels to set after startcol. If this number
+ * 				   is above MAX_COLS - startcol - 1, the result is undefined
+ *
+ * @retval none
+ */
+void DrawRowLine(uint8_t rownum, uint8_t startcol, uint8_t length)
+{
+	uint8_t run;
+
+	// The pixels of a row are next to each other in the frame buffer as long as they're on the same panel
+	while(length != 0)
+	{
+		run = PANEL_COLS - startcol % PANEL_COLS;
+
+		if(run > length)
+			run = length;
+
+		WriteRun(rownum, startcol, run);
+		startcol += run;
+		length -= run;
+	}
+}
+
+/**
+ * @brief	Sets a line (straight along a column) to a certain color
+ *
+ * @param 	colnum 		The column number (0 to MAX_COLS - 1). If this number is above
+ * 						MAX_COLS - 1, the result is undefined.
+ *
+ * @param	startrow 	The row number (0 to MAX_ROWS - 1) to start at. If this
+ * 					 	number is above MAX_ROWS - 1, the result is undefined
+ *
+ * @param	length 		The number of pixels to set after startrow. If this number
+ * 				   		is above MAX_ROWS - startrow - 1, the result is undefined
+ *
+ * @retval none
+ */
+void DrawColumnLine(uint8_t colnum, uint8_t startrow, uint8_t length)
+{
+	int currow = 0;
+
+	for(; currow < length; currow++)
+	{
+		WritePixel(startrow + currow, colnum, cur_draw_color);
+	}
+}
+
+/**
+ * @brief	Sets a pixel to the passed in color
+ *
+ * @param	color The color to change the pixel to
+ *
+ * @param	rownum The row number of the pixel
+ *
+ * @param	colnum The column number of the pixel
+ *
+ * @retval	none
+ */
+void DrawPixel(uint8_t rownum, uint8_t colnum)
+{
+	WritePixel(rownum, colnum, cur_draw_color);
+}
+
+/**
+ * @brief	Draws the set bits of one row of a GridArray by scanning for runs
+ * 			of ones, so empty rows cost nothing and every run gets filled in
+ * 			as one line (see DrawRowLine()).
+ *
+ * @param	rownum The row to draw to
+ * @param	bits The bits of the row (bit n is column n)
+ *
+ * @retval	none
+ */
+static void DrawGridRow(uint8_t rownum, GridRow bits)
+{
+	uint8_t startcol, length;
+	GridRow run;
+
+	while(bits != 0)
+	{
+		startcol = GRIDROW_CTZ(bits);
+		run = bits >> startcol;
+
+		// The run either ends at the first zero bit, or at the edge of the row
+		if(~run == 0)
+			length = MAX_COLS - startcol;
+		else
+			length = GRIDROW_CTZ(~run);
+
+		DrawRowLine(rownum, startcol, length);
+
+		if(startcol + length >= MAX_COLS)
+			bits = 0;
+		else
+			bits &= ~((((GridRow)1 << length) - 1) << startcol);
+	}
+}
+
+/**
+ *  @brief	Draws an array of bits (if bit is zero, dont display, if one, display color)
+ *
+ *  @param 	array The 32bit by 32bit array to draw from
+ *
+ *  @retval none
+ */
+void DrawGridArray(GridArray array)
+{
+	uint8_t row;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		DrawGridRow(row, array[row]);
+}
+
+/**
+ *  @brief	Draws only the bits of an array that are also set in a mask.
+ *  		Useful for redrawing just the parts of a frame that changed.
+ *
+ *  @param 	array The 32bit by 32bit array to draw from
+ *  @param 	mask Which bits of the array to draw
+ *
+ *  @retval none
+ */
+void DrawGridArrayMasked(GridArray array, GridArray mask)
+{
+	uint8_t row;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		DrawGridRow(row, array[row] & mask[row]);
+}
+
+/**
+ *  @brief	Copies pixels from the frame being displayed into the back buffer.
+ *  		Used to bring the cells that changed in the last frame up to date
+ *  		in the back buffer without redrawing the whole frame.
+ *
+ *  		Only call this while no frame is pending (see FramePending()).
+ *
+ *  @param 	mask Which pixels to copy
+ *
+ *  @retval none
+ */
+void CopyFrontPixels(GridArray mask)
+{
+	uint8_t row;
+	GridRow bits;
+	uint8_t col;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(bits = mask[row]; bits != 0; bits &= bits - 1)
+		{
+			col = GRIDROW_CTZ(bits);
+			WritePixel(row, col, ReadPixel(front, row, col));
+		}
+	}
+
+#ifdef MATRIX_INDEXED_COLOR
+	palette_back |= palette_front;
+#endif
+}
+
+/**
+ *  @brief	Gets the color a pixel is actually being displayed in, decoded
+ *  		from the port values the refresh interrupt clocks out for every
+ *  		BCM cycle (so it shows what the scanout shows, not what was drawn)
+ *
+ *  @param 	rownum The row number of the pixel
+ *  @param 	colnum The column number of the pixel
+ *
+ *  @retval The pixel's color
+ */
+Color GetDisplayedPixel(uint8_t rownum, uint8_t colnum)
+{
+	Color color = {0, 0, 0};
+	uint8_t bcm, port;
+	uint8_t rs = R0S, gs = G0S, bs = B0S;
+	const FrameBuffer *frame = front;
+	uint8_t scan_row = SCAN_ROW(rownum);
+	uint16_t chain_col = ChainColumn(rownum, colnum);
+
+	if(IS_BOTTOM_HALF(rownum))
+	{
+		rs = R1S;
+		gs = G1S;
+		bs = B1S;
+	}
+
+	for(bcm = 0; bcm < COLOR_BITS; ++bcm)
+	{
+#ifdef MATRIX_INDEXED_COLOR
+		port = plane_lut[bcm][frame->pixels[scan_row][chain_col]];
+#else
+		port = frame->planes[bcm][scan_row][chain_col];
+#endif
+
+		color.R |= ((port >> rs) & 1) << bcm;
+		color.G |= ((port >> gs) & 1) << bcm;
+		color.B |= ((port >> bs) & 1) << bcm;
+	}
+
+	return color;
+}
+
+/**
+ * @brief	Requests that the back buffer be shown on the display.
+ *
+ * 			The buffers are swapped by the refresh interrupt once it
+ * 			finishes displaying the current frame, so this never blocks.
+ * 			Until that happens (see FramePending()), the back buffer is
+ * 			still the one being drawn to. After the swap, the back buffer
+ * 			contains the frame that was displayed before this one.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void PresentFrame(void)
+{
+	present_pending = 1;
+}
+
+/**
+ * @brief	Checks whether a frame passed to PresentFrame() is still
+ * 			waiting to be displayed
+ *
+ * @param	none
+ *
+ * @retval	1 if the buffers haven't been swapped yet, 0 otherwise
+ */
+uint8_t FramePending(void)
+{
+	return present_pending;
+}
+
+/**
+ * @brief	Marks a cell as out of date in both buffers
+ *
+ * @param	rownum The row of the cell
+ * @param	colnum The column of the cell
+ *
+ * @retval	none
+ */
+static void MarkStale(uint8_t rownum, uint8_t colnum)
+{
+	stale[0][rownum] |= (GridRow)1 << colnum;
+	stale[1][rownum] |= (GridRow)1 << colnum;
+}
+
+/**
+ * @brief	Sets which cells of a layer are lit, and their color.
+ * 			Meant for things that rarely change, like the walls of a level.
+ *
+ * @param	layer Which layer (0 to MATRIX_LAYERS - 1)
+ * @param	bits The cells to light
+ * @param	color The color to light them in
+ *
+ * @retval	none
+ */
+void SetLayer(uint8_t layer, GridArray bits, Color color)
+{
+	Layer *cur = &layers[layer];
+	uint8_t row;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		stale[0][row] |= cur->bits[row] | bits[row];
+		stale[1][row] |= cur->bits[row] | bits[row];
+		cur->bits[row] = bits[row];
+	}
+
+	cur->color = color;
+}
+
+/**
+ * @brief	Lights or clears a single cell of a layer
+ *
+ * @param	layer Which layer (0 to MATRIX_LAYERS - 1)
+ * @param	rownum The row of the cell
+ * @param	colnum The column of the cell
+ * @param	on 1 to light the cell, 0 to clear it
+ *
+ * @retval	none
+ */
+void SetLayerBit(uint8_t layer, uint8_t rownum, uint8_t colnum, uint8_t on)
+{
+	GridRow *bits = &layers[layer].bits[rownum];
+
+	if(((*bits >> colnum) & 1) == on)
+		return;
+
+	*bits ^= (GridRow)1 << colnum;
+	MarkStale(rownum, colnum);
+}
+
+/**
+ * @brief	Moves a sprite to a cell and sets its color. Only the cell it
+ * 			left and the cell it entered get redrawn.
+ *
+ * @param	sprite Which sprite (0 to MATRIX_SPRITES - 1)
+ * @param	rownum The row to move it to
+ * @param	colnum The column to move it to
+ * @param	color The color to draw it in
+ *
+ * @retval	none
+ */
+void SetSprite(uint8_t sprite, uint8_t rownum, uint8_t colnum, Color color)
+{
+	Sprite *cur = &sprites[sprite];
+
+	if(cur->visible && cur->row == rownum && cur->col == colnum &&
+		cur->color.R == color.R && cur->color.G == color.G && cur->color.B == color.B)
+		return;
+
+	if(cur->visible)
+		MarkStale(cur->row, cur->col);
+
+	cur->row = rownum;
+	cur->col = colnum;
+	cur->color = color;
+	cur->visible = 1;
+
+	MarkStale(rownum, colnum);
+}
+
+/**
+ * @brief	Stops drawing a sprite
+ *
+ * @param	sprite Which sprite (0 to MATRIX_SPRITES - 1)
+ *
+ * @retval	none
+ */
+void HideSprite(uint8_t sprite)
+{
+	if(!sprites[sprite].visible)
+		return;
+
+	sprites[sprite].visible = 0;
+	MarkStale(sprites[sprite].row, sprites[sprite].col);
+}
+
+/**
+ * @brief	Has the next ComposeFrame() redraw every cell of both buffers.
+ * 			Needed after drawing to the matrix without the layers.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InvalidateLayers(void)
+{
+	memset(stale, 0xFF, sizeof(stale));
+}
+
+/**
+ * @brief	Redraws every out of date cell of the back buffer from the
+ * 			layers and sprites, then presents it.
+ *
+ * 			Every cell is written once, by whatever is on top of it: the
+ * 			sprites first, then the layers from the top down, and black
+ * 			for whatever is left.
+ *
+ * @param	none
+ *
+ * @retval	1 if the frame was presented, 0 if the last frame is still
+ * 			waiting to be displayed (the changes are kept for next time)
+ */
+uint8_t ComposeFrame(void)
+{
+	GridRow *cells;
+	GridRow bit;
+	uint8_t row;
+	int8_t i;
+
+	if(FramePending())
+		return 0;
+
+	cells = stale[(back == &buffers[0]) ? 0 : 1];
+
+#ifdef MATRIX_INDEXED_COLOR
+	// Redrawing every cell (like after a new level) frees every palette entry the buffer used
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		if(cells[row] != GRIDROW_ALL)
+			break;
+	}
+
+	if(row == MAX_ROWS)
+		palette_back = 0;
+#endif
+
+	for(i = MATRIX_SPRITES - 1; i >= 0; --i)
+	{
+		bit = (GridRow)1 << sprites[i].col;
+
+		if(!sprites[i].visible || !(cells[sprites[i].row] & bit))
+			continue;
+
+		SetColor(sprites[i].color.R, sprites[i].color.G, sprites[i].color.B);
+		DrawPixel(sprites[i].row, sprites[i].col);
+		cells[sprites[i].row] &= ~bit;
+	}
+
+	for(i = MATRIX_LAYERS - 1; i >= 0; --i)
+	{
+		SetColor(layers[i].color.R, layers[i].color.G, layers[i].color.B);
+
+		for(row = 0; row < MAX_ROWS; ++row)
+		{
+			DrawGridRow(row, cells[row] & layers[i].bits[row]);
+			cells[row] &= ~layers[i].bits[row];
+		}
+	}
+
+	SetColor(0, 0, 0);
+	DrawGridArray(cells);
+	memset(cells, 0, sizeof(stale[0]));
+
+	PresentFrame();
+
+	return 1;
+}
@@ -1,16 +1,70 @@
 #include <stdint.h>
 #include "inc/tm4c123gh6pm.h"
+#include "UART.h"
+#include "utility.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+// UART flag register bits
+#define UART_FR_BUSY 0x08	// Still transmitting
+#define UART_FR_RXFE 0x10	// Receive FIFO empty
+#define UART_FR_TXFF 0x20	// Transmit FIFO full
+
+// UART interrupt bits (same for the mask, status, and clear registers)
+#define UART_INT_RX 0x10	// Receive FIFO reached its trigger level
+#define UART_INT_TX 0x20	// Transmit FIFO drained to its trigger level
+#define UART_INT_RT 0x40	// Receive timeout (bytes sitting in the receive FIFO)
+
+/**
+ * Ring buffers between the UART interrupt and the rest of the program.
+ * Each one has a single producer and a single consumer: the head is only
+ * written by the producer and the tail only by the consumer, so neither
+ * side needs to disable interrupts. The indices run freely and get masked
+ * when used, so head - tail is always the number of bytes in the buffer.
+ */
+static volatile uint8_t rx_buffer[UART_RX_BUFFER_SIZE];
+static volatile uint16_t rx_head;	// Written by UART4Int
+static volatile uint16_t rx_tail;	// Written by UARTRead()
+static volatile uint32_t rx_overflows;	// Bytes dropped because rx_buffer was full
+
+static volatile uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint16_t tx_head;	// Written by UARTWrite()
+static volatile uint16_t tx_tail;	// Written by UART4Int
+
+/**
+* @brief	Sets both baud rate divisors. The UART must be disabled.
+*
+* 			The divisor is SYSCLK / (16 * baud), split into a 16-bit integer
+* 			part (IBRD) and a 6-bit fractional part (FBRD, in 1/64ths). It's
+* 			computed in 1/128ths and rounded to the nearest 1/64th.
+*
+* @param	baud The wanted baud rate (clamped to MAX_BAUD_RATE)
+*
+* @retval	none
+*/
+static void SetDivisors(uint32_t baud)
+{
+	uint32_t divisor;
+
+	if(baud > MAX_BAUD_RATE)
+		baud = MAX_BAUD_RATE;
+	else if(baud == 0)
+		baud = BAUD_RATE;
+
+	divisor = ((SYSCLK * 8) / baud + 1) / 2;
+
+	UART4_IBRD_R = divisor >> 6;
+	UART4_FBRD_R = divisor & 0x3F;
+}
 
 /**
 * @brief	Initialize the hardware needed to use the UART
 *
-* @param	IBRD The integer baud rate divisor to generate the baudrate from.
-*				 The equation for calculating this value is as follows:
-*					IBRD = SYSCLK / (16 * BAUD_RATE)
+* @param	baud The baud rate to use (up to MAX_BAUD_RATE)
 *
 * @retval	none
 */
-void InitUART(uint16_t IBRD)
+void InitUART(uint32_t baud)
 {
 	// Set PC4 and PC5 to their alternate function (UART4) and enable them
 	GPIO_PORTC_AFSEL_R |= 0x30;
@@ -21,21 +75,181 @@ void InitUART(uint16_t IBRD)
 	UART4_CTL_R &= ~1;
 
 	// Set the baud rate
-	UART4_IBRD_R = IBRD;
+	SetDivisors(baud);
+
+	// 8 data bits, one stop bit, no parity, FIFOs enabled (writing this also latches the divisors)
+	UART4_LCRH_R |= 0x70;
 
-	// 8 data bits, one stop bit, no parity
-	UART4_LCRH_R |= 0x60;
+	// Interrupt when the receive FIFO is half full and when the transmit FIFO is down to 1/8
+	UART4_IFLS_R = 0x10;
 
-	UART4_IM_R |= 0x10;		// Enable interrupt in UART for receive operations
+	UART4_IM_R |= UART_INT_RX | UART_INT_RT;	// Enable receive interrupts (transmit is enabled when there's something to send)
 	NVIC_EN1_R |= 0x10000000; 	// enable interrupt in NVIC
 	NVIC_PRI15_R |= 0x40;	// Set UART4 interrupt to priority level 2
 
 	// Enable the receiver, transmitter and the UART as a whole
-	UART4_CTL_R |= 0x101;
+	UART4_CTL_R |= 0x301;
 }
 
 /**
-* @brief 	Send a byte of data over the UART
+* @brief	Changes the baud rate. Everything already queued gets sent at
+* 			the old baud rate first, so this waits for the transmit buffer
+* 			to drain. Don't call it from an interrupt.
+*
+* @param	baud The new baud rate (up to MAX_BAUD_RATE)
+*
+* @retval	none
+*/
+void UARTSetBaudRate(uint32_t baud)
+{
+	// Wait for the transmit buffer, then the transmitter itself, to finish
+	while(tx_tail != tx_head)
+		WAIT_FOR_INTERRUPT();
+	while(UART4_FR_R & UART_FR_BUSY);
+
+	UART4_CTL_R &= ~1;
+	SetDivisors(baud);
+	UART4_LCRH_R = UART4_LCRH_R;	// The new divisors only take effect after a write to LCRH
+	UART4_CTL_R |= 1;
+}
+
+/**
+ * @brief	Moves the next byte of the transmit buffer into the transmit
+ * 			FIFO, if there's one and the FIFO has room. Interrupts are
+ * 			masked while it's moved, since both UART4Int() and
+ * 			UARTTransmit() take bytes out of the buffer.
+ *
+ * @param	none
+ *
+ * @retval	1 if a byte was moved, 0 otherwise
+ */
+static uint8_t SendQueuedByte(void)
+{
+	uint8_t sent = 0;
+	uint32_t masked = SAVE_AND_DISABLE_INTERRUPTS();
+
+	if(tx_tail != tx_head && (UART4_FR_R & UART_FR_TXFF) == 0)
+	{
+		UART4_DR_R = tx_buffer[tx_tail & (UART_TX_BUFFER_SIZE - 1)];
+		tx_tail++;
+		sent = 1;
+	}
+
+	RESTORE_INTERRUPTS(masked);
+
+	return sent;
+}
+
+/**
+ * @brief	Interrupt for UART4. Moves every received byte from the
+ * 			receive FIFO into the receive buffer, and refills the
+ * 			transmit FIFO from the transmit buffer.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void UART4Int(void)
+{
+	PROFILE_ISR_ENTER();
+
+	NVIC_UNPEND1_R |= 0x10000000; // Clear interrupt flag in NVIC
+	UART4_ICR_R = UART_INT_RX | UART_INT_TX | UART_INT_RT;	// Clear interrupt flags in the UART
+
+	// Drain the receive FIFO
+	while((UART4_FR_R & UART_FR_RXFE) == 0)
+	{
+		uint8_t data = UART4_DR_R;
+
+		if((uint16_t)(rx_head - rx_tail) < UART_RX_BUFFER_SIZE)
+		{
+			rx_buffer[rx_head & (UART_RX_BUFFER_SIZE - 1)] = data;
+			rx_head++;
+		}
+		else
+			rx_overflows++;
+
+		PostEvent(EVENT_INPUT);
+	}
+
+	// Fill the transmit FIFO
+	while(SendQueuedByte());
+
+	// Only keep the transmit interrupt on while there's more to send
+	if(tx_tail == tx_head)
+		UART4_IM_R &= ~UART_INT_TX;
+	else
+		UART4_IM_R |= UART_INT_TX;
+
+	PROFILE_ISR_EXIT(PROFILE_UART4, 0);
+}
+
+/**
+* @brief 	Queues data to be sent over the UART without waiting for it to be sent
+*
+* @param	buf The data to send
+* @param	len How many bytes to send
+*
+* @retval	How many bytes were queued, less than len if the transmit buffer filled up
+*/
+uint16_t UARTWrite(const uint8_t *buf, uint16_t len)
+{
+	uint16_t count = 0;
+
+	while(count < len && (uint16_t)(tx_head - tx_tail) < UART_TX_BUFFER_SIZE)
+	{
+		tx_buffer[tx_head & (UART_TX_BUFFER_SIZE - 1)] = buf[count++];
+		tx_head++;
+	}
+
+	// Start sending by running the interrupt, it's the only thing that takes data out of the buffer
+	if(count != 0)
+	{
+		UART4_IM_R |= UART_INT_TX;
+		NVIC_PEND1_R = 0x10000000;
+	}
+
+	return count;
+}
+
+/**
+* @brief 	Takes received bytes out of the receive buffer without waiting for more
+*
+* @param	buf Where to store the bytes
+* @param	len The most bytes to take
+*
+* @retval	How many bytes were stored in buf
+*/
+uint16_t UARTRead(uint8_t *buf, uint16_t len)
+{
+	uint16_t count = 0;
+
+	while(count < len && rx_tail != rx_head)
+	{
+		buf[count++] = rx_buffer[rx_tail & (UART_RX_BUFFER_SIZE - 1)];
+		rx_tail++;
+	}
+
+	return count;
+}
+
+/**
+* @brief 	Returns how many received bytes were dropped because the receive buffer was full
+*
+* @param	none
+*
+* @retval	The number of dropped bytes since the UART was initialized
+*/
+uint32_t UARTRxOverflows(void)
+{
+	return rx_overflows;
+}
+
+/**
+* @brief 	Send a byte of data over the UART. Only waits if the transmit
+* 			buffer is full, and then moves bytes into the transmit FIFO
+* 			itself, so it also works with interrupts masked or from an
+* 			interrupt that UART4Int() can't preempt.
 *
 * @param	data The 8 bits of data you want to send
 *
@@ -45,9 +259,46 @@ void UARTTransmit(uint8_t data)
 {
 	int uart_enabled = (UART4_CTL_R & 1);
 
-	// Wait until the UART is done transmitting
-	while(uart_enabled && (UART4_FR_R & 0x8));
+	// Wait until there's room in the transmit buffer
+	while(UARTWrite(&data, 1) == 0 && uart_enabled)
+	{
+		if(!SendQueuedByte())
+			WAIT_FOR_INTERRUPT();
+	}
+}
+
+/**
+* @brief 	Send a null terminated string over the UART
+*
+* @param	str The string to send (without its null terminator)
+*
+* @retval	none
+*/
+void UARTWriteString(const char *str)
+{
+	while(*str)
+		UARTTransmit(*str++);
+}
+
+/**
+* @brief 	Send an unsigned number over the UART as decimal text
+*
+* @param	num The number to send
+*
+* @retval	none
+*/
+void UARTWriteNumber(uint32_t num)
+{
+	char digits[10];
+	int count = 0;
+
+	// Generate the digits backwards, then send them in the right order
+	do
+	{
+		digits[count++] = '0' + (num % 10);
+		num /= 10;
+	} while(num != 0);
 
-	// Send the data
-	UART4_DR_R = data;
+	while(count > 0)
+		UARTTransmit(digits[--count]);
 }
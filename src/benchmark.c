@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include "benchmark.h"
+#include "LedMatrix.h"
+#include "pacman.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "UART.h"
+#include "utility.h"
+
+// A piece of code to time
+typedef void (*BenchmarkFunc)(void);
+
+typedef struct Benchmark_t
+{
+	const char *name;
+	BenchmarkFunc func;
+} Benchmark;
+
+// The code each benchmark times
+static void BenchClearMatrix(void)
+{
+	ClearMatrix();
+}
+
+static void BenchDrawSolidColor(void)
+{
+	SetColor(COLOR_MAX, 0, COLOR_MAX);
+	DrawSolidColor();
+}
+
+static void BenchDrawRowLine(void)
+{
+	SetColor(COLOR_MAX, COLOR_MAX, 0);
+	DrawRowLine(MAX_ROWS / 2, 0, MAX_COLS);
+}
+
+static void BenchDrawColumnLine(void)
+{
+	SetColor(0, COLOR_MAX, COLOR_MAX);
+	DrawColumnLine(MAX_COLS / 2, 0, MAX_ROWS);
+}
+
+static void BenchDrawGridArray(void)
+{
+	SetColor(0, COLOR_MAX, COLOR_MAX);
+	DrawGridArray(level);
+}
+
+static void BenchComposeFrame(void)
+{
+	InvalidateLayers();
+	ComposeFrame();
+}
+
+static void BenchGameTick(void)
+{
+	RunTask(EVENT_TICK);
+}
+
+static const Benchmark benchmarks[] =
+{
+	{"ClearMatrix", BenchClearMatrix},
+	{"DrawSolidColor", BenchDrawSolidColor},
+	{"DrawRowLine", BenchDrawRowLine},
+	{"DrawColumnLine", BenchDrawColumnLine},
+	{"DrawGridArray", BenchDrawGridArray},
+	{"ComposeFrame", BenchComposeFrame},
+	{"GameTick", BenchGameTick},
+	{"ScanoutFrame", ScanoutFrame},
+};
+
+/**
+ * @brief	Times one benchmark and sends its line of the results
+ *
+ * @param	bench The benchmark
+ *
+ * @retval	none
+ */
+static void RunBenchmark(const Benchmark *bench)
+{
+	uint32_t start, cycles, masked;
+	uint32_t min = 0xFFFFFFFF, max = 0;
+	uint64_t total = 0;
+	uint8_t i;
+
+	for(i = 0; i < BENCHMARK_ITERATIONS; ++i)
+	{
+		// Let the last frame get displayed, so code that presents a frame doesn't skip its work
+		while(FramePending())
+			WAIT_FOR_INTERRUPT();
+
+		masked = SAVE_AND_DISABLE_INTERRUPTS();
+		start = CYCLE_COUNT();
+		bench->func();
+		cycles = CYCLE_COUNT() - start;
+		RESTORE_INTERRUPTS(masked);
+
+		total += cycles;
+
+		if(cycles < min)
+			min = cycles;
+
+		if(cycles > max)
+			max = cycles;
+	}
+
+	UARTWriteString(bench->name);
+	UARTTransmit(',');
+	UARTWriteNumber(BENCHMARK_ITERATIONS);
+	UARTTransmit(',');
+	UARTWriteNumber(min);
+	UARTTransmit(',');
+	UARTWriteNumber((uint32_t)(total / BENCHMARK_ITERATIONS));
+	UARTTransmit(',');
+	UARTWriteNumber(max);
+	UARTTransmit(',');
+	UARTWriteNumber((uint32_t)((uint64_t)min * 1000 / ST_US));
+	UARTWriteString("\r\n");
+}
+
+/**
+ * @brief	Runs every benchmark and sends the results as CSV
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void RunBenchmarks(void)
+{
+	uint8_t i;
+
+	// The extra game ticks would make the game differ from its recording
+	if(IsReplaying())
+	{
+		UARTWriteString("benchmarks skipped: a recording or playback is running\r\n");
+		return;
+	}
+
+	UARTWriteString("benchmark,iterations,min_cycles,mean_cycles,max_cycles,min_ns\r\n");
+
+	for(i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+		RunBenchmark(&benchmarks[i]);
+
+	// The benchmarks drew all over the back buffer
+	InvalidateLayers();
+}
+
+/**
+ * @brief	Sends the share of a lit time out of the total lit time, in
+ * 			hundredths of a percent
+ *
+ * @param	lit The lit time of one plane
+ * @param	total The lit time of every plane added up
+ *
+ * @retval	none
+ */
+static void WriteShare(uint32_t lit, uint32_t total)
+{
+	UARTWriteNumber((uint32_t)(((uint64_t)lit * 10000 + total / 2) / total));
+}
+
+/**
+ * @brief	Calibrates the BCM timing and sends the lit time of every
+ * 			plane before and after as CSV
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void RunCalibration(void)
+{
+	uint32_t before[BCM_BITS], after[BCM_BITS];
+	uint32_t total_before = 0, total_after = 0;
+	uint8_t bcm;
+
+	CalibrateMatrix(before);
+	MeasureLitTimes(after);
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+	{
+		total_before += before[bcm];
+		total_after += after[bcm];
+	}
+
+	UARTWriteString("plane,target_cycles,lit_before,lit_after,ideal_share,share_before,share_after,max_gap_cycles\r\n");
+
+	for(bcm = 0; bcm < BCM_BITS; ++bcm)
+	{
+		UARTWriteNumber(bcm);
+		UARTTransmit(',');
+		UARTWriteNumber((uint32_t)BCM_BASE_TICKS << bcm);
+		UARTTransmit(',');
+		UARTWriteNumber(before[bcm]);
+		UARTTransmit(',');
+		UARTWriteNumber(after[bcm]);
+		UARTTransmit(',');
+		WriteShare(1UL << bcm, (1UL << BCM_BITS) - 1);
+		UARTTransmit(',');
+		WriteShare(before[bcm], total_before);
+		UARTTransmit(',');
+		WriteShare(after[bcm], total_after);
+		UARTTransmit(',');
+		UARTWriteNumber(EmissionGap(bcm));
+		UARTWriteString("\r\n");
+	}
+
+	// Every plane together, as for a white pixel
+	UARTWriteString("all,");
+	UARTWriteNumber(BCM_BASE_TICKS * ((1UL << BCM_BITS) - 1));
+	UARTTransmit(',');
+	UARTWriteNumber(total_before);
+	UARTTransmit(',');
+	UARTWriteNumber(total_after);
+	UARTWriteString(",10000,10000,10000,");
+	UARTWriteNumber(EmissionGap(BCM_BITS));
+	UARTWriteString("\r\n");
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include "capture.h"
+#include "LedMatrix.h"
+#include "protocol.h"
+#include "scheduler.h"
+
+/**
+ * @brief	Scales a color component up to 8 bits
+ *
+ * @param	value The component from 0 to COLOR_MAX
+ *
+ * @retval	The component from 0 to 255
+ */
+static uint8_t ExpandComponent(uint8_t value)
+{
+	return (uint8_t)(((uint16_t)value * 255 + COLOR_MAX / 2) / COLOR_MAX);
+}
+
+/**
+ * @brief	Writes a number out in decimal
+ *
+ * @param	text Where to write the digits
+ * @param	value The number
+ *
+ * @retval	The number of digits written
+ */
+static uint8_t WriteDecimal(uint8_t *text, uint8_t value)
+{
+	uint8_t digits = (value >= 100) ? 3 : (value >= 10) ? 2 : 1;
+	uint8_t i;
+
+	for(i = digits; i > 0; --i)
+	{
+		text[i - 1] = '0' + value % 10;
+		value /= 10;
+	}
+
+	return digits;
+}
+
+/**
+ * @brief	Handles OP_CAPTURE, sends the displayed frame
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void CaptureCommand(const uint8_t *data, uint8_t length)
+{
+	CaptureFrame();
+}
+
+/**
+ * @brief	Registers the capture command with the protocol
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitCapture(void)
+{
+	ProtocolRegister(OP_CAPTURE, CaptureCommand);
+}
+
+/**
+ * @brief	Sends the displayed frame over the UART as a PPM file.
+ *
+ * 			Any frame that's waiting to be displayed gets displayed first.
+ * 			While this runs, no other task can present a frame (tasks run
+ * 			to completion), so the buffers can't get swapped mid-capture.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void CaptureFrame(void)
+{
+	uint8_t payload[PROTOCOL_MAX_PAYLOAD - PROTOCOL_MAX_PAYLOAD % 3];	// Whole pixels only
+	uint8_t count, row, col;
+	uint32_t hash = 2166136261UL;
+	Color color;
+
+	// Let the game draw a frame it had to hold back, then wait for that one too
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+	RunTask(EVENT_FRAME_PRESENTED);
+	while(FramePending())
+		WAIT_FOR_INTERRUPT();
+
+	// PPM header: "P6\n<width> <height>\n255\n"
+	payload[0] = 'P';
+	payload[1] = '6';
+	payload[2] = '\n';
+	count = 3;
+	count += WriteDecimal(&payload[count], MAX_COLS);
+	payload[count++] = ' ';
+	count += WriteDecimal(&payload[count], MAX_ROWS);
+	payload[count++] = '\n';
+	count += WriteDecimal(&payload[count], 255);
+	payload[count++] = '\n';
+
+	ProtocolSend(OP_CAPTURE_DATA, payload, count);
+
+	count = 0;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			color = GetDisplayedPixel(row, col);
+			payload[count++] = ExpandComponent(color.R);
+			payload[count++] = ExpandComponent(color.G);
+			payload[count++] = ExpandComponent(color.B);
+
+			if(count == sizeof(payload))
+			{
+				for(count = 0; count < sizeof(payload); ++count)
+					hash = (hash ^ payload[count]) * 16777619UL;
+
+				ProtocolSend(OP_CAPTURE_DATA, payload, count);
+				count = 0;
+			}
+		}
+	}
+
+	for(row = 0; row < count; ++row)
+		hash = (hash ^ payload[row]) * 16777619UL;
+
+	if(count != 0)
+		ProtocolSend(OP_CAPTURE_DATA, payload, count);
+
+	ProtocolSend(OP_CAPTURE_DATA, payload, 0);
+
+	WRITE_LE32(payload, hash);
+	ProtocolSend(OP_CAPTURE_HASH, payload, 4);
+}
@@ -0,0 +1,668 @@
+#include <stdint.h>
+#include <string.h>
+#include "ghost.h"
+#include "pathfind.h"
+#include "mazegraph.h"
+#include "profiler.h"
+#include "utility.h"
+
+// How many game ticks (150ms each) the ghosts scatter and chase for before switching
+#define SCATTER_TICKS 47	// ~7 seconds
+#define CHASE_TICKS 133		// ~20 seconds
+
+// Clyde only chases pacman when he's at least this many cells away
+#define CLYDE_SHY_DISTANCE 8
+
+// How many cells ahead of pacman pinky aims for
+#define PINKY_LOOKAHEAD 4
+
+// A ghost in the level
+typedef struct Ghost_t
+{
+	Character character;
+	PacmanDir dir;			// Which way the ghost is moving
+	uint8_t frightened;		// 1 while the ghost can be eaten
+} Ghost;
+
+// Everything that differs between the ghosts' personalities
+typedef struct GhostInfo_t
+{
+	uint8_t start_row;
+	uint8_t start_col;
+	uint8_t corner_row;		// Where the ghost heads to while scattering
+	uint8_t corner_col;
+	PacmanDir start_dir;
+	Color color;
+} GhostInfo;
+
+// The corners the ghosts scatter to, just inside the edges of the display. On a bigger
+// display than the level, PickTarget() moves them to the closest corner of the level.
+#define CORNER_FAR_ROW (MAX_ROWS - 2)
+#define CORNER_FAR_COL (MAX_COLS - 2)
+
+// Blinky, Pinky, Inky, and Clyde
+static const GhostInfo ghost_info[4] =
+{
+	{12, 13, 1, CORNER_FAR_COL, LEFT, {COLOR_MAX, 0, 0} },
+	{12, 18, 1, 1, RIGHT, {COLOR_MAX, COLOR_MAX / 2, COLOR_MAX} },
+	{19, 13, CORNER_FAR_ROW, CORNER_FAR_COL, LEFT, {COLOR_MAX / 4, COLOR_MAX / 2, COLOR_MAX} },
+	{19, 18, CORNER_FAR_ROW, 1, RIGHT, {COLOR_MAX, COLOR_MAX / 2, 0} },
+};
+
+// The color of every ghost that can be eaten
+static const Color frightened_color = {0, 0, COLOR_MAX};
+
+// The direction opposite of each direction (indexed by PacmanDir)
+static const PacmanDir opposite_dir[] = {NONE, RIGHT, LEFT, DOWN, UP};
+
+// The order directions are tried in, which also breaks ties between equally good directions
+static const PacmanDir dir_order[] = {UP, LEFT, DOWN, RIGHT};
+
+static Ghost ghosts[GHOST_COUNT];
+static GridArray ghost_cells;	// 1 for every cell that has a ghost in it
+static GridArray ghost_reach;	// 1 for every cell the ghosts can get to from where they start
+
+static GhostMode cur_mode = SCATTER;	// Whether the ghosts are scattering or chasing (while not frightened)
+static uint16_t mode_ticks_left = SCATTER_TICKS;	// Game ticks until cur_mode switches
+static uint16_t frightened_ticks_left;	// Game ticks until the ghosts stop being frightened
+static uint8_t tick_count;		// Frightened ghosts only move every other tick
+
+// Longest a distance field has taken to compute. Until one has been measured, assume half the budget.
+static uint32_t worst_search_cycles = GHOST_CYCLE_BUDGET / 2;
+
+static uint32_t random_state = 1;	// State of the xorshift random number generator
+
+static uint8_t ignore_budget;	// Set by SetGhostDeterministic(), pathfinding never gets cut short
+
+/**
+ * @brief	Seeds the random number generator used by frightened ghosts.
+ * 			The same seed always gives the same ghost movements.
+ *
+ * @param	seed Any value (zero gets replaced by one)
+ *
+ * @retval	none
+ */
+void SeedGhostRandom(uint32_t seed)
+{
+	random_state = (seed == 0) ? 1 : seed;
+}
+
+/**
+ * @brief	Returns the next pseudo random number (xorshift32)
+ *
+ * @param	none
+ *
+ * @retval	A 32-bit pseudo random number
+ */
+static uint32_t NextRandom(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+
+	return random_state;
+}
+
+/**
+ * @brief	Finds the cell next to a cell in a direction, wrapping around
+ * 			the edges of the level like pacman does
+ *
+ * @param	row The row of the cell (updated to the neighbor's row)
+ * @param	col The column of the cell (updated to the neighbor's column)
+ * @param	dir Which neighbor to find
+ *
+ * @retval	1 if the neighbor isn't a wall, 0 if it is
+ */
+static uint8_t Neighbor(uint8_t *row, uint8_t *col, PacmanDir dir)
+{
+	switch(dir)
+	{
+		case LEFT:
+			*col = (*col == 0) ? MAX_COLS - 1 : *col - 1;
+			break;
+		case RIGHT:
+			*col = (*col == MAX_COLS - 1) ? 0 : *col + 1;
+			break;
+		case UP:
+			*row = (*row == 0) ? MAX_ROWS - 1 : *row - 1;
+			break;
+		case DOWN:
+			*row = (*row == MAX_ROWS - 1) ? 0 : *row + 1;
+			break;
+		case NONE:
+		default:
+			break;
+	}
+
+	return GET_GRIDARRAY_BIT(level, *row, *col) != 1;
+}
+
+/**
+ * @brief	Moves a position a number of cells in a direction, stopping at the
+ * 			edges of the level. Used to pick targets, so walls are ignored.
+ *
+ * @param	row The row to move (updated)
+ * @param	col The column to move (updated)
+ * @param	dir Which way to move
+ * @param	cells How far to move
+ *
+ * @retval	none
+ */
+static void Offset(int *row, int *col, PacmanDir dir, int cells)
+{
+	switch(dir)
+	{
+		case LEFT:
+			*col -= cells;
+			break;
+		case RIGHT:
+			*col += cells;
+			break;
+		case UP:
+			*row -= cells;
+			break;
+		case DOWN:
+			*row += cells;
+			break;
+		case NONE:
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief	Returns the squared straight line distance between two cells
+ *
+ * @param	row1 The row of the first cell
+ * @param	col1 The column of the first cell
+ * @param	row2 The row of the second cell
+ * @param	col2 The column of the second cell
+ *
+ * @retval	The squared distance
+ */
+static uint16_t SquaredDistance(uint8_t row1, uint8_t col1, uint8_t row2, uint8_t col2)
+{
+	int dr = row1 - row2;
+	int dc = col1 - col2;
+
+	return dr * dr + dc * dc;
+}
+
+/**
+ * @brief	Finds the closest cell (in a straight line) to a cell that the
+ * 			ghosts can get to. Every row only needs the closest set bit of
+ * 			ghost_reach on either side of the column.
+ *
+ * @param	row The row of the cell (updated to the closest reachable cell's row)
+ * @param	col The column of the cell (updated to the closest reachable cell's column)
+ *
+ * @retval	none
+ */
+static void NearestReachable(uint8_t *row, uint8_t *col)
+{
+	GridRow right, left;
+	uint8_t r, c, best_row = *row, best_col = *col;
+	uint16_t dist, best_dist = 0xFFFF;
+
+	for(r = 0; r < MAX_ROWS; ++r)
+	{
+		right = ghost_reach[r] >> *col;
+		left = ghost_reach[r] & (((GridRow)1 << *col) - 1);
+
+		// The closest cell at or after the column
+		if(right != 0)
+		{
+			c = *col + GRIDROW_CTZ(right);
+			dist = SquaredDistance(*row, *col, r, c);
+
+			if(dist < best_dist)
+			{
+				best_dist = dist;
+				best_row = r;
+				best_col = c;
+			}
+		}
+
+		// The closest cell before the column
+		if(left != 0)
+		{
+			c = sizeof(GridRow) * 8 - 1 - GRIDROW_CLZ(left);
+			dist = SquaredDistance(*row, *col, r, c);
+
+			if(dist < best_dist)
+			{
+				best_dist = dist;
+				best_row = r;
+				best_col = c;
+			}
+		}
+	}
+
+	*row = best_row;
+	*col = best_col;
+}
+
+/**
+ * @brief	Picks the cell a ghost wants to reach, using the classic rules:
+ * 			Blinky goes for pacman, Pinky for the cells ahead of pacman,
+ * 			Inky for the cell that mirrors Blinky around the two cells
+ * 			ahead of pacman, and Clyde goes for pacman until he gets close,
+ * 			then heads to his corner. While scattering, every ghost heads
+ * 			to its corner. Targets the ghosts can't get to are moved to the
+ * 			closest cell they can get to.
+ *
+ * @param	ghost Which ghost to pick a target for
+ * @param	pacman Pacman's current position
+ * @param	pacman_dir Pacman's current direction
+ * @param	row The row of the target (output)
+ * @param	col The column of the target (output)
+ *
+ * @retval	none
+ */
+static void PickTarget(uint8_t ghost, Character pacman, PacmanDir pacman_dir, uint8_t *row, uint8_t *col)
+{
+	int target_row = pacman.row, target_col = pacman.col;
+	uint8_t corner = (cur_mode == SCATTER);
+
+	switch(ghost)
+	{
+		case 1:
+			Offset(&target_row, &target_col, pacman_dir, PINKY_LOOKAHEAD);
+			break;
+
+		case 2:
+			Offset(&target_row, &target_col, pacman_dir, 2);
+			target_row = 2 * target_row - ghosts[0].character.row;
+			target_col = 2 * target_col - ghosts[0].character.col;
+			break;
+
+		case 3:
+			if(SquaredDistance(ghosts[ghost].character.row, ghosts[ghost].character.col, pacman.row, pacman.col) <
+				CLYDE_SHY_DISTANCE * CLYDE_SHY_DISTANCE)
+				corner = 1;
+			break;
+
+		case 0:
+		default:
+			break;
+	}
+
+	if(corner)
+	{
+		target_row = ghost_info[ghost].corner_row;
+		target_col = ghost_info[ghost].corner_col;
+	}
+
+	// Keep the target inside of the level
+	if(target_row < 0)
+		target_row = 0;
+	else if(target_row > MAX_ROWS - 1)
+		target_row = MAX_ROWS - 1;
+
+	if(target_col < 0)
+		target_col = 0;
+	else if(target_col > MAX_COLS - 1)
+		target_col = MAX_COLS - 1;
+
+	*row = target_row;
+	*col = target_col;
+
+	// Walls and cells closed off from the ghosts can't be reached, so aim for the closest cell that can
+	if(GET_GRIDARRAY_BIT(ghost_reach, *row, *col) != 1)
+		NearestReachable(row, col);
+}
+
+/**
+ * @brief	Picks which way a ghost goes next. Ghosts never turn around on
+ * 			their own, so they only get a choice at junctions; there, they
+ * 			take the direction that brings them closest to their target
+ * 			(or a random one while frightened).
+ *
+ * 			Distances come from the level's junction graph if it has one.
+ * 			Otherwise they come from the level's distance fields as long
+ * 			as the field is cached or there's enough of the tick's cycle
+ * 			budget left to compute one. Failing that, the ghost falls back
+ * 			to the straight line distance, which costs almost nothing.
+ *
+ * @param	ghost Which ghost to move
+ * @param	pacman Pacman's current position
+ * @param	pacman_dir Pacman's current direction
+ * @param	tick_start CYCLE_COUNT() at the start of this game tick's ghost update
+ *
+ * @retval	none
+ */
+static void ChooseDirection(uint8_t ghost, Character pacman, PacmanDir pacman_dir, uint32_t tick_start)
+{
+	Ghost *cur = &ghosts[ghost];
+	PacmanDir options[4];
+	uint8_t num_options = 0, i, row, col;
+	uint8_t target_row, target_col;
+	uint16_t dist, best_dist = 0xFFFF;
+	const DistanceField *field = 0;
+	uint32_t search_start, search_cycles;
+	uint8_t use_graph;
+
+	// Every open direction, except for turning around
+	for(i = 0; i < 4; ++i)
+	{
+		row = cur->character.row;
+		col = cur->character.col;
+
+		if(dir_order[i] != opposite_dir[cur->dir] && Neighbor(&row, &col, dir_order[i]))
+			options[num_options++] = dir_order[i];
+	}
+
+	// Dead end, turning around is the only way out
+	if(num_options == 0)
+	{
+		cur->dir = opposite_dir[cur->dir];
+		return;
+	}
+
+	// In a corridor, there's nothing to decide
+	if(num_options == 1)
+	{
+		cur->dir = options[0];
+		return;
+	}
+
+	if(cur->frightened)
+	{
+		cur->dir = options[NextRandom() % num_options];
+		return;
+	}
+
+	PickTarget(ghost, pacman, pacman_dir, &target_row, &target_col);
+
+	// Levels with a junction graph answer distance queries cheaply, as long as the target isn't a wall
+	use_graph = IsMazeGraphValid() && GET_GRIDARRAY_BIT(level, target_row, target_col) != 1;
+
+	// Otherwise, only search for paths while the budget can afford the slowest search seen so far
+	if(!use_graph && (ignore_budget || IsDistanceFieldCached(target_row, target_col) ||
+		(CYCLE_COUNT() - tick_start) + worst_search_cycles <= GHOST_CYCLE_BUDGET))
+	{
+		search_start = CYCLE_COUNT();
+		field = GetDistanceField(target_row, target_col);
+		search_cycles = CYCLE_COUNT() - search_start;
+
+		if(search_cycles > worst_search_cycles)
+			worst_search_cycles = search_cycles;
+	}
+
+	for(i = 0; i < num_options; ++i)
+	{
+		row = cur->character.row;
+		col = cur->character.col;
+		Neighbor(&row, &col, options[i]);
+
+		if(use_graph)
+			dist = MazeGraphDistance(row, col, target_row, target_col);
+		else if(field != 0)
+			dist = (*field)[row][col];
+		else
+			dist = SquaredDistance(row, col, target_row, target_col);
+
+		if(dist < best_dist)
+		{
+			best_dist = dist;
+			cur->dir = options[i];
+		}
+	}
+}
+
+/**
+ * @brief	Counts down the scatter/chase and frightened timers
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void UpdateMode(void)
+{
+	uint8_t i;
+
+	if(frightened_ticks_left != 0)
+	{
+		if(--frightened_ticks_left == 0)
+		{
+			for(i = 0; i < GHOST_COUNT; ++i)
+				ghosts[i].frightened = 0;
+		}
+
+		// The scatter/chase timer is paused while frightened
+		return;
+	}
+
+	if(--mode_ticks_left == 0)
+	{
+		cur_mode = (cur_mode == SCATTER) ? CHASE : SCATTER;
+		mode_ticks_left = (cur_mode == SCATTER) ? SCATTER_TICKS : CHASE_TICKS;
+
+		// Ghosts turn around whenever they switch modes
+		for(i = 0; i < GHOST_COUNT; ++i)
+			ghosts[i].dir = opposite_dir[ghosts[i].dir];
+	}
+}
+
+/**
+ * @brief	Updates the sprite of a ghost to its current cell and color
+ *
+ * @param	ghost Which ghost
+ *
+ * @retval	none
+ */
+static void UpdateGhostSprite(uint8_t ghost)
+{
+	const Ghost *cur = &ghosts[ghost];
+
+	SetSprite(GHOST_SPRITE + ghost, cur->character.row, cur->character.col,
+		cur->frightened ? frightened_color : cur->character.color);
+}
+
+/**
+ * @brief	Finds the cells the ghosts can get to from where they start in
+ * 			the current level, which their targets are kept inside of. Call
+ * 			it whenever the level changes.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void SetGhostLevel(void)
+{
+	uint8_t i;
+
+	memset(ghost_reach, 0, sizeof(ghost_reach));
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+	{
+		if(GET_GRIDARRAY_BIT(level, ghost_info[i].start_row, ghost_info[i].start_col) != 1)
+			ReachableCells(level, ghost_info[i].start_row, ghost_info[i].start_col, ghost_reach);
+	}
+}
+
+/**
+ * @brief	Puts every ghost back at its starting position, not frightened,
+ * 			and restarts the scatter/chase timer
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ResetGhosts(void)
+{
+	uint8_t i;
+
+	memset(ghost_cells, 0, sizeof(ghost_cells));
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+	{
+		ghosts[i].character.row = ghost_info[i].start_row;
+		ghosts[i].character.col = ghost_info[i].start_col;
+		ghosts[i].character.color = ghost_info[i].color;
+		ghosts[i].dir = ghost_info[i].start_dir;
+		ghosts[i].frightened = 0;
+
+		SET_GRIDARRAY_BIT(ghost_cells, ghosts[i].character.row, ghosts[i].character.col);
+		UpdateGhostSprite(i);
+	}
+
+	cur_mode = SCATTER;
+	mode_ticks_left = SCATTER_TICKS;
+	frightened_ticks_left = 0;
+	tick_count = 0;
+}
+
+/**
+ * @brief	Moves every ghost one cell (frightened ghosts only move every
+ * 			other tick). Pathfinding is limited to GHOST_CYCLE_BUDGET cycles,
+ * 			after which the remaining ghosts steer by straight line distance.
+ *
+ * @param	pacman Pacman's current position
+ * @param	pacman_dir Pacman's current direction
+ *
+ * @retval	none
+ */
+void MoveGhosts(Character pacman, PacmanDir pacman_dir)
+{
+	PROFILE_ISR_ENTER();
+
+	uint32_t tick_start = CYCLE_COUNT();
+	Ghost *cur;
+	uint8_t i;
+
+	UpdateMode();
+	tick_count++;
+
+	memset(ghost_cells, 0, sizeof(ghost_cells));
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+	{
+		cur = &ghosts[i];
+
+		if(!cur->frightened || (tick_count & 1))
+		{
+			ChooseDirection(i, pacman, pacman_dir, tick_start);
+			Neighbor(&cur->character.row, &cur->character.col, cur->dir);
+		}
+
+		SET_GRIDARRAY_BIT(ghost_cells, cur->character.row, cur->character.col);
+		UpdateGhostSprite(i);
+	}
+
+	PROFILE_ISR_EXIT(PROFILE_GHOSTS, GHOST_CYCLE_BUDGET);
+}
+
+/**
+ * @brief	Finds the ghost at a cell, checking the bitboard of occupied
+ * 			cells first so cells without ghosts cost a single bit test
+ *
+ * @param	row The row of the cell
+ * @param	col The column of the cell
+ *
+ * @retval	The index of the ghost, or NO_GHOST if the cell is empty
+ */
+uint8_t GhostCollision(uint8_t row, uint8_t col)
+{
+	uint8_t i;
+
+	if(GET_GRIDARRAY_BIT(ghost_cells, row, col) != 1)
+		return NO_GHOST;
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+	{
+		if(ghosts[i].character.row == row && ghosts[i].character.col == col)
+			return i;
+	}
+
+	return NO_GHOST;
+}
+
+/**
+ * @brief	Checks if a ghost can currently be eaten
+ *
+ * @param	ghost Which ghost to check
+ *
+ * @retval	1 if the ghost is frightened, 0 otherwise
+ */
+uint8_t IsGhostFrightened(uint8_t ghost)
+{
+	return ghosts[ghost].frightened;
+}
+
+/**
+ * @brief	Sends an eaten ghost back to its starting position
+ *
+ * @param	ghost Which ghost got eaten
+ *
+ * @retval	none
+ */
+void EatGhost(uint8_t ghost)
+{
+	Ghost *cur = &ghosts[ghost];
+	uint8_t i;
+
+	cur->character.row = ghost_info[ghost].start_row;
+	cur->character.col = ghost_info[ghost].start_col;
+	cur->dir = ghost_info[ghost].start_dir;
+	cur->frightened = 0;
+
+	UpdateGhostSprite(ghost);
+
+	// Another ghost might still be in the cell it left
+	memset(ghost_cells, 0, sizeof(ghost_cells));
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+		SET_GRIDARRAY_BIT(ghost_cells, ghosts[i].character.row, ghosts[i].character.col);
+}
+
+/**
+ * @brief	Makes every ghost frightened (edible, and moving randomly
+ * 			at half speed) for a number of game ticks
+ *
+ * @param	ticks How long the ghosts stay frightened
+ *
+ * @retval	none
+ */
+void FrightenGhosts(uint16_t ticks)
+{
+	uint8_t i;
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+	{
+		ghosts[i].frightened = 1;
+		ghosts[i].dir = opposite_dir[ghosts[i].dir];
+		UpdateGhostSprite(i);
+	}
+
+	frightened_ticks_left = ticks;
+}
+
+/**
+ * @brief	Turns the pathfinding budget off or back on. Without the budget,
+ * 			the ghosts' moves only depend on the game state and not on how
+ * 			long anything took, so a game can be replayed exactly.
+ *
+ * @param	on 1 to ignore GHOST_CYCLE_BUDGET, 0 to enforce it
+ *
+ * @retval	none
+ */
+void SetGhostDeterministic(uint8_t on)
+{
+	ignore_budget = on;
+}
+
+/**
+ * @brief	Gets the cell a ghost is in
+ *
+ * @param	ghost Which ghost
+ * @param	row Where to store the ghost's row
+ * @param	col Where to store the ghost's column
+ *
+ * @retval	none
+ */
+void GetGhostCell(uint8_t ghost, uint8_t *row, uint8_t *col)
+{
+	*row = ghosts[ghost].character.row;
+	*col = ghosts[ghost].character.col;
+}
@@ -6,36 +6,53 @@
 #include "utility.h"
 #include "LedMatrix.h"
 #include "UART.h"
-#include "Pacman.h"
+#include "pacman.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "stream.h"
+#include "scheduler.h"
+#include "replay.h"
+#include "capture.h"
 
 int main(void)
 {
 	// Enable clocks
-	SYSCTL_RCGCTIMER_R = 0x3;	// Enable clock for timers 0 and 1
+	SYSCTL_RCGCTIMER_R = 0x7;	// Enable clock for timers 0, 1, and 2
 	SYSCTL_RCGCGPIO_R |= 0x00000007;	// Activate clock for Port A, B, and C
 	SYSCTL_RCGCUART_R |= SYSCTL_RCGCUART_R4;	// Activate clock for UART 4
 
 	// Initialize PLL to give us an 80MHz SYSCLK
 	InitPLL(4);
 
+	// Start the cycle counter used for profiling
+	InitCycleCounter();
+	ResetProfiler();
+
 	// Initialize hardware to drive the led matrix
 	InitMatrixDriver();
 
+	// Set up the commands that can be received over the UART
+	InitProtocol();
+	InitStream();
+	InitReplay();
+	InitCapture();
+	SchedulerRegister(EVENT_INPUT, ProcessInput);
+
 	// Initialize the hardware needed to play the game
 	InitGame();
 
 	// Initialize the UART
-	InitUART(521);
+	InitUART(BAUD_RATE);
 
 	// Enable timer that drives the LED matrix
 	TIMER0_CTL_R |= 0x1;
 
+	// Make up for the time the rows are lit outside of the BCM timer period
+	CalibrateMatrix(NULL);
+
 	// Enable timer that drives the main game loop
 	TIMER1_CTL_R |= 0x1;
 
-	// Main While Loop
-	while(1)
-	{
-
-	}
+	// Run the game and handle input whenever an interrupt asks for it, sleeping in between
+	RunScheduler();
 }
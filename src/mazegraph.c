@@ -0,0 +1,399 @@
+#include <stdint.h>
+#include <string.h>
+#include "mazegraph.h"
+#include "utility.h"
+
+#define OPPOSITE(dir) (((dir) + 2) % MAZE_DIRS)
+
+// One end of the corridor a cell is in
+typedef struct CorridorEnd_t
+{
+	uint8_t node;
+	uint8_t dist;
+} CorridorEnd;
+
+static GridRow *cur_walls;			// Walls of the level the graph is of
+static const MazeGraph *cur_graph;	// 0 while there's no graph
+static GridArray node_cells;		// 1 for every cell that is a node
+
+/**
+ * @brief	Moves to the next cell in a direction, wrapping around the
+ * 			edges of the level like pacman does
+ *
+ * @param	row The row of the cell (updated)
+ * @param	col The column of the cell (updated)
+ * @param	dir Which way to move
+ *
+ * @retval	1 if the new cell isn't a wall, 0 if it is
+ */
+static uint8_t Step(uint8_t *row, uint8_t *col, MazeDir dir)
+{
+	switch(dir)
+	{
+		case MAZE_UP:
+			*row = (*row == 0) ? MAX_ROWS - 1 : *row - 1;
+			break;
+		case MAZE_LEFT:
+			*col = (*col == 0) ? MAX_COLS - 1 : *col - 1;
+			break;
+		case MAZE_DOWN:
+			*row = (*row == MAX_ROWS - 1) ? 0 : *row + 1;
+			break;
+		case MAZE_RIGHT:
+		default:
+			*col = (*col == MAX_COLS - 1) ? 0 : *col + 1;
+			break;
+	}
+
+	return GET_GRIDARRAY_BIT(cur_walls, *row, *col) != 1;
+}
+
+/**
+ * @brief	Finds which directions can be moved in from a cell
+ *
+ * @param	row The row of the cell
+ * @param	col The column of the cell
+ *
+ * @retval	A bitmask with bit n set if direction n is open
+ */
+static uint8_t OpenDirs(uint8_t row, uint8_t col)
+{
+	uint8_t dir, r, c, open = 0;
+
+	for(dir = 0; dir < MAZE_DIRS; ++dir)
+	{
+		r = row;
+		c = col;
+
+		if(Step(&r, &c, (MazeDir)dir))
+			open |= 1 << dir;
+	}
+
+	return open;
+}
+
+/**
+ * @brief	Finds the index of the node at a cell
+ *
+ * @param	row The row of the cell
+ * @param	col The column of the cell
+ *
+ * @retval	The node's index, or MAZE_NO_NODE if the cell isn't a node
+ */
+static uint8_t FindNode(uint8_t row, uint8_t col)
+{
+	uint8_t i;
+
+	if(GET_GRIDARRAY_BIT(node_cells, row, col) != 1)
+		return MAZE_NO_NODE;
+
+	for(i = 0; i < cur_graph->num_nodes; ++i)
+	{
+		if(cur_graph->nodes[i].row == row && cur_graph->nodes[i].col == col)
+			return i;
+	}
+
+	return MAZE_NO_NODE;
+}
+
+/**
+ * @brief	Follows a corridor from a cell until it reaches a node
+ *
+ * @param	row The row of the starting cell
+ * @param	col The column of the starting cell
+ * @param	dir The direction to leave the starting cell in (must be open)
+ * @param	end The node the corridor ends at and how far away it is (output)
+ * @param	target_row The row of a cell to look out for along the way
+ * @param	target_col The column of a cell to look out for along the way
+ *
+ * @retval	How far away the target cell is along the corridor, or MAZE_NO_PATH if it wasn't passed
+ */
+static uint8_t WalkCorridor(uint8_t row, uint8_t col, MazeDir dir, CorridorEnd *end, uint8_t target_row, uint8_t target_col)
+{
+	uint16_t length = 0;
+	uint8_t target_dist = MAZE_NO_PATH;
+	uint8_t open;
+
+	end->node = MAZE_NO_NODE;
+	end->dist = MAZE_NO_PATH;
+
+	// A corridor can't be longer than the level (this also stops loops without any nodes)
+	while(length < MAZE_NO_PATH - 1)
+	{
+		Step(&row, &col, dir);
+		length++;
+
+		if(row == target_row && col == target_col && target_dist == MAZE_NO_PATH)
+			target_dist = length;
+
+		if(GET_GRIDARRAY_BIT(node_cells, row, col) == 1)
+		{
+			end->node = FindNode(row, col);
+			end->dist = length;
+			break;
+		}
+
+		// Corridor cells have exactly two ways out, take the one that wasn't the way in
+		open = OpenDirs(row, col) & ~(1 << OPPOSITE(dir));
+		dir = (MazeDir)COUNT_TRAILING_ZEROS(open);
+	}
+
+	return target_dist;
+}
+
+/**
+ * @brief	Counts how many ways out of a cell there are
+ *
+ * @param	open The cell's open directions (from OpenDirs())
+ *
+ * @retval	The number of open directions
+ */
+static uint8_t CountDirs(uint8_t open)
+{
+	uint8_t count = 0;
+
+	for(; open != 0; open &= open - 1)
+		count++;
+
+	return count;
+}
+
+/**
+ * @brief	Uses a compiled graph for the distances in a level. The graph
+ * 			only stores its nodes, so the cells they're in get marked here.
+ *
+ * @param	walls The level's walls (the array itself is used, not a copy)
+ * @param	graph The level's graph (from BuildMazeGraph()), or 0 to stop using a graph
+ *
+ * @retval	none
+ */
+void SetMazeGraph(GridArray walls, const MazeGraph *graph)
+{
+	uint8_t i;
+
+	cur_walls = walls;
+	cur_graph = graph;
+	memset(node_cells, 0, sizeof(node_cells));
+
+	for(i = 0; graph != 0 && i < graph->num_nodes; ++i)
+		SET_GRIDARRAY_BIT(node_cells, graph->nodes[i].row, graph->nodes[i].col);
+}
+
+/**
+ * @brief	Compiles the walls of a level into a graph. Every open cell that
+ * 			isn't in the middle of a corridor (anything without exactly two
+ * 			ways out) becomes a node, the corridors between them become edges
+ * 			(including the ones that wrap around the edges of the level), and
+ * 			the shortest distances between every pair of nodes get computed.
+ *
+ * 			This takes too long and too much RAM to do on the target every
+ * 			time a level gets loaded, so host/mazegen.c runs it on the
+ * 			built-in level and writes the result into a const table (see
+ * 			builtin_maze_graph). Open levels with more than MAZE_MAX_NODES
+ * 			nodes can't be compiled, and should be searched directly (see
+ * 			pathfind.h).
+ *
+ * @param	walls The level's walls (the array itself is used, not a copy)
+ * @param	nodes Where to store the nodes
+ * @param	distance Where to store the distances between the nodes
+ * @param	graph The graph, pointing at nodes and distance (output)
+ *
+ * @retval	1 if the graph was built and is now used, 0 if the level has too many nodes
+ */
+uint8_t BuildMazeGraph(GridArray walls, MazeNode nodes[MAZE_MAX_NODES], uint8_t distance[MAZE_MAX_NODES * MAZE_MAX_NODES], MazeGraph *graph)
+{
+	uint8_t row, col, open, dir, i, j, k, n = 0;
+	uint16_t through;
+	CorridorEnd end;
+
+	SetMazeGraph(walls, 0);
+
+	// Find the nodes
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(col = 0; col < MAX_COLS; ++col)
+		{
+			if(GET_GRIDARRAY_BIT(walls, row, col) == 1 || CountDirs(OpenDirs(row, col)) == 2)
+				continue;
+
+			if(n == MAZE_MAX_NODES)
+				return 0;
+
+			nodes[n].row = row;
+			nodes[n].col = col;
+			n++;
+		}
+	}
+
+	graph->num_nodes = n;
+	graph->nodes = nodes;
+	graph->distance = distance;
+	SetMazeGraph(walls, graph);
+
+	// Follow every corridor leading out of every node
+	memset(distance, MAZE_NO_PATH, n * n);
+
+	for(i = 0; i < n; ++i)
+	{
+		open = OpenDirs(nodes[i].row, nodes[i].col);
+		distance[i * n + i] = 0;
+
+		for(dir = 0; dir < MAZE_DIRS; ++dir)
+		{
+			nodes[i].neighbor[dir] = MAZE_NO_NODE;
+			nodes[i].length[dir] = MAZE_NO_PATH;
+
+			if((open & (1 << dir)) == 0)
+				continue;
+
+			WalkCorridor(nodes[i].row, nodes[i].col, (MazeDir)dir, &end, MAX_ROWS, MAX_COLS);
+			nodes[i].neighbor[dir] = end.node;
+			nodes[i].length[dir] = end.dist;
+
+			if(end.node != MAZE_NO_NODE && end.dist < distance[i * n + end.node])
+				distance[i * n + end.node] = end.dist;
+		}
+	}
+
+	// Floyd-Warshall for the distances between every pair of nodes
+	for(k = 0; k < n; ++k)
+	{
+		for(i = 0; i < n; ++i)
+		{
+			if(distance[i * n + k] == MAZE_NO_PATH)
+				continue;
+
+			for(j = 0; j < n; ++j)
+			{
+				through = distance[i * n + k] + distance[k * n + j];
+
+				if(through < distance[i * n + j])
+					distance[i * n + j] = through;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @brief	Checks whether the graph of the current level could be built
+ *
+ * @param	none
+ *
+ * @retval	1 if the graph can be used, 0 otherwise
+ */
+uint8_t IsMazeGraphValid(void)
+{
+	return cur_graph != 0;
+}
+
+/**
+ * @brief	Returns the number of junctions (and dead ends) in the graph
+ *
+ * @param	none
+ *
+ * @retval	The number of nodes
+ */
+uint8_t MazeNodeCount(void)
+{
+	return (cur_graph != 0) ? cur_graph->num_nodes : 0;
+}
+
+/**
+ * @brief	Returns the shortest path length between two open cells. Each
+ * 			cell gets located on the graph (either it's a node, or it's in
+ * 			a corridor between two nodes), then the lengths along the
+ * 			corridors get added to the distance between the nodes.
+ *
+ * @param	from_row The row of the starting cell
+ * @param	from_col The column of the starting cell
+ * @param	to_row The row of the target cell
+ * @param	to_col The column of the target cell
+ *
+ * @retval	The number of moves needed, or MAZE_NO_PATH if there's no path, the graph
+ * 			isn't valid, or either cell is a wall. Paths between nodes longer than 254
+ * 			moves aren't stored, and lengths above 254 are returned as 254.
+ */
+uint8_t MazeGraphDistance(uint8_t from_row, uint8_t from_col, uint8_t to_row, uint8_t to_col)
+{
+	CorridorEnd from_ends[2], to_ends[2];
+	uint8_t num_from = 0, num_to = 0, i, j, dir, open, direct, between;
+	uint16_t dist, best = 0xFFFF;
+
+	if(cur_graph == 0 ||
+		GET_GRIDARRAY_BIT(cur_walls, from_row, from_col) == 1 ||
+		GET_GRIDARRAY_BIT(cur_walls, to_row, to_col) == 1)
+		return MAZE_NO_PATH;
+
+	if(from_row == to_row && from_col == to_col)
+		return 0;
+
+	// Find the nodes the starting cell can reach without passing another node
+	if(GET_GRIDARRAY_BIT(node_cells, from_row, from_col) == 1)
+	{
+		from_ends[0].node = FindNode(from_row, from_col);
+		from_ends[0].dist = 0;
+		num_from = 1;
+	}
+	else
+	{
+		open = OpenDirs(from_row, from_col);
+
+		for(dir = 0; dir < MAZE_DIRS; ++dir)
+		{
+			if((open & (1 << dir)) == 0)
+				continue;
+
+			// The target might be in the same corridor
+			direct = WalkCorridor(from_row, from_col, (MazeDir)dir, &from_ends[num_from], to_row, to_col);
+
+			if(direct != MAZE_NO_PATH && direct < best)
+				best = direct;
+
+			num_from++;
+		}
+	}
+
+	// Same for the target cell
+	if(GET_GRIDARRAY_BIT(node_cells, to_row, to_col) == 1)
+	{
+		to_ends[0].node = FindNode(to_row, to_col);
+		to_ends[0].dist = 0;
+		num_to = 1;
+	}
+	else
+	{
+		open = OpenDirs(to_row, to_col);
+
+		for(dir = 0; dir < MAZE_DIRS; ++dir)
+		{
+			if((open & (1 << dir)) != 0)
+				WalkCorridor(to_row, to_col, (MazeDir)dir, &to_ends[num_to++], MAX_ROWS, MAX_COLS);
+		}
+	}
+
+	for(i = 0; i < num_from; ++i)
+	{
+		for(j = 0; j < num_to; ++j)
+		{
+			if(from_ends[i].node == MAZE_NO_NODE || to_ends[j].node == MAZE_NO_NODE)
+				continue;
+
+			between = cur_graph->distance[from_ends[i].node * cur_graph->num_nodes + to_ends[j].node];
+
+			if(between == MAZE_NO_PATH)
+				continue;
+
+			dist = from_ends[i].dist + between + to_ends[j].dist;
+
+			if(dist < best)
+				best = dist;
+		}
+	}
+
+	if(best == 0xFFFF)
+		return MAZE_NO_PATH;
+
+	return (best > MAZE_NO_PATH - 1) ? MAZE_NO_PATH - 1 : best;
+}
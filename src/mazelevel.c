@@ -0,0 +1,7 @@
+#include <stdint.h>
+#include "mazegraph.h"
+
+// Generated by host/mazegen.c from the built-in level in pacman.c, don't edit
+
+// The level has more than MAZE_MAX_NODES junctions, so the ghosts search it cell by cell
+const MazeGraph *const builtin_maze_graph = 0;
@@ -1,14 +1,83 @@
 #include <stdint.h>
+#include <string.h>
 #include "pacman.h"
 #include "LedMatrix.h"
+#include "profiler.h"
+#include "pathfind.h"
+#include "ghost.h"
+#include "mazegraph.h"
+#include "UART.h"
+#include "protocol.h"
+#include "stream.h"
+#include "scheduler.h"
+#include "replay.h"
+#include "benchmark.h"
 
 // Pacman's current direction
 static PacmanDir cur_pacman_dir = RIGHT;
 
+// The direction pacman moved in on the last game tick (the input can change cur_pacman_dir before the next one)
+static PacmanDir tick_pacman_dir = RIGHT;
+
+// Where pacman starts the level
+#define PACMAN_START_ROW 1
+#define PACMAN_START_COL 1
+
 // Pacman himself
-static Character pacman = {1, 1, {127, 127, 0} };
+static Character pacman = {PACMAN_START_ROW, PACMAN_START_COL, {COLOR_MAX, COLOR_MAX, 0} };
+
+// Colors used to draw the level
+static const Color wall_color = {0, COLOR_MAX, COLOR_MAX};
+static const Color pellet_color = {COLOR_MAX, COLOR_MAX, COLOR_MAX};
+
+// Layers the level is drawn on (pellets over walls), and pacman's sprite (over the ghosts)
+#define WALL_LAYER 0
+#define PELLET_LAYER 1
+#define PACMAN_SPRITE (GHOST_SPRITE + GHOST_COUNT)
+
+#if PACMAN_SPRITE >= MATRIX_SPRITES
+#error "Not enough sprites for pacman and the ghosts"
+#endif
+
+// The pellets of the current level before any got eaten, restored by ResetGame()
+static GridArray start_pellets;
+
+// A level uploaded over the UART, loaded by the game loop once both halves have arrived
+static GridArray new_level;
+static GridArray new_pellets;
+static volatile uint8_t new_level_ready;
+
+// Set once a level was uploaded, which (unlike the built-in level) has no compiled maze graph
+static uint8_t level_uploaded;
+
+// Set while the display is showing streamed frames, so the game knows to redraw everything afterwards
+static uint8_t was_streaming;
+
+// Set when a game tick couldn't draw its frame because the last one was still pending
+static uint8_t compose_deferred;
+
+// Set by PauseGame(), the game ticks stop until it's cleared
+static uint8_t paused;
+
+// Number of received bytes handled at a time, so a burst of input can't hold up the game tick
+#define INPUT_SLICE 64
+
+// The slice of received bytes being handled, and how far into it ProcessInput() got
+static uint8_t input[INPUT_SLICE];
+static uint8_t input_count, input_next;
+
+// How much the "-" and "=" keys change the brightness of the display
+#define BRIGHTNESS_STEP 32
+
+// How many game ticks the ghosts stay frightened after pacman eats a power pellet
+#define POWER_PELLET_TICKS 40	// 6 seconds
+
+// Size of the built-in level, which sits in the top left of bigger displays
+#define BUILTIN_LEVEL_ROWS 32
+#define BUILTIN_LEVEL_COLS 32
 
-// The 32x32 grid array that defines the walls of the level
+// The grid array that defines the walls of the level (the built-in level, walled off by InitGame() on bigger displays).
+// Its maze graph (none, for an open room) is compiled into mazelevel.c, run "make -C host mazelevel" after changing it.
 GridArray level =
 {
 	0xFFFFFFFF,
@@ -81,83 +150,313 @@ static GridArray pellets = {
 	0x00000000,
 };
 
+// The pellets of the built-in level that frighten the ghosts when eaten (uploaded levels have none)
+static GridArray power_pellets = {
+	0x00000000,
+	0x00081000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00081000,
+	0x00000000,
+};
+
 /**
- * @brief	Initializes the hardware needed to play the game.
- * 			This function must be called before the game can
- * 			run.
+ * @brief	Puts the level on the display layers (redrawing the whole
+ * 			display, which frees the colors the old level used) and resets
+ * 			pacman, the pathfinding, and the ghosts. Must be called whenever
+ * 			the level or pellet grids get replaced.
  *
  * @param	none
  *
  * @retval	none
  */
-void InitGame(void)
+static void LoadLevel(void)
 {
-	// Timer initialization
-	TIMER1_CTL_R &= ~0x1;	// Disable timer
-	TIMER1_CFG_R = 0;		// 32-bit timer
-	TIMER1_TAMR_R |= 0x32;	// Set it to periodic mode, counting up, interrupt enabled
-	TIMER1_TAILR_R = 20000000;	// count up to 20_000_000 before reloading
-	TIMER1_TAMATCHR_R = 20000000;	// Trigger interrupt after 150ms has passed
-	TIMER1_IMR_R |= 0x10;	// Enable timer A match interrupt
+	pacman.row = PACMAN_START_ROW;
+	pacman.col = PACMAN_START_COL;
 
-	// Enable Timer1A interrupt in NVIC
-	NVIC_EN0_R |= 0x200000;
+	memcpy(start_pellets, pellets, sizeof(start_pellets));
+	InvalidateLayers();
+	SetLayer(WALL_LAYER, level, wall_color);
+	SetLayer(PELLET_LAYER, pellets, pellet_color);
+	SetPathLevel(level);
+	SetMazeGraph(level, level_uploaded ? 0 : builtin_maze_graph);
+	SetGhostLevel();
+	ResetGhosts();
+}
 
-	// Set Timer1 to priority level 1
-	NVIC_PRI5_R |= 0x2000;
+#if MAX_ROWS > BUILTIN_LEVEL_ROWS || MAX_COLS > BUILTIN_LEVEL_COLS
+/**
+ * @brief	Fills the part of a bigger display outside of the built-in
+ * 			level with walls, so nothing can leave the level.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void WallOffBuiltinLevel(void)
+{
+	uint8_t row;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+		level[row] |= (row < BUILTIN_LEVEL_ROWS) ? (GridRow)~(GridRow)0xFFFFFFFF : GRIDROW_ALL;
 }
+#endif
 
 /**
- * @brief	Receive interrupt for UART4. Grabs information
- * 			used to determine which direction pacman will move.
+ * @brief	Restarts the current level with all of its pellets, and
+ * 			seeds the random numbers, so the game always plays out the
+ * 			same way for the same input
+ *
+ * @param	seed The seed for the random numbers
+ *
+ * @retval	none
+ */
+void ResetGame(uint32_t seed)
+{
+	memcpy(pellets, start_pellets, sizeof(pellets));
+	LoadLevel();
+
+	cur_pacman_dir = RIGHT;
+	tick_pacman_dir = RIGHT;
+	SeedGhostRandom(seed);
+}
+
+/**
+ * @brief	Stops or restarts the game ticks. The last frame stays on the display.
+ *
+ * @param	pause 1 to pause the game, 0 to let it run
+ *
+ * @retval	none
+ */
+void PauseGame(uint8_t pause)
+{
+	paused = pause;
+}
+
+/**
+ * @brief	Hashes (FNV-1a) everything that changes while the game is
+ * 			played: pacman (with the direction the last tick moved him in,
+ * 			not input that no tick has seen yet), the ghosts, and the pellets
  *
  * @param	none
  *
+ * @retval	The hash
+ */
+uint32_t GameStateHash(void)
+{
+	uint32_t hash = 2166136261UL;
+	uint8_t state[2 * (GHOST_COUNT + 1) + 1];
+	uint8_t i, row;
+
+	state[0] = pacman.row;
+	state[1] = pacman.col;
+	state[2] = tick_pacman_dir;
+
+	for(i = 0; i < GHOST_COUNT; ++i)
+		GetGhostCell(i, &state[3 + 2 * i], &state[4 + 2 * i]);
+
+	for(i = 0; i < sizeof(state); ++i)
+		hash = (hash ^ state[i]) * 16777619UL;
+
+	for(row = 0; row < MAX_ROWS; ++row)
+	{
+		for(i = 0; i < MAX_COLS; i += 8)
+			hash = (hash ^ ((pellets[row] >> i) & 0xFF)) * 16777619UL;
+	}
+
+	return hash;
+}
+
+/**
+ * @brief	Handles the single character commands. The characters
+ * 			determine which direction pacman will move, or run the
+ * 			debugging commands and change the brightness.
+ *
+ * @param	data The received character
+ *
  * @retval	none
  */
-void UART4Int(void)
+static void HandleAsciiInput(uint8_t data)
 {
-	//UART4_ICR_R |= 0x10;	// Clear interrupt flag in the UART
-	NVIC_UNPEND1_R |= 0x10000000; // Clear interrupt flag in NVIC
+	switch(data)
+	{
+		case 'w':
+			cur_pacman_dir = UP;
+			break;
+		case 'a':
+			cur_pacman_dir = LEFT;
+			break;
+		case 'd':
+			cur_pacman_dir = RIGHT;
+			break;
+		case 's':
+			cur_pacman_dir = DOWN;
+			break;
+		case 'p':
+			ProfilerReport();
+			break;
+		case 'b':
+			RunBenchmarks();
+			break;
+		case 'c':
+			RunCalibration();
+			break;
+		case '-':
+			SetBrightness((GetBrightness() > BRIGHTNESS_STEP) ? GetBrightness() - BRIGHTNESS_STEP : 0);
+			break;
+		case '=':
+			SetBrightness((GetBrightness() < BRIGHTNESS_MAX - BRIGHTNESS_STEP) ? GetBrightness() + BRIGHTNESS_STEP : BRIGHTNESS_MAX);
+			break;
+		default:
+			break;
+	}
+}
 
-	uint8_t cur_data = 0;
+/**
+ * @brief	Handles OP_INPUT, sets the direction pacman will move
+ *
+ * @param	data The direction (one byte)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void InputCommand(const uint8_t *data, uint8_t length)
+{
+	if(length == 1 && data[0] <= DOWN)
+		cur_pacman_dir = (PacmanDir)data[0];
+}
+
+/**
+ * @brief	Copies rows of a GridArray out of a command's payload. The
+ * 			payload is either the whole array, or the number of the first
+ * 			row followed by as many rows as fit in a frame (for displays
+ * 			whose arrays don't fit in one).
+ *
+ * @param	array Where to store the rows
+ * @param	data The rows, sizeof(GridRow) little endian bytes each
+ * @param	length The length of data
+ *
+ * @retval	1 if the last row of the array was stored
+ */
+static uint8_t ReadGridRows(GridArray array, const uint8_t *data, uint8_t length)
+{
+	uint8_t row, count, i;
+
+#if MAX_ROWS * MAX_COLS / 8 <= PROTOCOL_MAX_PAYLOAD
+	if(length == sizeof(GridArray))
+	{
+		row = 0;
+		count = MAX_ROWS;
+	}
+	else
+#endif
+	if(length % sizeof(GridRow) == 1 && length > 1 && data[0] + (length - 1) / sizeof(GridRow) <= MAX_ROWS)
+	{
+		row = data[0];
+		count = (length - 1) / sizeof(GridRow);
+		data++;
+	}
+	else
+		return 0;
 
-	// If there was a receive operation, handle it
-	if(UART4_MIS_R & 0x10)
+	for(; count > 0; --count, ++row, data += sizeof(GridRow))
 	{
-		cur_data = UART4_DR_R;
-
-		switch(cur_data)
-		{
-			case 'w':
-				cur_pacman_dir = UP;
-				break;
-			case 'a':
-				cur_pacman_dir = LEFT;
-				break;
-			case 'd':
-				cur_pacman_dir = RIGHT;
-				break;
-			case 's':
-				cur_pacman_dir = DOWN;
-				break;
-			default:
-				break;
-		}
+		array[row] = 0;
+
+		for(i = 0; i < sizeof(GridRow); ++i)
+			array[row] |= (GridRow)data[i] << (8 * i);
 	}
+
+	return row == MAX_ROWS;
 }
 
 /**
- * @brief	Draws a character to the matrix
+ * @brief	Handles OP_LEVEL_WALLS, stores rows of the walls of a new level
  *
- * @param	character Which character to draw
+ * @param	data The walls (see ReadGridRows())
+ * @param	length The length of data
  *
  * @retval	none
  */
-static void DrawCharacter(Character character)
+static void LevelWallsCommand(const uint8_t *data, uint8_t length)
 {
-	SetColor(character.color.R, character.color.G, character.color.B);
-	DrawPixel(character.row, character.col);
+	ReadGridRows(new_level, data, length);
+}
+
+/**
+ * @brief	Handles OP_LEVEL_PELLETS, stores rows of the pellets of a new
+ * 			level. Once the last row is stored, has the game loop load
+ * 			the level (along with the walls sent before it).
+ *
+ * @param	data The pellets (see ReadGridRows())
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void LevelPelletsCommand(const uint8_t *data, uint8_t length)
+{
+	if(ReadGridRows(new_pellets, data, length))
+		new_level_ready = 1;
+}
+
+/**
+ * @brief	Task for EVENT_INPUT, handles the bytes received over the UART.
+ * 			Only INPUT_SLICE bytes are handled per run, and the event gets
+ * 			posted again if there might be more. Once they're all handled,
+ * 			a frame that stopped halfway gets dropped if it's overdue.
+ * 			While a streamed frame waits for the last one to be displayed,
+ * 			the rest of the slice is kept for when streaming posts the
+ * 			event again.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ProcessInput(void)
+{
+	if(input_next == input_count)
+	{
+		input_count = UARTRead(input, INPUT_SLICE);
+		input_next = 0;
+	}
+
+	while(input_next < input_count && !IsStreamWaiting())
+		ProtocolReceive(input[input_next++]);
+
+	if(IsStreamWaiting())
+		return;
+
+	if(input_count == INPUT_SLICE)
+		PostEvent(EVENT_INPUT);
+	else
+		ProtocolCheckTimeout();
 }
 
 // Perform movement and collision detection
@@ -219,37 +518,179 @@ static void MovePacman(void)
 }
 
 /**
- * @brief	Timer1 interrupt, used as the main game loop
+ * @brief	Handles pacman running into a ghost. Frightened ghosts get
+ * 			eaten, otherwise pacman and the ghosts go back to where they
+ * 			started (the eaten pellets stay eaten).
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void CheckGhostCollision(void)
+{
+	uint8_t ghost = GhostCollision(pacman.row, pacman.col);
+
+	if(ghost == NO_GHOST)
+		return;
+
+	if(IsGhostFrightened(ghost))
+	{
+		EatGhost(ghost);
+		return;
+	}
+
+	pacman.row = PACMAN_START_ROW;
+	pacman.col = PACMAN_START_COL;
+	ResetGhosts();
+}
+
+/**
+ * @brief	Task for EVENT_TICK, the main game loop
  *
  * @param 	none
  *
  * @retval	none
  */
-void Timer1Int(void)
+static void GameTick(void)
 {
-	// Clear interrupt flags
-	TIMER1_ICR_R |= TIMER_ICR_TAMCINT; // Clear the interrupt flag
-	NVIC_UNPEND0_R |= 0x200000;	// Clear interrupt pending flag in NVIC
+	PROFILE_ISR_ENTER();
+
+	// The game is paused while frames are being streamed to the display
+	if(IsStreaming())
+	{
+		was_streaming = 1;
+		PROFILE_ISR_EXIT(PROFILE_GAME_TICK, 0);
+		return;
+	}
+
+	if(paused)
+	{
+		PROFILE_ISR_EXIT(PROFILE_GAME_TICK, 0);
+		return;
+	}
+
+	// Streaming drew over the whole display
+	if(was_streaming)
+	{
+		InvalidateLayers();
+		was_streaming = 0;
+	}
+
+	// Switch to a level that was uploaded
+	if(new_level_ready)
+	{
+		memcpy(level, new_level, sizeof(level));
+		memcpy(pellets, new_pellets, sizeof(pellets));
+		memset(power_pellets, 0, sizeof(power_pellets));
+		level_uploaded = 1;
+		LoadLevel();
+		new_level_ready = 0;
+	}
+
+	// Recordings and playbacks see the input at the start of the tick
+	cur_pacman_dir = ReplayTick(cur_pacman_dir);
+	tick_pacman_dir = cur_pacman_dir;
 
 	// Move pacman and perform collision detection
 	MovePacman();
 
+	// Eating a power pellet lets pacman eat the ghosts for a while
+	if(GET_GRIDARRAY_BIT(pellets, pacman.row, pacman.col) && GET_GRIDARRAY_BIT(power_pellets, pacman.row, pacman.col))
+		FrightenGhosts(POWER_PELLET_TICKS);
+
 	// Clear out the bit in the pellet grid array where pacman is currently at
 	CLEAR_GRIDARRAY_BIT(pellets, pacman.row, pacman.col);
+	SetLayerBit(PELLET_LAYER, pacman.row, pacman.col, 0);
+
+	// Check for ghosts both before and after they move, so pacman can't slip past one
+	CheckGhostCollision();
+	MoveGhosts(pacman, cur_pacman_dir);
+	CheckGhostCollision();
 
 	// Check if pacman won and do something
 
-	// Clear out the screen
-	ClearMatrix();
+	// Only the cells that changed get redrawn
+	SetSprite(PACMAN_SPRITE, pacman.row, pacman.col, pacman.color);
+	compose_deferred = !ComposeFrame();
+
+	ReplayTickDone();
+
+	PROFILE_ISR_EXIT(PROFILE_GAME_TICK, 0);
+}
+
+/**
+ * @brief	Task for EVENT_FRAME_PRESENTED, draws the frame of a game
+ * 			tick (or starts the streamed frame) that had to wait for the
+ * 			last frame to be displayed
+ *
+ * @param 	none
+ *
+ * @retval	none
+ */
+static void FramePresented(void)
+{
+	StreamFramePresented();
+
+	if(compose_deferred && !IsStreaming())
+		compose_deferred = !ComposeFrame();
+}
+
+/**
+ * @brief	Timer1 interrupt, starts a game tick
+ *
+ * @param 	none
+ *
+ * @retval	none
+ */
+void Timer1Int(void)
+{
+	// Clear interrupt flags
+	TIMER1_ICR_R |= TIMER_ICR_TAMCINT; // Clear the interrupt flag
+	NVIC_UNPEND0_R |= 0x200000;	// Clear interrupt pending flag in NVIC
+
+	// The game itself runs in thread mode, where the matrix refresh can always interrupt it
+	PostEvent(EVENT_TICK);
+
+	// Checks for a frame that stopped halfway even when no more bytes come
+	PostEvent(EVENT_INPUT);
+}
+
+/**
+ * @brief	Initializes the hardware needed to play the game.
+ * 			This function must be called before the game can
+ * 			run.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitGame(void)
+{
+	// Timer initialization
+	TIMER1_CTL_R &= ~0x1;	// Disable timer
+	TIMER1_CFG_R = 0;		// 32-bit timer
+	TIMER1_TAMR_R |= 0x32;	// Set it to periodic mode, counting up, interrupt enabled
+	TIMER1_TAILR_R = 20000000;	// count up to 20_000_000 before reloading
+	TIMER1_TAMATCHR_R = 20000000;	// Trigger interrupt after 150ms has passed
+	TIMER1_IMR_R |= 0x10;	// Enable timer A match interrupt
+
+	// Enable Timer1A interrupt in NVIC
+	NVIC_EN0_R |= 0x200000;
+
+	// Set Timer1 to priority level 1
+	NVIC_PRI5_R |= 0x2000;
 
-	// Draw level
-	SetColor(0, 127, 127);
-	DrawGridArray(level);
+	// Handle the commands that control the game
+	ProtocolSetAsciiHandler(HandleAsciiInput);
+	ProtocolRegister(OP_INPUT, InputCommand);
+	ProtocolRegister(OP_LEVEL_WALLS, LevelWallsCommand);
+	ProtocolRegister(OP_LEVEL_PELLETS, LevelPelletsCommand);
 
-	// Draw pellets
-	SetColor(127, 127, 127);
-	DrawGridArray(pellets);
+	SchedulerRegister(EVENT_TICK, GameTick);
+	SchedulerRegister(EVENT_FRAME_PRESENTED, FramePresented);
 
-	// Draw Pacman
-	DrawCharacter(pacman);
+#if MAX_ROWS > BUILTIN_LEVEL_ROWS || MAX_COLS > BUILTIN_LEVEL_COLS
+	WallOffBuiltinLevel();
+#endif
+	LoadLevel();
 }
@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <string.h>
+#include "pathfind.h"
+#include "utility.h"
+
+// A cached distance field and the cell it was computed from
+typedef struct PathCacheEntry_t
+{
+	uint16_t target;	// row * MAX_COLS + col, or NO_TARGET if this entry is unused
+	uint16_t last_used;	// Value of use_counter the last time this entry was requested
+	DistanceField field;
+} PathCacheEntry;
+
+#define NO_TARGET 0xFFFF
+
+// Rotates a row of a GridArray by one column, which also follows the wrap-around tunnels
+#define ROTATE_LEFT(bits) (((bits) << 1) | ((bits) >> (MAX_COLS - 1)))
+#define ROTATE_RIGHT(bits) (((bits) >> 1) | ((bits) << (MAX_COLS - 1)))
+
+static GridRow *cur_walls;	// The walls of the level being pathfound over
+static PathCacheEntry cache[PATH_CACHE_SIZE];
+static uint16_t use_counter;	// Incremented every time a field is requested (for least recently used replacement)
+
+/**
+ * @brief	Sets the walls used for pathfinding. Every cached distance
+ * 			field is thrown away, so call this whenever the level changes.
+ *
+ * @param	walls The level's walls (the array itself is used, not a copy)
+ *
+ * @retval	none
+ */
+void SetPathLevel(GridArray walls)
+{
+	uint8_t i;
+
+	cur_walls = walls;
+
+	for(i = 0; i < PATH_CACHE_SIZE; ++i)
+		cache[i].target = NO_TARGET;
+}
+
+/**
+ * @brief	Grows a breadth first search's frontier by one step in every
+ * 			direction: each row of the frontier gets shifted left and right
+ * 			(rotated, so the wrap-around tunnels are followed) and ORed with
+ * 			the rows above and below it (also wrapping), then masked against
+ * 			the walls and the cells that were already reached.
+ *
+ * @param	walls The walls of the level
+ * @param	frontier The cells reached by the last step (replaced by the ones reached by this step)
+ * @param	reached Every cell reached so far (updated)
+ *
+ * @retval	Nonzero if any new cell was reached
+ */
+static GridRow GrowFrontier(GridArray walls, GridArray frontier, GridArray reached)
+{
+	GridArray next;
+	GridRow any = 0;
+	uint8_t r, above, below;
+
+	for(r = 0; r < MAX_ROWS; ++r)
+	{
+		above = (r == 0) ? MAX_ROWS - 1 : r - 1;
+		below = (r == MAX_ROWS - 1) ? 0 : r + 1;
+
+		next[r] = (ROTATE_LEFT(frontier[r]) | ROTATE_RIGHT(frontier[r]) | frontier[above] | frontier[below]) & ~walls[r] & ~reached[r];
+		any |= next[r];
+	}
+
+	for(r = 0; r < MAX_ROWS; ++r)
+	{
+		reached[r] |= next[r];
+		frontier[r] = next[r];
+	}
+
+	return any;
+}
+
+/**
+ * @brief	Fills in the shortest path length from every cell to a target cell.
+ *
+ * 			This is a breadth first search that expands a whole row of the
+ * 			frontier at once (see GrowFrontier()). Only writing the distances
+ * 			out touches individual cells, and each reachable cell is only
+ * 			written once.
+ *
+ * 			The target may be a wall; distances are then measured to it as if
+ * 			it were open. Distances longer than 254 are stored as 254.
+ *
+ * @param	walls The walls of the level
+ * @param	row The row of the target cell
+ * @param	col The column of the target cell
+ * @param	field Where to store the distances (PATH_UNREACHABLE for walls and cut off cells)
+ *
+ * @retval	none
+ */
+void ComputeDistanceField(GridArray walls, uint8_t row, uint8_t col, DistanceField field)
+{
+	GridArray frontier = {0}, reached = {0};
+	GridRow bits, any = 1;
+	uint8_t r, c;
+	uint8_t dist = 0;
+
+	memset(field, PATH_UNREACHABLE, sizeof(DistanceField));
+
+	frontier[row] = (GridRow)1 << col;
+	reached[row] = frontier[row];
+
+	while(any != 0)
+	{
+		// Write out the distance of every cell reached during the last step
+		for(r = 0; r < MAX_ROWS; ++r)
+		{
+			bits = frontier[r];
+
+			while(bits != 0)
+			{
+				c = GRIDROW_CTZ(bits);
+				field[r][c] = dist;
+				bits &= bits - 1;
+			}
+		}
+
+		if(dist < PATH_UNREACHABLE - 1)
+			dist++;
+
+		any = GrowFrontier(walls, frontier, reached);
+	}
+}
+
+/**
+ * @brief	Finds every cell that can be reached from a cell, with the
+ * 			same breadth first search as ComputeDistanceField() but
+ * 			without the distances
+ *
+ * @param	walls The walls of the level
+ * @param	row The row of the starting cell
+ * @param	col The column of the starting cell
+ * @param	reached Where to set the bit of every reachable cell, including the
+ * 				    starting cell. Cells already set count as reached, so it
+ * 				    has to be cleared or only hold cells set by earlier calls.
+ *
+ * @retval	none
+ */
+void ReachableCells(GridArray walls, uint8_t row, uint8_t col, GridArray reached)
+{
+	GridArray frontier = {0};
+
+	frontier[row] = (GridRow)1 << col;
+	reached[row] |= frontier[row];
+
+	while(GrowFrontier(walls, frontier, reached) != 0);
+}
+
+/**
+ * @brief	Returns the distance field for a target cell of the current level.
+ * 			The field is only computed if it isn't already cached, otherwise
+ * 			the least recently used cached field gets replaced.
+ *
+ * @param	row The row of the target cell
+ * @param	col The column of the target cell
+ *
+ * @retval	The distance field, valid until PATH_CACHE_SIZE other targets have been requested
+ * 			or SetPathLevel() is called
+ */
+const DistanceField *GetDistanceField(uint8_t row, uint8_t col)
+{
+	uint16_t target = row * MAX_COLS + col;
+	PathCacheEntry *oldest = &cache[0];
+	uint8_t i;
+
+	use_counter++;
+
+	for(i = 0; i < PATH_CACHE_SIZE; ++i)
+	{
+		if(cache[i].target == target)
+		{
+			cache[i].last_used = use_counter;
+			return &cache[i].field;
+		}
+
+		// Unused entries always get replaced first
+		if(cache[i].target == NO_TARGET)
+			oldest = &cache[i];
+		else if(oldest->target != NO_TARGET && (uint16_t)(use_counter - cache[i].last_used) > (uint16_t)(use_counter - oldest->last_used))
+			oldest = &cache[i];
+	}
+
+	ComputeDistanceField(cur_walls, row, col, oldest->field);
+	oldest->target = target;
+	oldest->last_used = use_counter;
+
+	return &oldest->field;
+}
+
+/**
+ * @brief	Checks whether GetDistanceField() can return a target's
+ * 			distance field without computing it
+ *
+ * @param	row The row of the target cell
+ * @param	col The column of the target cell
+ *
+ * @retval	1 if the field is cached, 0 otherwise
+ */
+uint8_t IsDistanceFieldCached(uint8_t row, uint8_t col)
+{
+	uint16_t target = row * MAX_COLS + col;
+	uint8_t i;
+
+	for(i = 0; i < PATH_CACHE_SIZE; ++i)
+	{
+		if(cache[i].target == target)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Returns the shortest path length between two cells of the current level
+ *
+ * @param	from_row The row of the starting cell
+ * @param	from_col The column of the starting cell
+ * @param	to_row The row of the target cell
+ * @param	to_col The column of the target cell
+ *
+ * @retval	The number of moves needed, or PATH_UNREACHABLE if there's no path
+ */
+uint8_t PathDistance(uint8_t from_row, uint8_t from_col, uint8_t to_row, uint8_t to_col)
+{
+	return (*GetDistanceField(to_row, to_col))[from_row][from_col];
+}
@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <string.h>
+#include "profiler.h"
+#include "UART.h"
+#include "LedMatrix.h"
+
+// Timing statistics for a single interrupt (all durations are in SYSCLK cycles)
+typedef struct ProfileStats_t
+{
+	uint32_t count;		// Number of times the interrupt ran
+	uint32_t min;		// Shortest run
+	uint32_t max;		// Longest run
+	uint64_t total;		// Sum of every run, used for the mean
+	uint32_t missed;	// Number of runs that took longer than their budget
+	uint32_t histogram[PROFILE_BUCKETS];	// Runs bucketed by log2 of their duration
+} ProfileStats;
+
+static ProfileStats stats[PROFILE_COUNT];
+
+// Names used in the report
+static const char * const profile_names[PROFILE_COUNT] = { "Timer0AInt", "GameTick", "UART4Int", "MoveGhosts" };
+
+/**
+ * @brief	Clears all of the collected statistics
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ResetProfiler(void)
+{
+	uint8_t id;
+
+	memset(stats, 0, sizeof(stats));
+
+	for(id = 0; id < PROFILE_COUNT; ++id)
+		stats[id].min = 0xFFFFFFFF;
+}
+
+/**
+ * @brief	Adds one run of an interrupt to its statistics. Normally
+ * 			called through PROFILE_ISR_EXIT().
+ *
+ * @param	id Which interrupt ran
+ * @param	cycles How long it ran for
+ * @param	budget The most cycles it was allowed to take (0 for no limit)
+ *
+ * @retval	none
+ */
+void ProfileRecord(ProfileId id, uint32_t cycles, uint32_t budget)
+{
+	ProfileStats *cur = &stats[id];
+
+	cur->count++;
+	cur->total += cycles;
+
+	if(cycles < cur->min)
+		cur->min = cycles;
+	if(cycles > cur->max)
+		cur->max = cycles;
+
+	if(budget != 0 && cycles > budget)
+		cur->missed++;
+
+	if(cycles == 0)
+		cur->histogram[0]++;
+	else
+		cur->histogram[31 - COUNT_LEADING_ZEROS(cycles)]++;
+}
+
+/**
+ * @brief	Sends a report of every interrupt's statistics over the
+ * 			UART, then starts collecting new statistics.
+ *
+ * 			The first line describes the display timing:
+ * 				bcm bits=<BCM_BITS> frc=<BCM_FRC_BITS> base=<cycles> refresh=<Hz> isr=<Hz> polled=<planes> isrs/frame=<count> cpu=<per mille>
+ * 			where cpu is the share of the CPU time the refresh interrupt takes
+ * 			(from its mean run length, 0 if it didn't run)
+ *
+ * 			Then each interrupt gets one line:
+ * 				<name> n=<count> min=<cycles> max=<cycles> mean=<cycles> missed=<count>
+ * 			followed by a line with every non-empty histogram bucket:
+ * 				 <log2 of bucket start>:<count> ...
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ProfilerReport(void)
+{
+	static ProfileStats snapshot[PROFILE_COUNT];
+	uint8_t id, bucket;
+	uint32_t masked;
+
+	// Copy the statistics so the interrupts can keep running while they're sent
+	masked = SAVE_AND_DISABLE_INTERRUPTS();
+	memcpy(snapshot, stats, sizeof(snapshot));
+	ResetProfiler();
+	RESTORE_INTERRUPTS(masked);
+
+	UARTWriteString("bcm bits=");
+	UARTWriteNumber(BCM_BITS);
+	UARTWriteString(" frc=");
+	UARTWriteNumber(BCM_FRC_BITS);
+	UARTWriteString(" base=");
+	UARTWriteNumber(BCM_BASE_TICKS);
+	UARTWriteString(" refresh=");
+	UARTWriteNumber(BCM_REFRESH_HZ);
+	UARTWriteString(" isr=");
+	UARTWriteNumber(BCM_ISR_RATE_HZ);
+	UARTWriteString(" polled=");
+	UARTWriteNumber(BCM_POLLED_PLANES);
+	UARTWriteString(" isrs/frame=");
+	UARTWriteNumber(BCM_ISRS_PER_FRAME);
+	UARTWriteString(" cpu=");
+
+	if(snapshot[PROFILE_TIMER0A].count != 0)
+		UARTWriteNumber((uint32_t)(snapshot[PROFILE_TIMER0A].total / snapshot[PROFILE_TIMER0A].count * BCM_ISR_RATE_HZ / (SYSCLK / 1000)));
+	else
+		UARTWriteNumber(0);
+
+	UARTWriteString("\r\n");
+
+	for(id = 0; id < PROFILE_COUNT; ++id)
+	{
+		UARTWriteString(profile_names[id]);
+		UARTWriteString(" n=");
+		UARTWriteNumber(snapshot[id].count);
+
+		if(snapshot[id].count != 0)
+		{
+			UARTWriteString(" min=");
+			UARTWriteNumber(snapshot[id].min);
+			UARTWriteString(" max=");
+			UARTWriteNumber(snapshot[id].max);
+			UARTWriteString(" mean=");
+			UARTWriteNumber((uint32_t)(snapshot[id].total / snapshot[id].count));
+		}
+
+		UARTWriteString(" missed=");
+		UARTWriteNumber(snapshot[id].missed);
+		UARTWriteString("\r\n");
+
+		for(bucket = 0; bucket < PROFILE_BUCKETS; ++bucket)
+		{
+			if(snapshot[id].histogram[bucket] == 0)
+				continue;
+
+			UARTTransmit(' ');
+			UARTWriteNumber(bucket);
+			UARTTransmit(':');
+			UARTWriteNumber(snapshot[id].histogram[bucket]);
+		}
+
+		UARTWriteString("\r\n");
+	}
+}
@@ -0,0 +1,320 @@
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+#include "UART.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "LedMatrix.h"
+
+// Where the parser is within a frame
+typedef enum {WAIT_SYNC, WAIT_OPCODE, WAIT_LENGTH, WAIT_PAYLOAD, WAIT_CRC} ParserState;
+
+// Most bytes a frame has after its SYNC: opcode, length, payload and CRC
+#define FRAME_BYTES (PROTOCOL_MAX_PAYLOAD + 3)
+
+static ParserState state = WAIT_SYNC;
+static uint8_t cur_length;
+static uint8_t cur_crc;		// CRC of everything received so far
+static uint8_t frame[FRAME_BYTES];	// The bytes of the frame so far, after its SYNC (the payload starts at frame[2])
+static uint16_t frame_count;
+static uint8_t rescan[FRAME_BYTES];	// The bytes of a dropped frame, while they go through the parser again
+static uint32_t last_byte;	// CYCLE_COUNT() after the last byte went through the parser
+static uint32_t crc_errors;
+
+static CommandHandler handlers[PROTOCOL_MAX_OPCODES];
+static AsciiHandler ascii_handler;
+
+/**
+ * @brief	Adds a byte to a CRC8 (polynomial 0x07)
+ *
+ * @param	crc The CRC so far
+ * @param	data The byte to add
+ *
+ * @retval	The new CRC
+ */
+static uint8_t Crc8(uint8_t crc, uint8_t data)
+{
+	uint8_t bit;
+
+	crc ^= data;
+
+	for(bit = 0; bit < 8; ++bit)
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+
+	return crc;
+}
+
+/**
+ * @brief	Handles OP_SET_BAUD, changes the baud rate
+ *
+ * @param	data The new baud rate (4 bytes)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void SetBaudCommand(const uint8_t *data, uint8_t length)
+{
+	if(length == 4)
+		UARTSetBaudRate(READ_LE32(data));
+}
+
+/**
+ * @brief	Handles OP_PROFILE, sends the profiling report
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void ProfileCommand(const uint8_t *data, uint8_t length)
+{
+	ProfilerReport();
+}
+
+/**
+ * @brief	Handles OP_BENCHMARK, runs the benchmarks
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void BenchmarkCommand(const uint8_t *data, uint8_t length)
+{
+	RunBenchmarks();
+}
+
+/**
+ * @brief	Handles OP_CALIBRATE, calibrates the BCM timing
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void CalibrateCommand(const uint8_t *data, uint8_t length)
+{
+	RunCalibration();
+}
+
+/**
+ * @brief	Handles OP_BRIGHTNESS, sets the brightness of the whole display
+ *
+ * @param	data The brightness (one byte)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void BrightnessCommand(const uint8_t *data, uint8_t length)
+{
+	if(length == 1)
+		SetBrightness(data[0]);
+}
+
+/**
+ * @brief	Registers the commands that don't belong to the game
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitProtocol(void)
+{
+	ProtocolRegister(OP_SET_BAUD, SetBaudCommand);
+	ProtocolRegister(OP_PROFILE, ProfileCommand);
+	ProtocolRegister(OP_BENCHMARK, BenchmarkCommand);
+	ProtocolRegister(OP_CALIBRATE, CalibrateCommand);
+	ProtocolRegister(OP_BRIGHTNESS, BrightnessCommand);
+}
+
+/**
+ * @brief	Sets which function handles frames with an opcode
+ *
+ * @param	opcode The opcode to handle (below PROTOCOL_MAX_OPCODES)
+ * @param	handler The function to call, or 0 to ignore the opcode
+ *
+ * @retval	none
+ */
+void ProtocolRegister(uint8_t opcode, CommandHandler handler)
+{
+	if(opcode < PROTOCOL_MAX_OPCODES)
+		handlers[opcode] = handler;
+}
+
+/**
+ * @brief	Sets which function handles bytes received outside of a frame
+ *
+ * @param	handler The function to call, or 0 to ignore those bytes
+ *
+ * @retval	none
+ */
+void ProtocolSetAsciiHandler(AsciiHandler handler)
+{
+	ascii_handler = handler;
+}
+
+/**
+ * @brief	Runs one byte through the parser. Once a whole frame with a
+ * 			good CRC has been received, its handler gets called.
+ *
+ * @param	data The byte
+ *
+ * @retval	1 if the byte ended a frame with a bad CRC, otherwise 0
+ */
+static uint8_t ParseByte(uint8_t data)
+{
+	if(state != WAIT_SYNC)
+		frame[frame_count++] = data;
+
+	switch(state)
+	{
+		case WAIT_SYNC:
+			if(data == PROTOCOL_SYNC)
+			{
+				frame_count = 0;
+				state = WAIT_OPCODE;
+			}
+			else if(ascii_handler != 0)
+				ascii_handler(data);
+			break;
+
+		case WAIT_OPCODE:
+			cur_crc = Crc8(0, data);
+			state = WAIT_LENGTH;
+			break;
+
+		case WAIT_LENGTH:
+			cur_length = data;
+			cur_crc = Crc8(cur_crc, data);
+			state = (cur_length == 0) ? WAIT_CRC : WAIT_PAYLOAD;
+			break;
+
+		case WAIT_PAYLOAD:
+			cur_crc = Crc8(cur_crc, data);
+
+			if(frame_count == cur_length + 2)
+				state = WAIT_CRC;
+			break;
+
+		case WAIT_CRC:
+		default:
+			state = WAIT_SYNC;
+
+			if(data != cur_crc)
+				return 1;
+
+			if(frame[0] < PROTOCOL_MAX_OPCODES && handlers[frame[0]] != 0)
+				handlers[frame[0]](&frame[2], cur_length);
+			break;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Drops the frame being received, and runs its bytes after its
+ * 			SYNC through the parser again. A stray SYNC or a corrupt length
+ * 			only costs the frame it started then, not the frames and ASCII
+ * 			bytes that came after it.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void Resync(void)
+{
+	uint16_t count = frame_count, start = 0, i;
+
+	crc_errors++;
+	memcpy(rescan, frame, count);
+	state = WAIT_SYNC;
+
+	for(i = 0; i < count; ++i)
+	{
+		if(state == WAIT_SYNC && rescan[i] == PROTOCOL_SYNC)
+			start = i;
+
+		// A frame that started in there is dropped the same way, so carry on after its SYNC
+		if(ParseByte(rescan[i]))
+		{
+			crc_errors++;
+			i = start;
+		}
+	}
+}
+
+/**
+ * @brief	Feeds one received byte into the protocol. Once a whole frame
+ * 			with a good CRC has been received, its handler gets called.
+ *
+ * @param	data The received byte
+ *
+ * @retval	none
+ */
+void ProtocolReceive(uint8_t data)
+{
+	ProtocolCheckTimeout();
+
+	if(ParseByte(data))
+		Resync();
+
+	last_byte = CYCLE_COUNT();
+}
+
+/**
+ * @brief	Drops the frame being received if no byte of it came for
+ * 			PROTOCOL_BYTE_TIMEOUT, and runs its bytes through the parser
+ * 			again (see Resync()). Call it once everything received has been
+ * 			fed in, so bytes waiting in the receive buffer don't count as
+ * 			missing.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ProtocolCheckTimeout(void)
+{
+	// None of the bytes are going to be followed by the rest of their frame
+	while(state != WAIT_SYNC && CYCLE_COUNT() - last_byte > PROTOCOL_BYTE_TIMEOUT)
+		Resync();
+}
+
+/**
+ * @brief	Sends a frame over the UART
+ *
+ * @param	opcode The frame's opcode
+ * @param	data The payload
+ * @param	length How many bytes of payload there are
+ *
+ * @retval	none
+ */
+void ProtocolSend(uint8_t opcode, const uint8_t *data, uint8_t length)
+{
+	uint8_t crc = Crc8(Crc8(0, opcode), length);
+	uint8_t i;
+
+	UARTTransmit(PROTOCOL_SYNC);
+	UARTTransmit(opcode);
+	UARTTransmit(length);
+
+	for(i = 0; i < length; ++i)
+	{
+		UARTTransmit(data[i]);
+		crc = Crc8(crc, data[i]);
+	}
+
+	UARTTransmit(crc);
+}
+
+/**
+ * @brief	Returns the number of frames dropped because of a bad CRC, or
+ * 			because the rest of them never came
+ *
+ * @param	none
+ *
+ * @retval	The number of dropped frames since startup
+ */
+uint32_t ProtocolErrors(void)
+{
+	return crc_errors;
+}
@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include "replay.h"
+#include "pacman.h"
+#include "ghost.h"
+#include "protocol.h"
+
+// What the recorder is doing
+typedef enum {REPLAY_IDLE, REPLAY_RECORDING, REPLAY_PLAYING} ReplayState;
+
+static ReplayState state = REPLAY_IDLE;
+
+// Records waiting to be exported or played back
+static uint16_t records[REPLAY_BUFFER_SIZE];
+static uint16_t head;	// Where the next record gets stored
+static uint16_t tail;	// The oldest record
+static uint32_t overflows;
+
+static uint32_t tick;			// Game ticks since the reset
+static uint32_t last_tick;		// Tick of the last record stored or played back
+static uint32_t end_tick;		// Last tick of a playback
+static PacmanDir last_dir;		// Direction of the last record stored or played back
+
+/**
+ * @brief	Stores a record for the current tick
+ *
+ * @param	dir The direction pacman moves in from this tick on
+ *
+ * @retval	none
+ */
+static void StoreRecord(PacmanDir dir)
+{
+	if((uint16_t)(head - tail) >= REPLAY_BUFFER_SIZE)
+	{
+		overflows++;
+		return;
+	}
+
+	records[head & (REPLAY_BUFFER_SIZE - 1)] = ((uint16_t)dir << REPLAY_DIR_SHIFT) | (uint16_t)(tick - last_tick);
+	head++;
+
+	last_tick = tick;
+	last_dir = dir;
+}
+
+/**
+ * @brief	Sends the number of ticks and the state of the game
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void SendResult(void)
+{
+	uint8_t payload[8];
+	uint32_t hash = GameStateHash();
+
+	WRITE_LE32(&payload[0], tick);
+	WRITE_LE32(&payload[4], hash);
+	ProtocolSend(OP_REPLAY_RESULT, payload, sizeof(payload));
+}
+
+/**
+ * @brief	Resets the game and the tick count
+ *
+ * @param	seed The seed for the game's random numbers
+ *
+ * @retval	none
+ */
+static void Restart(uint32_t seed)
+{
+	ResetGame(seed);
+	SetGhostDeterministic(1);
+	PauseGame(0);
+
+	tick = 0;
+	last_tick = 0;
+	last_dir = RIGHT;
+}
+
+/**
+ * @brief	Handles OP_REPLAY_RECORD, resets the game and starts recording
+ *
+ * @param	data The seed (4 bytes)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void RecordCommand(const uint8_t *data, uint8_t length)
+{
+	if(length != 4)
+		return;
+
+	head = tail = 0;
+	overflows = 0;
+
+	Restart(READ_LE32(data));
+	state = REPLAY_RECORDING;
+}
+
+/**
+ * @brief	Handles OP_REPLAY_PLAY, resets the game and starts playing the
+ * 			queued records back
+ *
+ * @param	data The seed (4 bytes) and the number of ticks to play (4 bytes)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void PlayCommand(const uint8_t *data, uint8_t length)
+{
+	if(length != 8)
+		return;
+
+	Restart(READ_LE32(data));
+	end_tick = READ_LE32(&data[4]);
+	state = REPLAY_PLAYING;
+}
+
+/**
+ * @brief	Handles OP_REPLAY_STOP
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void StopCommand(const uint8_t *data, uint8_t length)
+{
+	switch(state)
+	{
+		case REPLAY_RECORDING:
+			// Marks how long the recording is
+			StoreRecord(last_dir);
+			SendResult();
+			break;
+
+		case REPLAY_PLAYING:
+			head = tail = 0;
+			break;
+
+		default:
+			head = tail = 0;
+			overflows = 0;
+			break;
+	}
+
+	state = REPLAY_IDLE;
+	SetGhostDeterministic(0);
+	PauseGame(0);
+}
+
+/**
+ * @brief	Handles OP_REPLAY_EXPORT, sends the buffered records
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void ExportCommand(const uint8_t *data, uint8_t length)
+{
+	uint8_t payload[PROTOCOL_MAX_PAYLOAD - 1];
+	uint8_t count;
+	uint16_t record;
+
+	while(tail != head)
+	{
+		for(count = 0; tail != head && count < sizeof(payload); count += 2, tail++)
+		{
+			record = records[tail & (REPLAY_BUFFER_SIZE - 1)];
+			payload[count] = record & 0xFF;
+			payload[count + 1] = record >> 8;
+		}
+
+		ProtocolSend(OP_REPLAY_DATA, payload, count);
+	}
+}
+
+/**
+ * @brief	Handles OP_REPLAY_DATA, queues records for playback
+ *
+ * @param	data The records (2 bytes each)
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void DataCommand(const uint8_t *data, uint8_t length)
+{
+	for(; length >= 2; data += 2, length -= 2)
+	{
+		if((uint16_t)(head - tail) >= REPLAY_BUFFER_SIZE)
+		{
+			overflows++;
+			continue;
+		}
+
+		records[head & (REPLAY_BUFFER_SIZE - 1)] = data[0] | ((uint16_t)data[1] << 8);
+		head++;
+	}
+}
+
+/**
+ * @brief	Registers the replay commands with the protocol
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitReplay(void)
+{
+	ProtocolRegister(OP_REPLAY_RECORD, RecordCommand);
+	ProtocolRegister(OP_REPLAY_PLAY, PlayCommand);
+	ProtocolRegister(OP_REPLAY_STOP, StopCommand);
+	ProtocolRegister(OP_REPLAY_EXPORT, ExportCommand);
+	ProtocolRegister(OP_REPLAY_DATA, DataCommand);
+}
+
+/**
+ * @brief	Records or plays back the direction for the tick that's starting
+ *
+ * @param	dir The direction pacman was steered in by the live input
+ *
+ * @retval	The direction pacman should move in this tick
+ */
+PacmanDir ReplayTick(PacmanDir dir)
+{
+	uint16_t record;
+
+	tick++;
+
+	if(state == REPLAY_RECORDING)
+	{
+		if(dir != last_dir || tick - last_tick >= REPLAY_MAX_DELTA)
+			StoreRecord(dir);
+
+		return dir;
+	}
+
+	if(state == REPLAY_PLAYING)
+	{
+		// Apply every record that's due (there's only ever one per tick when recorded here)
+		while(tail != head)
+		{
+			record = records[tail & (REPLAY_BUFFER_SIZE - 1)];
+
+			if(last_tick + (record & REPLAY_MAX_DELTA) != tick)
+				break;
+
+			last_tick = tick;
+			last_dir = (PacmanDir)(record >> REPLAY_DIR_SHIFT);
+			tail++;
+		}
+
+		return last_dir;
+	}
+
+	return dir;
+}
+
+/**
+ * @brief	Finishes a playback once its last tick has run, and pauses
+ * 			the game until the next OP_REPLAY_STOP
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void ReplayTickDone(void)
+{
+	if(state != REPLAY_PLAYING || tick < end_tick)
+		return;
+
+	SendResult();
+
+	// Hold the last frame, so it can be captured (see capture.h)
+	PauseGame(1);
+
+	state = REPLAY_IDLE;
+	head = tail = 0;
+	SetGhostDeterministic(0);
+}
+
+/**
+ * @brief	Tells whether a recording or a playback is going on
+ *
+ * @param	none
+ *
+ * @retval	1 while recording or playing back, 0 otherwise
+ */
+uint8_t IsReplaying(void)
+{
+	return state != REPLAY_IDLE;
+}
+
+/**
+ * @brief	Returns the number of records lost because the buffer was full
+ *
+ * @param	none
+ *
+ * @retval	The number of lost records since the last reset of the buffer
+ */
+uint32_t ReplayOverflows(void)
+{
+	return overflows;
+}
@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include "scheduler.h"
+#include "utility.h"
+
+// One flag per event. Interrupts only ever set a flag and the scheduler only
+// clears it, and a byte store is atomic, so no locking is needed.
+static volatile uint8_t pending[EVENT_COUNT];
+
+static TaskHandler tasks[EVENT_COUNT];
+
+/**
+ * @brief	Sets the task that runs when an event is posted
+ *
+ * @param	event The event
+ * @param	handler The task to run (or 0 to ignore the event)
+ *
+ * @retval	none
+ */
+void SchedulerRegister(Event event, TaskHandler handler)
+{
+	if(event < EVENT_COUNT)
+		tasks[event] = handler;
+}
+
+/**
+ * @brief	Marks an event as pending. Only sets a flag, so it's cheap
+ * 			enough to call from any interrupt.
+ *
+ * @param	event The event
+ *
+ * @retval	none
+ */
+void PostEvent(Event event)
+{
+	pending[event] = 1;
+}
+
+/**
+ * @brief	Runs an event's task right away, without posting the event.
+ * 			Only call this from thread mode (like from another task).
+ *
+ * @param	event The event
+ *
+ * @retval	none
+ */
+void RunTask(Event event)
+{
+	if(event < EVENT_COUNT && tasks[event])
+		tasks[event]();
+}
+
+/**
+ * @brief	Finds the first pending event
+ *
+ * @param	none
+ *
+ * @retval	The event, or EVENT_COUNT if none are pending
+ */
+static Event NextEvent(void)
+{
+	uint8_t event;
+
+	for(event = 0; event < EVENT_COUNT; ++event)
+	{
+		if(pending[event])
+			return (Event)event;
+	}
+
+	return EVENT_COUNT;
+}
+
+/**
+ * @brief	Runs the tasks of posted events forever, highest priority
+ * 			first, and sleeps until the next interrupt whenever there's
+ * 			nothing to do.
+ *
+ * @param	none
+ *
+ * @retval	none (never returns)
+ */
+void RunScheduler(void)
+{
+	Event event;
+
+	while(1)
+	{
+		// Interrupts are masked between checking for events and sleeping, so an
+		// event posted in between still wakes the core (WFI wakes on pending
+		// interrupts even while they're masked, and they run once unmasked)
+		DISABLE_INTERRUPTS();
+		event = NextEvent();
+
+		if(event == EVENT_COUNT)
+			WAIT_FOR_INTERRUPT();
+
+		ENABLE_INTERRUPTS();
+
+		if(event == EVENT_COUNT)
+			continue;
+
+		// Clear the flag first so a post while the task runs isn't lost
+		pending[event] = 0;
+
+		if(tasks[event])
+			tasks[event]();
+	}
+}
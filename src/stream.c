@@ -0,0 +1,306 @@
+#include <stdint.h>
+#include <string.h>
+#include "stream.h"
+#include "LedMatrix.h"
+#include "protocol.h"
+#include "scheduler.h"
+
+// Number of pixels in a frame
+#define STREAM_PIXELS (MAX_ROWS * MAX_COLS)
+
+// What the decoder expects next in the token stream
+typedef enum {WAIT_TOKEN, WAIT_RGB, WAIT_INDEX} DecoderState;
+
+static volatile uint8_t streaming;
+static uint8_t decoding;		// Set between OP_STREAM_BEGIN and OP_STREAM_END
+static uint8_t begin_waiting;	// Set while OP_STREAM_BEGIN waits for the last frame to be displayed
+
+static DecoderState state = WAIT_TOKEN;
+static uint16_t cursor;			// Next pixel to decode (row * MAX_COLS + col)
+static uint8_t run;				// Pixels the current color token covers
+static uint8_t rgb[3];			// Color bytes received so far
+static uint8_t rgb_count;
+
+static Color palette[STREAM_PALETTE_SIZE];
+
+// Pixels written by the frame being decoded, and by the frame decoded before it
+static GridArray written;
+static GridArray last_written;
+
+/**
+ * @brief	Scales an 8 bit color component down to the display's color depth
+ *
+ * @param	value The 8 bit component
+ *
+ * @retval	The component from 0 to COLOR_MAX
+ */
+static uint8_t ScaleComponent(uint8_t value)
+{
+	return value >> (8 - COLOR_BITS);
+}
+
+/**
+ * @brief	Draws the current color over the next run pixels of the frame
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void FillRun(void)
+{
+	uint8_t row, col, length;
+
+	while(run != 0 && cursor < STREAM_PIXELS)
+	{
+		row = cursor / MAX_COLS;
+		col = cursor % MAX_COLS;
+		length = (run < MAX_COLS - col) ? run : MAX_COLS - col;
+
+		DrawRowLine(row, col, length);
+
+		if(length == MAX_COLS)
+			written[row] = GRIDROW_ALL;
+		else
+			written[row] |= (((GridRow)1 << length) - 1) << col;
+
+		cursor += length;
+		run -= length;
+	}
+
+	run = 0;
+}
+
+/**
+ * @brief	Decodes one byte of a frame's token stream (see stream.h)
+ *
+ * @param	data The byte
+ *
+ * @retval	none
+ */
+static void DecodeByte(uint8_t data)
+{
+	switch(state)
+	{
+		case WAIT_TOKEN:
+			if(data < 0x80)
+			{
+				// Skipping past the end stops there, so the cursor can't wrap around into the frame
+				cursor = (data < STREAM_PIXELS - cursor) ? cursor + data + 1 : STREAM_PIXELS;
+			}
+			else
+			{
+				run = (data & 0x3F) + 1;
+				rgb_count = 0;
+				state = (data < 0xC0) ? WAIT_RGB : WAIT_INDEX;
+			}
+			break;
+
+		case WAIT_RGB:
+			rgb[rgb_count++] = data;
+
+			if(rgb_count == 3)
+			{
+				SetColor(ScaleComponent(rgb[0]), ScaleComponent(rgb[1]), ScaleComponent(rgb[2]));
+				FillRun();
+				state = WAIT_TOKEN;
+			}
+			break;
+
+		case WAIT_INDEX:
+			data %= STREAM_PALETTE_SIZE;
+			SetColor(palette[data].R, palette[data].G, palette[data].B);
+			FillRun();
+			state = WAIT_TOKEN;
+			break;
+	}
+}
+
+/**
+ * @brief	Handles OP_STREAM_MODE, turns streaming on or off
+ *
+ * @param	data 1 to start streaming, 0 to stop
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void StreamModeCommand(const uint8_t *data, uint8_t length)
+{
+	if(length != 1)
+		return;
+
+	// The back buffer holds whatever the game drew last, so the first frame has to copy everything
+	if(data[0] && !streaming)
+		memset(last_written, 0xFF, sizeof(last_written));
+
+	decoding = 0;
+	begin_waiting = 0;
+	streaming = (data[0] != 0);
+}
+
+/**
+ * @brief	Handles OP_STREAM_PALETTE, sets colors in the palette
+ *
+ * @param	data The first index, followed by R, G, B for each color
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void StreamPaletteCommand(const uint8_t *data, uint8_t length)
+{
+	uint8_t index;
+
+	if(length == 0)
+		return;
+
+	for(index = data[0], data++, length--; length >= 3 && index < STREAM_PALETTE_SIZE; ++index, data += 3, length -= 3)
+	{
+		palette[index].R = ScaleComponent(data[0]);
+		palette[index].G = ScaleComponent(data[1]);
+		palette[index].B = ScaleComponent(data[2]);
+	}
+}
+
+/**
+ * @brief	Gets the back buffer ready for a new frame, once the last one is
+ * 			on the display.
+ *
+ * 			After the last swap, the back buffer holds the frame before the
+ * 			one being displayed, so only the pixels the displayed frame wrote
+ * 			are out of date in it. Those get copied over, and the deltas of
+ * 			the new frame are decoded straight on top.
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+static void BeginFrame(void)
+{
+	CopyFrontPixels(last_written);
+	memset(written, 0, sizeof(written));
+
+	state = WAIT_TOKEN;
+	cursor = 0;
+	run = 0;
+	decoding = 1;
+}
+
+/**
+ * @brief	Handles OP_STREAM_BEGIN, starts a new frame. If the last frame
+ * 			isn't on the display yet, the back buffer can't be touched, so
+ * 			the frame starts in StreamFramePresented() instead, and the
+ * 			input after this waits until then (see IsStreamWaiting()).
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void StreamBeginCommand(const uint8_t *data, uint8_t length)
+{
+	if(!streaming)
+		return;
+
+	decoding = 0;
+
+	if(FramePending())
+		begin_waiting = 1;
+	else
+		BeginFrame();
+}
+
+/**
+ * @brief	Handles OP_STREAM_DATA, decodes the next part of the frame
+ *
+ * @param	data Part of the frame's token stream
+ * @param	length The length of data
+ *
+ * @retval	none
+ */
+static void StreamDataCommand(const uint8_t *data, uint8_t length)
+{
+	if(!decoding)
+		return;
+
+	while(length--)
+		DecodeByte(*data++);
+}
+
+/**
+ * @brief	Handles OP_STREAM_END, displays the decoded frame
+ *
+ * @param	data Unused
+ * @param	length Unused
+ *
+ * @retval	none
+ */
+static void StreamEndCommand(const uint8_t *data, uint8_t length)
+{
+	if(!decoding)
+		return;
+
+	memcpy(last_written, written, sizeof(last_written));
+	decoding = 0;
+
+	PresentFrame();
+}
+
+/**
+ * @brief	Registers the streaming commands with the protocol
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitStream(void)
+{
+	ProtocolRegister(OP_STREAM_MODE, StreamModeCommand);
+	ProtocolRegister(OP_STREAM_PALETTE, StreamPaletteCommand);
+	ProtocolRegister(OP_STREAM_BEGIN, StreamBeginCommand);
+	ProtocolRegister(OP_STREAM_DATA, StreamDataCommand);
+	ProtocolRegister(OP_STREAM_END, StreamEndCommand);
+}
+
+/**
+ * @brief	Called for EVENT_FRAME_PRESENTED, starts a frame that had to
+ * 			wait for the last one to be displayed, and lets the input after
+ * 			it be handled
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void StreamFramePresented(void)
+{
+	if(!begin_waiting || FramePending())
+		return;
+
+	begin_waiting = 0;
+	BeginFrame();
+	PostEvent(EVENT_INPUT);
+}
+
+/**
+ * @brief	Checks whether a frame is waiting for the last one to be
+ * 			displayed, in which case the input after OP_STREAM_BEGIN has to
+ * 			wait too
+ *
+ * @param	none
+ *
+ * @retval	1 while the received bytes must be left alone
+ */
+uint8_t IsStreamWaiting(void)
+{
+	return begin_waiting;
+}
+
+/**
+ * @brief	Checks whether streaming mode is on
+ *
+ * @param	none
+ *
+ * @retval	1 while the display shows streamed frames instead of the game
+ */
+uint8_t IsStreaming(void)
+{
+	return streaming;
+}
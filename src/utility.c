@@ -55,3 +55,19 @@ void SysTickDelay(uint32_t delay)
 
 	NVIC_ST_CTRL_R = 0;		// Turn off timer
 }
+
+/**
+ * @brief	Starts the DWT cycle counter. Afterwards, CYCLE_COUNT()
+ * 			returns the number of SYSCLK cycles since it started
+ * 			(wrapping around every 2^32 cycles).
+ *
+ * @param	none
+ *
+ * @retval	none
+ */
+void InitCycleCounter(void)
+{
+	DEMCR_R |= 0x01000000;	// Enable the DWT unit (TRCENA)
+	DWT_CYCCNT_R = 0;
+	DWT_CTRL_R |= 0x1;		// Start counting (CYCCNTENA)
+}
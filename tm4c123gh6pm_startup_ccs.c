@@ -35,10 +35,13 @@ extern uint32_t __STACK_TOP;
 // Timer 0 Subtimer A interrupt is in LedMatrix.c
 extern void Timer0AInt(void);
 
+// Timer 2 Subtimer A interrupt is in LedMatrix.c
+extern void Timer2AInt(void);
+
 // Timer 1 interrupt, located in pacman.c
 extern void Timer1Int(void);
 
-// UART4 interrupt, located in pacman.c
+// UART4 interrupt, located in UART.c
 extern void UART4Int(void);
 
 //*****************************************************************************
@@ -91,7 +94,7 @@ void (* const g_pfnVectors[])(void) =
     IntDefaultHandler,                      // Timer 0 subtimer B
     Timer1Int,                      		// Timer 1 subtimer A
     IntDefaultHandler,                      // Timer 1 subtimer B
-    IntDefaultHandler,                      // Timer 2 subtimer A
+    Timer2AInt,                      		// Timer 2 subtimer A
     IntDefaultHandler,                      // Timer 2 subtimer B
     IntDefaultHandler,                      // Analog Comparator 0
     IntDefaultHandler,                      // Analog Comparator 1